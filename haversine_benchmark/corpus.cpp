@@ -0,0 +1,112 @@
+#include "corpus.hpp"
+
+#include <stdexcept>
+#include <format>
+#include <fstream>
+#include <random>
+#include <string>
+#include <system_error>
+
+namespace
+{
+    // writing a corpus and generating its pairs again draw them the same way
+    globe_point_pair draw_point_pair(std::mt19937& engine)
+    {
+        std::uniform_real_distribution<double> x_distribution{ -180.0, 180.0 };
+        std::uniform_real_distribution<double> y_distribution{ -90.0, 90.0 };
+
+        return
+        {
+            .point1 = { .x = x_distribution(engine), .y = y_distribution(engine) },
+            .point2 = { .x = x_distribution(engine), .y = y_distribution(engine) }
+        };
+    }
+
+    void write_point_pair(std::ofstream& output_stream, const globe_point_pair& point_pair)
+    {
+        const auto& [p1, p2] = point_pair;
+        output_stream << std::format(R"({{ "x0": {}, "y0": {}, "x1": {}, "y1": {} }})", p1.x, p1.y, p2.x, p2.y);
+    }
+
+    void write_distance(std::ofstream& output_stream, double distance)
+    {
+        output_stream.write(reinterpret_cast<const char*>(&distance), sizeof(decltype(distance)));
+    }
+}
+
+benchmark_corpus::benchmark_corpus(uint64_t pair_count, bool write_json, uint32_t seed)
+    : m_pair_count{ pair_count }
+    , m_seed{ seed }
+{
+    const std::filesystem::path directory = std::filesystem::temp_directory_path();
+    const std::string stem = std::format("haversine_benchmark_{}_{}", pair_count, seed);
+
+    if (write_json)
+        m_json_path = directory / (stem + ".json");
+
+    m_answers_path = directory / (stem + ".f64");
+
+    std::ofstream json_stream;
+    if (write_json)
+        json_stream.open(m_json_path);
+
+    std::ofstream answers_stream{ m_answers_path, std::ios::binary };
+
+    if ((write_json && !json_stream) || !answers_stream)
+        throw std::runtime_error{ "Could not write the benchmark corpus to the temporary directory." };
+
+    std::mt19937 engine{ seed };
+
+    // the pairs are written as they are drawn, so generating a corpus holds none of them in memory
+    const double sum_coef = 1.0 / pair_count;
+
+    if (write_json)
+        json_stream << "{\n  \"pairs\": [\n";
+
+    for (uint64_t i = 0; i < pair_count; ++i)
+    {
+        const globe_point_pair point_pair = draw_point_pair(engine);
+
+        if (write_json)
+        {
+            json_stream << (i == 0 ? "    " : ",\n    ");
+            write_point_pair(json_stream, point_pair);
+        }
+
+        const double distance = haversine_distance(point_pair.point1, point_pair.point2);
+        write_distance(answers_stream, distance);
+        m_mean_distance += sum_coef * distance;
+    }
+
+    if (write_json)
+        json_stream << "\n  ]\n}\n";
+
+    if (pair_count > 0)
+        write_distance(answers_stream, m_mean_distance);
+
+    if ((write_json && !json_stream) || !answers_stream)
+        throw std::runtime_error{ "Could not write the benchmark corpus to the temporary directory." };
+}
+
+benchmark_corpus::~benchmark_corpus()
+{
+    std::error_code error;
+
+    if (!m_json_path.empty())
+        std::filesystem::remove(m_json_path, error);
+
+    std::filesystem::remove(m_answers_path, error);
+}
+
+std::vector<globe_point_pair> benchmark_corpus::generate_point_pairs() const
+{
+    std::mt19937 engine{ m_seed };
+
+    std::vector<globe_point_pair> point_pairs;
+    point_pairs.reserve(m_pair_count);
+
+    for (uint64_t i = 0; i < m_pair_count; ++i)
+        point_pairs.push_back(draw_point_pair(engine));
+
+    return point_pairs;
+}
@@ -0,0 +1,42 @@
+﻿#ifndef WS_CORPUS_HPP
+#define WS_CORPUS_HPP
+
+#include <cstdint>
+#include <filesystem>
+#include <vector>
+
+#include "../haversine_processor/haversine_formula.hpp"
+
+// A generated input in the formats haversine_input_generator writes: the pairs as JSON and their reference
+// distances, followed by the mean, as doubles. The points are spread uniformly over the globe by a fixed seed, so a
+// given pair count always gives the same bytes. The files are written to the temporary directory and removed with
+// the corpus.
+class benchmark_corpus
+{
+private:
+    uint64_t m_pair_count{};
+    uint32_t m_seed{};
+    double m_mean_distance{};
+    std::filesystem::path m_json_path;
+    std::filesystem::path m_answers_path;
+
+public:
+    static constexpr uint32_t default_seed = 0x5eed;
+
+    // without write_json only the answers are written, for corpora too large to parse
+    explicit benchmark_corpus(uint64_t pair_count, bool write_json = true, uint32_t seed = default_seed);
+    ~benchmark_corpus();
+
+    benchmark_corpus(const benchmark_corpus&) = delete;
+    benchmark_corpus& operator=(const benchmark_corpus&) = delete;
+
+    uint64_t pair_count() const { return m_pair_count; }
+    double mean_distance() const { return m_mean_distance; }
+    const std::filesystem::path& json_path() const { return m_json_path; }
+    const std::filesystem::path& answers_path() const { return m_answers_path; }
+
+    // the pairs the JSON holds, drawn again from the seed rather than parsed
+    std::vector<globe_point_pair> generate_point_pairs() const;
+};
+
+#endif
@@ -0,0 +1,386 @@
+#include <algorithm>
+#include <charconv>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <exception>
+#include <filesystem>
+#include <format>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <limits>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "../haversine_processor/haversine_formula.hpp"
+#include "../haversine_processor/json/model.hpp"
+#include "../haversine_processor/json/parser.hpp"
+#include "../haversine_processor/json/scanner.hpp"
+#include "../haversine_processor/json/token.hpp"
+#include "../haversine_processor/memory_probe.hpp"
+#include "../haversine_processor/platform_metrics.hpp"
+#include "../haversine_processor/point_input.hpp"
+#include "corpus.hpp"
+
+namespace
+{
+    // Each stage's input is loaded just before the stage is timed and freed after it. The scanner holds the JSON text
+    // and its tokens, and the parser the tokens and the document it builds, about 3 GB per million pairs, so they stop
+    // at 10 million. The stages that start from pairs or answers go on to 100 million, for which no JSON is written.
+    constexpr uint64_t corpus_pair_counts[] = { 1'000, 10'000, 100'000, 1'000'000, 10'000'000, 100'000'000 };
+    constexpr uint64_t max_text_pairs = 10'000'000;
+    constexpr uint64_t default_max_pairs = 1'000'000;
+    constexpr uint32_t default_repetitions = 10;
+
+    struct benchmark_arguments
+    {
+        uint64_t max_pairs = default_max_pairs;
+        uint32_t repetitions = default_repetitions;
+        bool memory_probe = false;
+    };
+
+    // what a stage needs, prepared before it is timed so each repetition only times the stage itself; a stage only
+    // loads its own part
+    struct stage_input
+    {
+        std::string json_path;
+        std::string answers_path;
+        uintmax_t file_size{};
+        uint64_t pair_count{};
+        double mean_distance{};
+        std::string contents;
+        size_t token_count{};
+        std::vector<json::token> tokens;
+        std::vector<globe_point_pair> point_pairs;
+    };
+
+    // load fills in the stage's part of the input, if it has one; run runs the stage once and returns the CPU timer
+    // ticks it took, and throws if the stage gets the wrong answer
+    struct stage_function
+    {
+        const char* name = nullptr;
+        uint64_t max_pair_count{};
+        void(*load)(const benchmark_corpus&, stage_input&) = nullptr;
+        uint64_t(*input_bytes)(const stage_input&) = nullptr;
+        uint64_t(*run)(const stage_input&) = nullptr;
+    };
+
+    std::string read_corpus_text(const benchmark_corpus& corpus)
+    {
+        std::ifstream input_file{ corpus.json_path(), std::ios::binary };
+        if (!input_file)
+            throw std::runtime_error{ "Cannot open the benchmark corpus." };
+
+        return { std::istreambuf_iterator<char>{ input_file }, std::istreambuf_iterator<char>{} };
+    }
+
+    // the text, and how many tokens scanning it gives
+    void load_text(const benchmark_corpus& corpus, stage_input& input)
+    {
+        input.contents = read_corpus_text(corpus);
+
+        std::istringstream input_stream{ input.contents };
+        input.token_count = json::scanner::scan(input_stream, input.file_size).size();
+    }
+
+    void load_tokens(const benchmark_corpus& corpus, stage_input& input)
+    {
+        std::istringstream input_stream{ read_corpus_text(corpus) };
+        input.tokens = json::scanner::scan(input_stream, input.file_size);
+    }
+
+    void load_point_pairs(const benchmark_corpus& corpus, stage_input& input)
+    {
+        input.point_pairs = corpus.generate_point_pairs();
+    }
+
+    // byte counts match the data_processed totals of the corresponding profile blocks
+
+    uint64_t file_bytes(const stage_input& input)
+    {
+        return input.file_size;
+    }
+
+    uint64_t token_bytes(const stage_input& input)
+    {
+        return input.tokens.size() * sizeof(json::token);
+    }
+
+    uint64_t pair_bytes(const stage_input& input)
+    {
+        return input.point_pairs.size() * sizeof(globe_point_pair);
+    }
+
+    uint64_t answer_bytes(const stage_input& input)
+    {
+        return (input.pair_count + 1) * sizeof(double);
+    }
+
+    // the corpus mean goes through a JSON round trip before the stages see it
+    bool matches_mean(double distance, double expected_distance)
+    {
+        return std::abs(distance - expected_distance) <= 1e-9 * std::abs(expected_distance);
+    }
+
+    uint64_t run_scan(const stage_input& input)
+    {
+        std::istringstream input_stream{ input.contents };
+
+        const uint64_t start = read_cpu_timer();
+        const std::vector<json::token> tokens = json::scanner::scan(input_stream, input.file_size);
+        const uint64_t elapsed = read_cpu_timer() - start;
+
+        if (tokens.size() != input.token_count)
+            throw std::runtime_error{ "The scanner produced a different number of tokens." };
+
+        return elapsed;
+    }
+
+    uint64_t run_parse(const stage_input& input)
+    {
+        const uint64_t start = read_cpu_timer();
+        const json::json_document document = json::parser::parse(input.tokens);
+        const uint64_t elapsed = read_cpu_timer() - start;
+
+        return elapsed;
+    }
+
+    uint64_t run_haversine(const stage_input& input)
+    {
+        const uint64_t start = read_cpu_timer();
+
+        const double sum_coeff = 1.0 / input.point_pairs.size();
+        double mean_distance = 0.0;
+
+        for (const auto& [p1, p2] : input.point_pairs)
+            mean_distance += sum_coeff * haversine_distance(p1, p2);
+
+        const uint64_t elapsed = read_cpu_timer() - start;
+
+        // also keeps the loop from being optimized away
+        if (!matches_mean(mean_distance, input.mean_distance))
+            throw std::runtime_error{ "The haversine mean does not match the corpus." };
+
+        return elapsed;
+    }
+
+    uint64_t run_reference(const stage_input& input)
+    {
+        const uint64_t start = read_cpu_timer();
+        const double reference_distance = read_reference_distance(input.answers_path, input.pair_count);
+        const uint64_t elapsed = read_cpu_timer() - start;
+
+        if (!matches_mean(reference_distance, input.mean_distance))
+            throw std::runtime_error{ "The reference mean does not match the corpus." };
+
+        return elapsed;
+    }
+
+    // read_reference_distance streams the answers file, so it has nothing to load
+    constexpr stage_function stage_functions[] =
+    {
+        { "scanner::scan", max_text_pairs, load_text, file_bytes, run_scan },
+        { "parser::parse", max_text_pairs, load_tokens, token_bytes, run_parse },
+        { "haversine_distance", std::ranges::max(corpus_pair_counts), load_point_pairs, pair_bytes, run_haversine },
+        { "read_reference_distance", std::ranges::max(corpus_pair_counts), nullptr, answer_bytes, run_reference },
+    };
+
+    struct sample_statistics
+    {
+        double mean{};
+        double deviation{};
+        double min{};
+    };
+
+    sample_statistics summarize(const std::vector<uint64_t>& samples, double scale)
+    {
+        sample_statistics statistics{ .min = std::numeric_limits<double>::max() };
+
+        for (const uint64_t sample : samples)
+        {
+            statistics.mean += sample * scale;
+            statistics.min = std::min(statistics.min, sample * scale);
+        }
+        statistics.mean /= samples.size();
+
+        if (samples.size() > 1)
+        {
+            double squares = 0.0;
+            for (const uint64_t sample : samples)
+                squares += (sample * scale - statistics.mean) * (sample * scale - statistics.mean);
+
+            statistics.deviation = std::sqrt(squares / (samples.size() - 1));
+        }
+
+        return statistics;
+    }
+
+    std::string format_statistics(const sample_statistics& statistics)
+    {
+        return std::format("{:10.3f} +/- {:<9.3f} (min {:.3f})", statistics.mean, statistics.deviation, statistics.min);
+    }
+
+    // the corpus's paths and totals, which every stage's input starts from
+    stage_input get_corpus_input(const benchmark_corpus& corpus)
+    {
+        return
+        {
+            .json_path = corpus.json_path().string(),
+            .answers_path = corpus.answers_path().string(),
+            .file_size = corpus.json_path().empty() ? 0 : std::filesystem::file_size(corpus.json_path()),
+            .pair_count = corpus.pair_count(),
+            .mean_distance = corpus.mean_distance(),
+            .contents = {},
+            .token_count = 0,
+            .tokens = {},
+            .point_pairs = {}
+        };
+    }
+
+    // Times every stage over one corpus, loading each stage's input in turn. The first run of each stage is left out:
+    // it pays for the page faults of memory the later runs reuse.
+    void benchmark_corpus_stages(const benchmark_corpus& corpus, uint32_t repetitions, double ns_per_tick)
+    {
+        const stage_input corpus_input = get_corpus_input(corpus);
+
+        if (corpus_input.file_size)
+            std::cout << std::format("\n--- {} pairs, {} JSON bytes ---\n", corpus_input.pair_count, corpus_input.file_size);
+        else
+            std::cout << std::format("\n--- {} pairs, no JSON ---\n", corpus_input.pair_count);
+
+        std::cout << std::format("{:<24} {:<42} {}\n", "stage", "ns/byte", "ns/pair");
+
+        for (const stage_function& stage : stage_functions)
+        {
+            if (corpus_input.pair_count > stage.max_pair_count)
+            {
+                std::cout << std::format("{:<24} skipped, its input would not fit in memory\n", stage.name);
+                continue;
+            }
+
+            // freed at the end of the iteration, before the next stage loads its own
+            stage_input input = corpus_input;
+            if (stage.load)
+                stage.load(corpus, input);
+
+            stage.run(input);
+
+            std::vector<uint64_t> samples;
+            samples.reserve(repetitions);
+
+            for (uint32_t i = 0; i < repetitions; ++i)
+                samples.push_back(stage.run(input));
+
+            const uint64_t byte_count = stage.input_bytes(input);
+
+            std::cout << std::format("{:<24} {:<42} {}\n", stage.name,
+                                     format_statistics(summarize(samples, ns_per_tick / byte_count)),
+                                     format_statistics(summarize(samples, ns_per_tick / input.pair_count)));
+        }
+    }
+
+    template<typename T>
+    bool parse_count(std::string_view value, T& count)
+    {
+        const auto [end, error] = std::from_chars(value.data(), value.data() + value.size(), count);
+        return error == std::errc{} && end == value.data() + value.size() && count > 0;
+    }
+
+    bool parse_arguments(int argc, char* argv[], benchmark_arguments& app_args, const std::string& usage_message)
+    {
+        constexpr std::string_view max_pairs_prefix = "--max-pairs=";
+        constexpr std::string_view repetitions_prefix = "--repetitions=";
+
+        for (int i = 1; i < argc; ++i)
+        {
+            const std::string_view arg = argv[i];
+
+            if (arg == "--memory")
+            {
+                app_args.memory_probe = true;
+                continue;
+            }
+
+            bool valid = false;
+            if (arg.starts_with(max_pairs_prefix))
+                valid = parse_count(arg.substr(max_pairs_prefix.size()), app_args.max_pairs) && app_args.max_pairs <= std::ranges::max(corpus_pair_counts);
+            else if (arg.starts_with(repetitions_prefix))
+                valid = parse_count(arg.substr(repetitions_prefix.size()), app_args.repetitions);
+
+            if (!valid)
+            {
+                std::cout << usage_message << "\n\n";
+                std::cout << "Invalid option '" << arg << "'.\n";
+                return false;
+            }
+        }
+
+        return true;
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    begin_timer_calibration();
+
+    const std::string exe_filename = std::filesystem::path(argv[0]).filename().string();
+    const std::string usage_message = "Usage: " + exe_filename + " [--max-pairs=<count>] [--repetitions=<count>] [--memory]\n\n"
+                                      "Times each stage of the haversine processor in isolation over generated inputs of 1,000 "
+                                      "pairs and up, by powers of ten, to <count> pairs (default "
+                                      + std::to_string(default_max_pairs) + "; the largest input is 100,000,000 pairs).\n"
+                                      "Each stage's input is held in memory while it is timed. The scanner and parser need about 3 GB per million\n"
+                                      "pairs and stop at 10,000,000; the haversine stage holds 32 bytes per pair, and read_reference_distance\n"
+                                      "streams its file.\n"
+                                      "Each stage runs <count> times (default " + std::to_string(default_repetitions) + ") per input. "
+                                      "Bytes are the stage's own input, as the profiler counts them.\n"
+                                      "--memory first measures read bandwidth and latency at each level of the memory hierarchy.";
+
+    benchmark_arguments app_args;
+    if (!parse_arguments(argc, argv, app_args, usage_message))
+        return EXIT_FAILURE;
+
+    try
+    {
+        const timer_calibration calibration = get_timer_calibration();
+        const uint64_t cpu_freq = calibration.cpu_freq;
+        if (!cpu_freq)
+            throw std::runtime_error{ "Failed to estimate CPU frequency." };
+
+        const double ns_per_tick = 1e9 / cpu_freq;
+
+        std::cout << "--- Haversine Benchmark ---\n\n";
+        std::cout << "CPU freq: " << cpu_freq << " (" << to_string(calibration.source) << ")\n";
+        std::cout << "Repetitions: " << app_args.repetitions << "\n";
+
+        if (app_args.memory_probe)
+        {
+            std::cout << '\n';
+            print_memory_hierarchy(probe_memory_hierarchy());
+        }
+
+        for (const uint64_t pair_count : corpus_pair_counts)
+        {
+            if (pair_count > app_args.max_pairs)
+                break;
+
+            const benchmark_corpus corpus{ pair_count, pair_count <= max_text_pairs };
+            benchmark_corpus_stages(corpus, app_args.repetitions, ns_per_tick);
+        }
+    }
+    catch (std::exception& ex)
+    {
+        std::cout << "ERROR!! " << ex.what() << '\n';
+        return EXIT_FAILURE;
+    }
+    catch (...)
+    {
+        std::cout << "UNKNOWN ERROR!!\n";
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -7,10 +7,14 @@
 #include <fstream>
 #include <format>
 #include <iostream>
+#include <iterator>
 #include <locale>
+#include <stdexcept>
 #include <string>
 #include <vector>
 
+#include "../haversine_processor/parallel.hpp"
+#include "../haversine_processor/task_scheduler.hpp"
 #include "haversine_formula.hpp"
 #include "random_generator.hpp"
 
@@ -155,10 +159,15 @@ namespace
         }
     }
 
-    void write_point_pair(std::ofstream& output_stream, const globe_point_pair& point_pair)
+    // formatting the pairs is most of the generator's time, so blocks of them are formatted in parallel, a batch
+    // of blocks at a time to bound the memory, and written out in order
+    constexpr size_t pairs_per_block = 4096;
+    constexpr size_t blocks_per_batch = 256;
+
+    void write_point_pair(std::string& text, const globe_point_pair& point_pair, bool last)
     {
         const auto& [p1, p2] = point_pair;
-        output_stream << std::format(R"({{ "x0": {}, "y0": {}, "x1": {}, "y1": {} }})", p1.x, p1.y, p2.x, p2.y);
+        std::format_to(std::back_inserter(text), R"(    {{ "x0": {}, "y0": {}, "x1": {}, "y1": {} }}{})", p1.x, p1.y, p2.x, p2.y, last ? "\n" : ",\n");
     }
 
     void save_haversine_json(const char* path, const std::vector<globe_point_pair>& data)
@@ -166,23 +175,40 @@ namespace
         std::ofstream output_stream{ path };
 
         if (!output_stream)
-            throw std::exception{ "Could not write input data JSON file." };
+            throw std::runtime_error{ "Could not write input data JSON file." };
 
         output_stream << "{\n  \"pairs\": [\n";
 
-        if (!data.empty())
+        if (data.empty())
+            output_stream << '\n';
+
+        const size_t block_count = (data.size() + pairs_per_block - 1) / pairs_per_block;
+        std::vector<std::string> blocks(std::min(block_count, blocks_per_batch));
+
+        for (size_t batch_begin = 0; batch_begin < block_count; batch_begin += blocks_per_batch)
         {
-            output_stream << "    ";
-            write_point_pair(output_stream, data[0]);
+            const size_t batch_size = std::min(blocks_per_batch, block_count - batch_begin);
 
-            for (size_t i = 1; i < data.size(); ++i)
+            parallel_for(batch_size, 0, [&](size_t begin, size_t end)
             {
-                output_stream << ",\n    ";
-                write_point_pair(output_stream, data[i]);
-            }
+                for (size_t block = begin; block < end; ++block)
+                {
+                    const size_t first_pair = (batch_begin + block) * pairs_per_block;
+                    const size_t last_pair = std::min(data.size(), first_pair + pairs_per_block);
+
+                    std::string& text = blocks[block];
+                    text.clear();
+
+                    for (size_t i = first_pair; i < last_pair; ++i)
+                        write_point_pair(text, data[i], i + 1 == data.size());
+                }
+            });
+
+            for (size_t block = 0; block < batch_size; ++block)
+                output_stream << blocks[block];
         }
 
-        output_stream << "\n  ]\n}\n";
+        output_stream << "  ]\n}\n";
 
         output_stream.close();
     }
@@ -192,7 +218,7 @@ namespace
         std::ofstream output_stream{ path, std::ios::binary };
 
         if (!output_stream)
-            throw std::exception{ "Could not write reference distance binary file." };
+            throw std::runtime_error{ "Could not write reference distance binary file." };
 
         if (!haversine_distances.empty())
         {
@@ -215,7 +241,7 @@ namespace
         std::ifstream input_file{ path, std::ios::binary };
 
         if (!input_file)
-            throw std::exception{ "Cannot open binary file." };
+            throw std::runtime_error{ "Cannot open binary file." };
 
         for (auto i = 0LL; i < expected_points && input_file.peek() && !input_file.eof(); ++i)
         {
@@ -276,36 +302,37 @@ int main(int argc, char* argv[])
 
         std::cout << "--- Haversine Distance Input Generator ---\n\n";
 
+        // one set of workers for generating and for formatting the output
+        const task_scheduler_scope scheduler;
+
         // generate pairs of coordinates
         std::cout << "Generating coordinate pairs...";
 
         const cluster_dimensions dimensions = get_cluster_dimensions(app_args);
 
-        uniform_real_generator x_rand_r1{ dimensions.x_min_r1, dimensions.x_max_r1 };
-        uniform_real_generator y_rand_r1{ dimensions.y_min_r1, dimensions.y_max_r1 };
-        uniform_real_generator x_rand_r2{ dimensions.x_min_r2, dimensions.x_max_r2 };
-        uniform_real_generator y_rand_r2{ dimensions.y_min_r2, dimensions.y_max_r2 };
+        std::vector<globe_point_pair> points(app_args.pair_count);
+        std::vector<double> distances(app_args.pair_count);
 
-        std::vector<globe_point_pair> points;
-        points.reserve(app_args.pair_count);
-
-        std::vector<double> distances;
-        distances.reserve(app_args.pair_count);
-
-        for (int i = 0; i < app_args.pair_count; ++i)
+        // every range draws from generators of its own, each seeded from the random device like a single set would be
+        parallel_for(points.size(), 0, [&](size_t begin, size_t end)
         {
-            auto point_pair = globe_point_pair
-            {
-                .point1 = { .x = x_rand_r1(), .y = y_rand_r1() },
-                .point2 = { .x = x_rand_r2(), .y = y_rand_r2() }
-            };
+            uniform_real_generator x_rand_r1{ dimensions.x_min_r1, dimensions.x_max_r1 };
+            uniform_real_generator y_rand_r1{ dimensions.y_min_r1, dimensions.y_max_r1 };
+            uniform_real_generator x_rand_r2{ dimensions.x_min_r2, dimensions.x_max_r2 };
+            uniform_real_generator y_rand_r2{ dimensions.y_min_r2, dimensions.y_max_r2 };
 
-            points.push_back(point_pair);
-
-            const auto& [p1, p2] = point_pair;
-            double distance = haversine_distance(p1, p2);
-            distances.push_back(distance);
-        }
+            for (size_t i = begin; i < end; ++i)
+            {
+                points[i] = globe_point_pair
+                {
+                    .point1 = { .x = x_rand_r1(), .y = y_rand_r1() },
+                    .point2 = { .x = x_rand_r2(), .y = y_rand_r2() }
+                };
+
+                const auto& [p1, p2] = points[i];
+                distances[i] = haversine_distance(p1, p2);
+            }
+        });
 
         std::cout << " done.\n\n";
 
@@ -0,0 +1,450 @@
+#include <algorithm>
+#include <charconv>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <exception>
+#include <filesystem>
+#include <format>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#if _WIN32
+#include <fcntl.h>
+#include <io.h>
+#include <share.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#include "../haversine_processor/mapped_file.hpp"
+#include "../haversine_processor/platform_metrics.hpp"
+#include "../haversine_repetition_tester/repetition_tester.hpp"
+
+namespace
+{
+    constexpr size_t kibibyte = 1024;
+    constexpr size_t mebibyte = 1024 * kibibyte;
+
+    constexpr size_t stream_chunk_size = mebibyte;
+    constexpr size_t min_read_chunk_size = 4 * kibibyte;
+    constexpr size_t max_read_chunk_size = 16 * mebibyte;
+
+    struct io_benchmark_arguments
+    {
+        const char* input_path = nullptr;
+        uint32_t seconds_to_try = repetition_tester::default_seconds_to_try;
+        bool cold_cache = false;
+    };
+
+    struct io_test_input
+    {
+        std::string path;
+        uint64_t file_size{};
+
+        // allocated and faulted in once, up front, for the test that reuses its buffer
+        std::vector<char> reused_buffer;
+    };
+
+    struct io_test
+    {
+        std::string name;
+        size_t chunk_size{};
+        void(*run)(repetition_tester&, io_test_input&, size_t) = nullptr;
+    };
+
+    // keeps the reads of the mapped file from being optimized away
+    volatile uint64_t mapped_sum{};
+
+#if _WIN32
+    int open_descriptor(const std::string& path)
+    {
+        int descriptor = -1;
+        _sopen_s(&descriptor, path.c_str(), _O_RDONLY | _O_BINARY, _SH_DENYNO, 0);
+        return descriptor;
+    }
+
+    int64_t read_descriptor(int descriptor, char* buffer, size_t size)
+    {
+        return _read(descriptor, buffer, static_cast<unsigned>(size));
+    }
+
+    void close_descriptor(int descriptor)
+    {
+        _close(descriptor);
+    }
+
+    std::FILE* open_stream(const std::string& path)
+    {
+        std::FILE* stream = nullptr;
+        return fopen_s(&stream, path.c_str(), "rb") == 0 ? stream : nullptr;
+    }
+#else
+    int open_descriptor(const std::string& path)
+    {
+        return open(path.c_str(), O_RDONLY);
+    }
+
+    int64_t read_descriptor(int descriptor, char* buffer, size_t size)
+    {
+        return read(descriptor, buffer, size);
+    }
+
+    void close_descriptor(int descriptor)
+    {
+        close(descriptor);
+    }
+
+    std::FILE* open_stream(const std::string& path)
+    {
+        return std::fopen(path.c_str(), "rb");
+    }
+#endif
+
+    // Asks the OS to drop the file's pages from its cache, so the next read has to go to the disk. Only Linux has a
+    // way to do this for one file.
+    bool drop_file_cache(const std::string& path)
+    {
+#if __linux__
+        const int descriptor = open(path.c_str(), O_RDONLY);
+        if (descriptor < 0)
+            return false;
+
+        const bool dropped = posix_fadvise(descriptor, 0, 0, POSIX_FADV_DONTNEED) == 0;
+        close(descriptor);
+
+        return dropped;
+#else
+        return false;
+#endif
+    }
+
+    // reads until the buffer is full or the file ends; returns the bytes read, or -1 on an error
+    int64_t read_fully(int descriptor, char* buffer, size_t size)
+    {
+        size_t total = 0;
+
+        while (total < size)
+        {
+            // a single read is capped well below the buffer sizes used here on some systems
+            const int64_t bytes_read = read_descriptor(descriptor, buffer + total, std::min<size_t>(size - total, 1024 * mebibyte));
+            if (bytes_read < 0)
+                return -1;
+
+            if (bytes_read == 0)
+                break;
+
+            total += static_cast<size_t>(bytes_read);
+        }
+
+        return static_cast<int64_t>(total);
+    }
+
+    // the character at a time reading scanner::scan does through its istream
+    void test_ifstream_get(repetition_tester& tester, io_test_input& input, size_t)
+    {
+        tester.begin_time();
+
+        std::ifstream input_file{ input.path, std::ios::binary };
+
+        uint64_t byte_count = 0;
+        for (auto next = input_file.get(); next != std::ifstream::traits_type::eof(); next = input_file.get())
+            ++byte_count;
+
+        tester.end_time();
+
+        tester.count_bytes(byte_count);
+    }
+
+    void test_ifstream_read(repetition_tester& tester, io_test_input& input, size_t chunk_size)
+    {
+        std::vector<char> buffer(chunk_size);
+
+        tester.begin_time();
+
+        std::ifstream input_file{ input.path, std::ios::binary };
+
+        uint64_t byte_count = 0;
+        while (input_file.read(buffer.data(), static_cast<std::streamsize>(buffer.size())) || input_file.gcount() > 0)
+            byte_count += static_cast<uint64_t>(input_file.gcount());
+
+        tester.end_time();
+
+        tester.count_bytes(byte_count);
+    }
+
+    void test_fread(repetition_tester& tester, io_test_input& input, size_t chunk_size)
+    {
+        std::vector<char> buffer(chunk_size);
+
+        tester.begin_time();
+
+        std::FILE* stream = open_stream(input.path);
+        if (!stream)
+        {
+            tester.end_time();
+            tester.error("Could not open the input file.");
+            return;
+        }
+
+        uint64_t byte_count = 0;
+        for (size_t bytes_read = std::fread(buffer.data(), 1, buffer.size(), stream); bytes_read > 0; bytes_read = std::fread(buffer.data(), 1, buffer.size(), stream))
+            byte_count += bytes_read;
+
+        tester.end_time();
+
+        std::fclose(stream);
+        tester.count_bytes(byte_count);
+    }
+
+    void test_read(repetition_tester& tester, io_test_input& input, size_t chunk_size)
+    {
+        std::vector<char> buffer(chunk_size);
+
+        tester.begin_time();
+
+        const int descriptor = open_descriptor(input.path);
+        if (descriptor < 0)
+        {
+            tester.end_time();
+            tester.error("Could not open the input file.");
+            return;
+        }
+
+        uint64_t byte_count = 0;
+        for (int64_t bytes_read = read_fully(descriptor, buffer.data(), buffer.size()); bytes_read > 0; bytes_read = read_fully(descriptor, buffer.data(), buffer.size()))
+            byte_count += static_cast<uint64_t>(bytes_read);
+
+        tester.end_time();
+
+        close_descriptor(descriptor);
+        tester.count_bytes(byte_count);
+    }
+
+    void read_whole_file(repetition_tester& tester, const io_test_input& input, char* buffer)
+    {
+        tester.begin_time();
+
+        const int descriptor = open_descriptor(input.path);
+        if (descriptor < 0)
+        {
+            tester.end_time();
+            tester.error("Could not open the input file.");
+            return;
+        }
+
+        const int64_t bytes_read = read_fully(descriptor, buffer, input.file_size);
+
+        tester.end_time();
+
+        close_descriptor(descriptor);
+
+        if (bytes_read < 0)
+        {
+            tester.error("Could not read the input file.");
+            return;
+        }
+
+        tester.count_bytes(static_cast<uint64_t>(bytes_read));
+    }
+
+    // a new, untouched buffer every time, so the read also pays for faulting its pages in
+    void test_read_fresh_buffer(repetition_tester& tester, io_test_input& input, size_t)
+    {
+        const std::unique_ptr<char[]> buffer{ new char[input.file_size] };
+        read_whole_file(tester, input, buffer.get());
+    }
+
+    void test_read_reused_buffer(repetition_tester& tester, io_test_input& input, size_t)
+    {
+        read_whole_file(tester, input, input.reused_buffer.data());
+    }
+
+    // Sums the whole file a word at a time: the read tests copy every byte, so the mapped ones read every byte too,
+    // not just one per page to fault it in.
+    void map_and_sum(repetition_tester& tester, const io_test_input& input, bool populate)
+    {
+        tester.begin_time();
+
+        const mapped_input_file mapped_file{ input.path, populate };
+        const std::span<const std::byte> bytes = mapped_file.bytes();
+
+        uint64_t sum = 0;
+        size_t offset = 0;
+
+        for (; offset + sizeof(uint64_t) <= bytes.size(); offset += sizeof(uint64_t))
+        {
+            uint64_t word = 0;
+            std::memcpy(&word, bytes.data() + offset, sizeof(word));
+            sum += word;
+        }
+
+        for (; offset < bytes.size(); ++offset)
+            sum += static_cast<uint64_t>(bytes[offset]);
+
+        tester.end_time();
+
+        mapped_sum = sum;
+        tester.count_bytes(bytes.size());
+    }
+
+    void test_mmap(repetition_tester& tester, io_test_input& input, size_t)
+    {
+        map_and_sum(tester, input, false);
+    }
+
+    void test_mmap_populate(repetition_tester& tester, io_test_input& input, size_t)
+    {
+        map_and_sum(tester, input, true);
+    }
+
+    std::string format_size(size_t size)
+    {
+        return size >= mebibyte ? std::format("{} MiB", size / mebibyte) : std::format("{} KiB", size / kibibyte);
+    }
+
+    std::vector<io_test> make_io_tests()
+    {
+        std::vector<io_test> tests
+        {
+            { "ifstream::get", 0, test_ifstream_get },
+            { std::format("ifstream::read, {} chunks", format_size(stream_chunk_size)), stream_chunk_size, test_ifstream_read },
+            { std::format("fread, {} chunks", format_size(stream_chunk_size)), stream_chunk_size, test_fread },
+        };
+
+        for (size_t chunk_size = min_read_chunk_size; chunk_size <= max_read_chunk_size; chunk_size *= 4)
+            tests.push_back({ std::format("read, {} chunks", format_size(chunk_size)), chunk_size, test_read });
+
+        tests.push_back({ "read whole file, fresh buffer", 0, test_read_fresh_buffer });
+        tests.push_back({ "read whole file, reused buffer", 0, test_read_reused_buffer });
+        tests.push_back({ "mmap", 0, test_mmap });
+        tests.push_back({ "mmap, populated", 0, test_mmap_populate });
+
+        return tests;
+    }
+
+    bool parse_arguments(int argc, char* argv[], io_benchmark_arguments& app_args, const std::string& usage_message)
+    {
+        constexpr std::string_view seconds_prefix = "--seconds=";
+
+        for (int i = 1; i < argc; ++i)
+        {
+            const std::string_view arg = argv[i];
+
+            if (arg.starts_with(seconds_prefix))
+            {
+                const std::string_view value = arg.substr(seconds_prefix.size());
+                const auto [end, error] = std::from_chars(value.data(), value.data() + value.size(), app_args.seconds_to_try);
+
+                if (error != std::errc{} || end != value.data() + value.size() || app_args.seconds_to_try == 0)
+                {
+                    std::cout << usage_message << "\n\n";
+                    std::cout << "Invalid option '" << arg << "'.\n";
+                    return false;
+                }
+            }
+            else if (arg == "--cold")
+            {
+                app_args.cold_cache = true;
+            }
+            else if (!arg.starts_with("--") && !app_args.input_path)
+            {
+                app_args.input_path = argv[i];
+            }
+            else
+            {
+                std::cout << usage_message << "\n\n";
+                std::cout << "Unrecognized option '" << arg << "'.\n";
+                return false;
+            }
+        }
+
+        if (!app_args.input_path)
+        {
+            std::cout << usage_message << "\n";
+            return false;
+        }
+
+        return true;
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    begin_timer_calibration();
+
+    const std::string exe_filename = std::filesystem::path(argv[0]).filename().string();
+    const std::string usage_message = "Usage: " + exe_filename + " [--seconds=<count>] [--cold] haversine_points.json\n\n"
+                                      "Reads the file with each I/O strategy until it goes <count> seconds (default "
+                                      + std::to_string(repetition_tester::default_seconds_to_try) + ") without a new fastest time,\n"
+                                      "reporting the throughput and the page faults taken.\n"
+                                      "--cold drops the file from the OS cache before every read (Linux only).";
+
+    io_benchmark_arguments app_args;
+    if (!parse_arguments(argc, argv, app_args, usage_message))
+        return EXIT_FAILURE;
+
+    try
+    {
+        const timer_calibration calibration = get_timer_calibration();
+        const uint64_t cpu_freq = calibration.cpu_freq;
+        if (!cpu_freq)
+            throw std::runtime_error{ "Failed to estimate CPU frequency." };
+
+        io_test_input input{ .path = app_args.input_path, .file_size = 0, .reused_buffer = {} };
+
+        if (!std::filesystem::exists(input.path))
+            throw std::runtime_error{ "Input file does not exist." };
+
+        input.file_size = std::filesystem::file_size(input.path);
+        if (input.file_size == 0)
+            throw std::runtime_error{ "The input file is empty." };
+
+        if (app_args.cold_cache && !drop_file_cache(input.path))
+            throw std::runtime_error{ "Cannot drop the input file from the OS cache on this system." };
+
+        input.reused_buffer.resize(input.file_size);
+
+        std::cout << "--- Haversine I/O Benchmark ---\n\n";
+        std::cout << "Input file: " << std::filesystem::path(input.path).filename().string() << "\n";
+        std::cout << "Input size: " << input.file_size << " bytes\n";
+        std::cout << "CPU freq: " << cpu_freq << " (" << to_string(calibration.source) << ")\n";
+        std::cout << "File cache: " << (app_args.cold_cache ? "dropped before every read" : "warm") << "\n";
+
+        for (const io_test& test : make_io_tests())
+        {
+            std::cout << "\n--- " << test.name << " ---\n";
+
+            repetition_tester tester;
+            tester.new_test_wave(input.file_size, cpu_freq, app_args.seconds_to_try);
+
+            while (tester.is_testing())
+            {
+                if (app_args.cold_cache)
+                    drop_file_cache(input.path);
+
+                test.run(tester, input, test.chunk_size);
+            }
+        }
+    }
+    catch (std::exception& ex)
+    {
+        std::cout << "ERROR!! " << ex.what() << '\n';
+        return EXIT_FAILURE;
+    }
+    catch (...)
+    {
+        std::cout << "UNKNOWN ERROR!!\n";
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
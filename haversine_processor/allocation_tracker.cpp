@@ -0,0 +1,172 @@
+#include "allocation_tracker.hpp"
+
+#include <cstddef>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+
+#if _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#include <psapi.h>
+
+#pragma comment(lib, "psapi.lib")
+#elif __linux__
+#include <sys/resource.h>
+#endif
+
+namespace
+{
+    // name of the innermost allocation-free region the thread is in, or null
+    thread_local const char* allocation_free_region = nullptr;
+
+#if PROFILER_ALLOCATIONS
+    // every block starts with its size, padded so the memory handed out keeps malloc's alignment
+    constexpr size_t header_size = alignof(std::max_align_t);
+
+    [[noreturn]] void report_allocation_in_free_region(size_t size)
+    {
+        // stdio rather than iostream, which may allocate
+        std::fprintf(stderr, "Allocation of %zu bytes in allocation-free region '%s'.\n", size, allocation_free_region);
+        std::abort();
+    }
+
+    void* allocate(size_t size) noexcept
+    {
+        if (allocation_free_region) [[unlikely]]
+            report_allocation_in_free_region(size);
+
+        void* block = std::malloc(size + header_size);
+        if (!block)
+            return nullptr;
+
+        *static_cast<size_t*>(block) = size;
+
+        allocation_counters& counters = thread_allocations;
+        ++counters.allocation_count;
+        counters.allocated_bytes += size;
+        counters.live_bytes += static_cast<int64_t>(size);
+
+        if (counters.live_bytes > counters.peak_live_bytes)
+            counters.peak_live_bytes = counters.live_bytes;
+
+        return static_cast<std::byte*>(block) + header_size;
+    }
+
+    void* allocate_or_throw(size_t size)
+    {
+        for (;;)
+        {
+            if (void* memory = allocate(size))
+                return memory;
+
+            const std::new_handler handler = std::get_new_handler();
+            if (!handler)
+                throw std::bad_alloc{};
+
+            handler();
+        }
+    }
+
+    void deallocate(void* memory) noexcept
+    {
+        if (!memory)
+            return;
+
+        void* block = static_cast<std::byte*>(memory) - header_size;
+        thread_allocations.live_bytes -= static_cast<int64_t>(*static_cast<size_t*>(block));
+
+        std::free(block);
+    }
+#endif
+}
+
+#if PROFILER_ALLOCATIONS
+
+// the over-aligned forms are left to the standard library; they never mix with these
+
+void* operator new(size_t size)
+{
+    return allocate_or_throw(size);
+}
+
+void* operator new[](size_t size)
+{
+    return allocate_or_throw(size);
+}
+
+void* operator new(size_t size, const std::nothrow_t&) noexcept
+{
+    return allocate(size);
+}
+
+void* operator new[](size_t size, const std::nothrow_t&) noexcept
+{
+    return allocate(size);
+}
+
+void operator delete(void* memory) noexcept
+{
+    deallocate(memory);
+}
+
+void operator delete[](void* memory) noexcept
+{
+    deallocate(memory);
+}
+
+void operator delete(void* memory, size_t) noexcept
+{
+    deallocate(memory);
+}
+
+void operator delete[](void* memory, size_t) noexcept
+{
+    deallocate(memory);
+}
+
+void operator delete(void* memory, const std::nothrow_t&) noexcept
+{
+    deallocate(memory);
+}
+
+void operator delete[](void* memory, const std::nothrow_t&) noexcept
+{
+    deallocate(memory);
+}
+
+#endif
+
+page_fault_counts read_page_faults()
+{
+#if _WIN32
+    PROCESS_MEMORY_COUNTERS memory_counters{};
+    if (!GetProcessMemoryInfo(GetCurrentProcess(), &memory_counters, sizeof(memory_counters)))
+        return {};
+
+    return { memory_counters.PageFaultCount, 0 };
+#elif __linux__
+    rusage usage{};
+    if (getrusage(RUSAGE_THREAD, &usage) != 0)
+        return {};
+
+    return { static_cast<uint64_t>(usage.ru_minflt), static_cast<uint64_t>(usage.ru_majflt) };
+#else
+    return {};
+#endif
+}
+
+allocation_free_scope::allocation_free_scope(const char* region_name, bool enabled)
+    : m_prev_region_name{ allocation_free_region }, m_enabled{ enabled }
+{
+    if (m_enabled)
+        allocation_free_region = region_name;
+}
+
+allocation_free_scope::~allocation_free_scope()
+{
+    if (m_enabled)
+        allocation_free_region = m_prev_region_name;
+}
@@ -0,0 +1,67 @@
+﻿#ifndef WS_ALLOCATIONTRACKER_HPP
+#define WS_ALLOCATIONTRACKER_HPP
+
+#include <cstdint>
+
+// allocation accounting and allocation-free assertions; replaces the global operator new and delete
+#ifndef PROFILER_ALLOCATIONS
+#define PROFILER_ALLOCATIONS 0
+#endif
+
+#if PROFILER_ALLOCATIONS
+
+#define ASSERT_NO_ALLOCATIONS_CONCAT_CORE(a, b) a##b
+#define ASSERT_NO_ALLOCATIONS_CONCAT(a, b) ASSERT_NO_ALLOCATIONS_CONCAT_CORE(a, b)
+
+// aborts the program as soon as the rest of the enclosing scope allocates on this thread
+#define ASSERT_NO_ALLOCATIONS(region_name) allocation_free_scope ASSERT_NO_ALLOCATIONS_CONCAT(allocation_free, __LINE__){ (region_name) }
+#define ASSERT_NO_ALLOCATIONS_IF(region_name, condition) allocation_free_scope ASSERT_NO_ALLOCATIONS_CONCAT(allocation_free, __LINE__){ (region_name), (condition) }
+
+#else
+
+#define ASSERT_NO_ALLOCATIONS(...)
+#define ASSERT_NO_ALLOCATIONS_IF(...)
+
+#endif
+
+// What operator new and delete have seen on one thread. Live bytes can go negative on a thread that frees memory
+// another thread allocated. The peak is a high-water mark of live bytes that profile blocks reset and restore to
+// find the peak inside each block.
+struct allocation_counters
+{
+    uint64_t allocation_count{};
+    uint64_t allocated_bytes{};
+    int64_t live_bytes{};
+    int64_t peak_live_bytes{};
+};
+
+inline thread_local allocation_counters thread_allocations{};
+
+struct page_fault_counts
+{
+    uint64_t minor_faults{};
+    uint64_t major_faults{};
+};
+
+// The calling thread's page faults so far (getrusage on Linux). Windows only has a process-wide count, with no
+// minor/major split, which is returned as minor faults.
+page_fault_counts read_page_faults();
+
+// Marks the rest of a scope as allocation-free on the calling thread; nested scopes are allowed.
+class allocation_free_scope final
+{
+private:
+    const char* m_prev_region_name = nullptr;
+    bool m_enabled = false;
+
+public:
+    explicit allocation_free_scope(const char* region_name, bool enabled = true);
+    ~allocation_free_scope();
+
+    allocation_free_scope(const allocation_free_scope&) = delete;
+    allocation_free_scope& operator=(const allocation_free_scope&) = delete;
+    allocation_free_scope(allocation_free_scope&&) noexcept = delete;
+    allocation_free_scope& operator=(allocation_free_scope&&) noexcept = delete;
+};
+
+#endif
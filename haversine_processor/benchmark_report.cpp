@@ -0,0 +1,579 @@
+#include "benchmark_report.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+#include <filesystem>
+#include <format>
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <optional>
+#include <thread>
+#include <vector>
+
+#include "json/json.hpp"
+#include "json/utilities.hpp"
+#include "platform_metrics.hpp"
+#include "profiler.hpp"
+
+namespace
+{
+    // a t statistic past this counts as a real difference: about p < 0.003 once there are a few dozen hits, and
+    // p < 0.02 with five repetitions a side
+    constexpr double significant_t = 3.0;
+
+    struct report_anchor
+    {
+        std::string name;
+        uint64_t hit_count{};
+        uint64_t timed_count{};
+        double exclusive_ms{};
+        double inclusive_ms{};
+
+        // the timed hits' spread, recorded for sampled anchors and, in builds with PROFILER_VARIANCE, for all
+        std::optional<double> mean_hit_ns;
+        std::optional<double> hit_ns_stddev;
+
+        // the inclusive time of each repetition
+        std::vector<double> repetition_ms;
+    };
+
+    // as read back for a comparison, with the total and the anchors' times per repetition
+    struct benchmark_report
+    {
+        std::string cpu;
+        double hardware_threads{};
+        double input_size{};
+        double pair_count{};
+        std::string kernel;
+        bool profiled = false;
+        report_anchor total;
+        std::vector<report_anchor> anchors;
+    };
+
+    enum class change_verdict
+    {
+        unchanged,
+        improved,
+        regressed,
+        untested
+    };
+
+    // what a change was measured on: the repetitions' times, the timed hits' times, or the totals alone
+    enum class change_basis
+    {
+        repetitions,
+        hits,
+        totals
+    };
+
+    struct anchor_change
+    {
+        change_basis basis = change_basis::totals;
+        double baseline_value{};
+        double candidate_value{};
+        double change_percent{};
+
+        // only when both sides have a spread to test against
+        std::optional<double> t;
+
+        change_verdict verdict = change_verdict::unchanged;
+    };
+
+    struct sample_spread
+    {
+        double mean{};
+        double variance{};
+        double count{};
+    };
+
+    // shortest round-trip form; JSON has no infinities or NaNs
+    std::string to_json_number(double value)
+    {
+        return std::isfinite(value) ? std::format("{}", value) : "0";
+    }
+
+    void write_machine(std::ofstream& output_stream, const timer_calibration& calibration)
+    {
+        output_stream << "  \"machine\": {\n";
+        output_stream << std::format("    \"cpu\": {},\n", json::to_json_string(read_cpu_brand()));
+        output_stream << std::format("    \"cpu_freq\": {},\n", calibration.cpu_freq);
+        output_stream << std::format("    \"cpu_freq_source\": {},\n", json::to_json_string(to_string(calibration.source)));
+        output_stream << std::format("    \"hardware_threads\": {}\n", std::thread::hardware_concurrency());
+        output_stream << "  },\n";
+    }
+
+    std::string to_json_object(const scaling_point& point)
+    {
+        return std::format("{{ \"name\": {}, \"duration_ms\": {}, \"speedup\": {}, \"efficiency\": {} }}",
+                           json::to_json_string(point.name), to_json_number(point.duration_ms), to_json_number(point.speedup), to_json_number(point.efficiency));
+    }
+
+    // a repetition's share of the anchor's running total
+    double get_repetition_duration(std::span<const benchmark_repetition> repetitions, size_t repetition, size_t anchor_index)
+    {
+        const auto running_duration = [&](size_t i)
+        {
+            const std::vector<double>& durations = repetitions[i].inclusive_durations;
+            return anchor_index < durations.size() ? durations[anchor_index] : 0.0;
+        };
+
+        return running_duration(repetition) - (repetition ? running_duration(repetition - 1) : 0.0);
+    }
+
+    std::vector<report_anchor> get_report_anchors(std::span<const benchmark_repetition> repetitions, double cpu_freq)
+    {
+        const double ms_per_tick = 1000.0 / cpu_freq;
+        const double ns_per_tick = 1000000000.0 / cpu_freq;
+
+        const std::vector<profile_anchor> anchors = profiler::get_anchors();
+        std::vector<report_anchor> report_anchors;
+
+        for (size_t anchor_index = 0; anchor_index < anchors.size(); ++anchor_index)
+        {
+            const profile_anchor& anchor = anchors[anchor_index];
+
+            if (!anchor.name || !anchor.hit_count)
+                continue;
+
+            const compensated_durations durations = profiler::get_compensated_durations(anchor);
+
+            report_anchor& report = report_anchors.emplace_back();
+            report.name = anchor.name;
+            report.hit_count = anchor.hit_count;
+            report.timed_count = anchor.timed_count;
+            report.exclusive_ms = durations.exclusive_duration * ms_per_tick;
+            report.inclusive_ms = durations.inclusive_duration * ms_per_tick;
+
+            // sampled anchors keep their spread in every build, the rest only with PROFILER_VARIANCE
+            if (anchor.timed_count && (PROFILER_VARIANCE || anchor.sample_period))
+            {
+                report.mean_hit_ns = anchor.timed_mean * ns_per_tick;
+                report.hit_ns_stddev = anchor.timed_count > 1 ? std::sqrt(anchor.timed_m2 / (anchor.timed_count - 1.0)) * ns_per_tick : 0.0;
+            }
+
+            for (size_t repetition = 0; repetition < repetitions.size(); ++repetition)
+                report.repetition_ms.push_back(get_repetition_duration(repetitions, repetition, anchor_index) * ms_per_tick);
+        }
+
+        // a stable order keeps reports diffable
+        std::ranges::sort(report_anchors, {}, &report_anchor::name);
+
+        return report_anchors;
+    }
+
+    double get_number(const json::json_object& object, const std::string& key)
+    {
+        const std::optional<json::float_literal> value = object.get_as_number(key);
+        if (!value)
+            throw std::runtime_error{ "The benchmark report is missing a value." };
+
+        return *value;
+    }
+
+    // reports from before repetitions were recorded have none
+    std::vector<double> get_numbers(const json::json_object& object, const std::string& key)
+    {
+        std::vector<double> numbers;
+
+        if (const json::json_array* array = object.get_as<json::json_array>(key))
+        {
+            for (const json::json_element& element : *array)
+            {
+                const std::optional<json::float_literal> number = element.as_number();
+                if (!number)
+                    throw std::runtime_error{ "The benchmark report has a repetition time that isn't a number." };
+
+                numbers.push_back(*number);
+            }
+        }
+
+        return numbers;
+    }
+
+    benchmark_report read_benchmark_report(const char* path)
+    {
+        const json::json_document document = json::deserialize_json(path);
+
+        const json::json_object* root = document.as<json::json_object>();
+        const json::json_object* machine = root ? root->get_as<json::json_object>("machine") : nullptr;
+        const json::json_object* input = root ? root->get_as<json::json_object>("input") : nullptr;
+        const json::json_object* total = root ? root->get_as<json::json_object>("total") : nullptr;
+        const json::json_array* anchors = root ? root->get_as<json::json_array>("anchors") : nullptr;
+
+        if (!machine || !input || !total || !anchors)
+            throw std::runtime_error{ "Not a benchmark report." };
+
+        benchmark_report report;
+
+        if (const std::string* cpu = machine->get_as<std::string>("cpu"))
+            report.cpu = *cpu;
+
+        report.hardware_threads = machine->get_as_number("hardware_threads").value_or(0.0);
+        report.input_size = get_number(*input, "size");
+        report.pair_count = get_number(*input, "pair_count");
+
+        if (const std::string* kernel = root->get_as<std::string>("kernel"))
+            report.kernel = *kernel;
+
+        if (const bool* profiled = root->get_as<bool>("profiling"))
+            report.profiled = *profiled;
+
+        report.total.name = "total";
+        report.total.inclusive_ms = get_number(*total, "duration_ms");
+        report.total.repetition_ms = get_numbers(*total, "repetition_ms");
+
+        // the anchors' totals cover every repetition, the report's total only the mean one
+        const double repetition_count = root->get_as_number("repetitions").value_or(1.0);
+
+        for (const json::json_element& element : *anchors)
+        {
+            const json::json_object* anchor = element.as<json::json_object>();
+            const std::string* name = anchor ? anchor->get_as<std::string>("name") : nullptr;
+
+            if (!name)
+                throw std::runtime_error{ "The benchmark report has an unnamed anchor." };
+
+            report.anchors.push_back({
+                .name = *name,
+                .hit_count = static_cast<uint64_t>(get_number(*anchor, "hit_count")),
+                .timed_count = static_cast<uint64_t>(get_number(*anchor, "timed_count")),
+                .exclusive_ms = get_number(*anchor, "exclusive_ms") / repetition_count,
+                .inclusive_ms = get_number(*anchor, "inclusive_ms") / repetition_count,
+                .mean_hit_ns = anchor->get_as_number("mean_hit_ns"),
+                .hit_ns_stddev = anchor->get_as_number("hit_ns_stddev"),
+                .repetition_ms = get_numbers(*anchor, "repetition_ms")
+            });
+        }
+
+        return report;
+    }
+
+    double percent_change(double baseline, double candidate)
+    {
+        return baseline > 0.0 ? 100.0 * (candidate - baseline) / baseline : 0.0;
+    }
+
+    // a change within the threshold stands; past it, only a significant one counts either way
+    change_verdict judge_change(double change_percent, double threshold_percent, std::optional<double> t)
+    {
+        if (std::abs(change_percent) <= threshold_percent)
+            return change_verdict::unchanged;
+
+        if (!t)
+            return change_verdict::untested;
+
+        if (std::abs(*t) <= significant_t)
+            return change_verdict::unchanged;
+
+        return change_percent > 0.0 ? change_verdict::regressed : change_verdict::improved;
+    }
+
+    sample_spread get_spread(std::span<const double> values)
+    {
+        sample_spread spread;
+        spread.count = static_cast<double>(values.size());
+
+        for (const double value : values)
+            spread.mean += value / spread.count;
+
+        for (const double value : values)
+            spread.variance += (value - spread.mean) * (value - spread.mean) / (spread.count - 1.0);
+
+        return spread;
+    }
+
+    sample_spread get_hit_spread(const report_anchor& anchor)
+    {
+        return { *anchor.mean_hit_ns, *anchor.hit_ns_stddev * *anchor.hit_ns_stddev, static_cast<double>(anchor.timed_count) };
+    }
+
+    double welch_t(const sample_spread& baseline, const sample_spread& candidate)
+    {
+        const double difference = candidate.mean - baseline.mean;
+        const double standard_error = std::sqrt(baseline.variance / baseline.count + candidate.variance / candidate.count);
+
+        if (standard_error > 0.0)
+            return difference / standard_error;
+
+        return difference ? std::copysign(std::numeric_limits<double>::infinity(), difference) : 0.0;
+    }
+
+    // Welch's t-test on the repetitions' times when both sides repeated the run, which takes in everything that
+    // varies between runs; on the timed hits' times when both sides have their spread; the totals alone otherwise
+    anchor_change compare_anchor(const report_anchor& baseline, const report_anchor& candidate, double threshold_percent)
+    {
+        anchor_change change;
+
+        if (baseline.repetition_ms.size() > 1 && candidate.repetition_ms.size() > 1)
+        {
+            const sample_spread baseline_spread = get_spread(baseline.repetition_ms);
+            const sample_spread candidate_spread = get_spread(candidate.repetition_ms);
+
+            change.basis = change_basis::repetitions;
+            change.baseline_value = baseline_spread.mean;
+            change.candidate_value = candidate_spread.mean;
+            change.t = welch_t(baseline_spread, candidate_spread);
+        }
+        else if (baseline.timed_count > 1 && candidate.timed_count > 1 && baseline.hit_ns_stddev && candidate.hit_ns_stddev)
+        {
+            change.basis = change_basis::hits;
+            change.baseline_value = *baseline.mean_hit_ns;
+            change.candidate_value = *candidate.mean_hit_ns;
+            change.t = welch_t(get_hit_spread(baseline), get_hit_spread(candidate));
+        }
+        else
+        {
+            change.baseline_value = baseline.inclusive_ms;
+            change.candidate_value = candidate.inclusive_ms;
+        }
+
+        change.change_percent = percent_change(change.baseline_value, change.candidate_value);
+        change.verdict = judge_change(change.change_percent, threshold_percent, change.t);
+
+        return change;
+    }
+
+    const char* to_string(change_verdict verdict)
+    {
+        switch (verdict)
+        {
+            case change_verdict::improved: return "  IMPROVED";
+            case change_verdict::regressed: return "  REGRESSED";
+            case change_verdict::untested: return "  NOT ENOUGH DATA";
+            case change_verdict::unchanged:
+            default: return "";
+        }
+    }
+
+    void print_anchor_change(const report_anchor& baseline, const report_anchor& candidate, const anchor_change& change)
+    {
+        switch (change.basis)
+        {
+            case change_basis::repetitions:
+                std::cout << std::format("  {}: {:.4f} ms -> {:.4f} ms ({:+.2f}%, t {:.1f} over {} and {} repetitions){}\n",
+                                         baseline.name, change.baseline_value, change.candidate_value, change.change_percent, *change.t,
+                                         baseline.repetition_ms.size(), candidate.repetition_ms.size(), to_string(change.verdict));
+                break;
+
+            case change_basis::hits:
+                std::cout << std::format("  {}: {:.3f} ns/hit -> {:.3f} ns/hit ({:+.2f}%, t {:.1f}){}\n",
+                                         baseline.name, change.baseline_value, change.candidate_value, change.change_percent, *change.t, to_string(change.verdict));
+                break;
+
+            case change_basis::totals:
+            default:
+                std::cout << std::format("  {}: {:.4f} ms -> {:.4f} ms ({:+.2f}%, untested){}\n",
+                                         baseline.name, change.baseline_value, change.candidate_value, change.change_percent, to_string(change.verdict));
+                break;
+        }
+    }
+
+    void write_repetition_times(std::ofstream& output_stream, std::span<const double> repetition_ms)
+    {
+        if (repetition_ms.empty())
+            return;
+
+        output_stream << ", \"repetition_ms\": [";
+
+        for (size_t i = 0; i < repetition_ms.size(); ++i)
+            output_stream << (i ? ", " : "") << to_json_number(repetition_ms[i]);
+
+        output_stream << ']';
+    }
+
+    void print_unmatched_anchors(const char* label, const benchmark_report& report, const benchmark_report& other)
+    {
+        std::string names;
+
+        for (const report_anchor& anchor : report.anchors)
+        {
+            if (std::ranges::find(other.anchors, anchor.name, &report_anchor::name) == other.anchors.end())
+                names += (names.empty() ? "" : ", ") + anchor.name;
+        }
+
+        if (!names.empty())
+            std::cout << label << names << '\n';
+    }
+}
+
+benchmark_repetition record_benchmark_repetition(uint64_t elapsed_cycles)
+{
+    benchmark_repetition repetition;
+    repetition.elapsed_cycles = elapsed_cycles;
+
+    for (const profile_anchor& anchor : profiler::get_anchors())
+        repetition.inclusive_durations.push_back(profiler::get_compensated_durations(anchor).inclusive_duration);
+
+    return repetition;
+}
+
+void write_benchmark_report(const char* path, const benchmark_run& run)
+{
+    const timer_calibration calibration = get_timer_calibration();
+
+    if (!calibration.cpu_freq)
+        throw std::runtime_error{ "Failed to estimate CPU frequency." };
+
+    std::ofstream output_stream{ path };
+
+    if (!output_stream)
+        throw std::runtime_error{ "Could not write report file." };
+
+    const double cpu_freq = static_cast<double>(calibration.cpu_freq);
+
+    std::vector<double> repetition_ms;
+    for (const benchmark_repetition& repetition : run.repetitions)
+        repetition_ms.push_back(1000.0 * repetition.elapsed_cycles / cpu_freq);
+
+    const double total_seconds = repetition_ms.empty() ? profiler::get_overall_duration() / cpu_freq : get_spread(repetition_ms).mean / 1000.0;
+    const double pairs_per_second = total_seconds > 0.0 ? run.pair_count / total_seconds : 0.0;
+    const double bytes_per_second = total_seconds > 0.0 ? run.input_size / total_seconds : 0.0;
+
+    // the blocks that fill in the anchors are timed inside the run, so their cost is part of the total
+    const bool profiled = PROFILER && profiler::is_enabled();
+
+    output_stream << "{\n";
+    write_machine(output_stream, calibration);
+    output_stream << std::format("  \"profiling\": {},\n", profiled ? "true" : "false");
+    output_stream << std::format("  \"repetitions\": {},\n", std::max<size_t>(run.repetitions.size(), 1));
+    output_stream << "  \"input\": {\n";
+    output_stream << std::format("    \"path\": {},\n", json::to_json_string(std::filesystem::path(run.input_path).filename().string()));
+    output_stream << std::format("    \"size\": {},\n", run.input_size);
+    output_stream << std::format("    \"pair_count\": {}\n", run.pair_count);
+    output_stream << "  },\n";
+    output_stream << std::format("  \"kernel\": {},\n", json::to_json_string(run.kernel));
+    output_stream << std::format("  \"mean_distance\": {},\n", to_json_number(run.mean_distance));
+    output_stream << "  \"total\": {\n";
+    output_stream << std::format("    \"includes_profiler_overhead\": {},\n", profiled ? "true" : "false");
+    output_stream << std::format("    \"duration_ms\": {},\n", to_json_number(1000.0 * total_seconds));
+    output_stream << std::format("    \"pairs_per_second\": {},\n", to_json_number(pairs_per_second));
+    output_stream << std::format("    \"bytes_per_second\": {}", to_json_number(bytes_per_second));
+    write_repetition_times(output_stream, repetition_ms);
+    output_stream << "\n  },\n";
+    output_stream << "  \"anchors\": [";
+
+    const char* separator = "\n";
+
+    for (const report_anchor& anchor : get_report_anchors(run.repetitions, cpu_freq))
+    {
+        output_stream << separator << "    {";
+        output_stream << std::format(" \"name\": {}, \"hit_count\": {}, \"timed_count\": {},", json::to_json_string(anchor.name), anchor.hit_count, anchor.timed_count);
+        output_stream << std::format(" \"exclusive_ms\": {}, \"inclusive_ms\": {}", to_json_number(anchor.exclusive_ms), to_json_number(anchor.inclusive_ms));
+
+        if (anchor.mean_hit_ns && anchor.hit_ns_stddev)
+            output_stream << std::format(", \"mean_hit_ns\": {}, \"hit_ns_stddev\": {}", to_json_number(*anchor.mean_hit_ns), to_json_number(*anchor.hit_ns_stddev));
+
+        write_repetition_times(output_stream, anchor.repetition_ms);
+
+        output_stream << " }";
+        separator = ",\n";
+    }
+
+    output_stream << "\n  ]\n}\n";
+
+    if (!output_stream)
+        throw std::runtime_error{ "Could not write report file." };
+}
+
+void write_scaling_report(const char* path, std::string_view mode, const char* input_path, std::span<const pass_scaling> scaling)
+{
+    std::ofstream output_stream{ path };
+
+    if (!output_stream)
+        throw std::runtime_error{ "Could not write report file." };
+
+    output_stream << "{\n";
+    write_machine(output_stream, get_timer_calibration());
+    output_stream << std::format("  \"mode\": {},\n", json::to_json_string(mode));
+    output_stream << std::format("  \"input\": {{ \"path\": {} }},\n", json::to_json_string(std::filesystem::path(input_path).filename().string()));
+    output_stream << "  \"passes\": [";
+
+    const char* separator = "\n";
+
+    for (const pass_scaling& pass : scaling)
+    {
+        output_stream << separator << "    {\n";
+        output_stream << std::format("      \"threads\": {},\n", pass.thread_count);
+        output_stream << std::format("      \"total\": {},\n", to_json_object(pass.total));
+        output_stream << "      \"stages\": [";
+
+        const char* stage_separator = "\n";
+
+        for (const scaling_point& stage : pass.stages)
+        {
+            output_stream << stage_separator << "        " << to_json_object(stage);
+            stage_separator = ",\n";
+        }
+
+        output_stream << "\n      ]\n    }";
+        separator = ",\n";
+    }
+
+    output_stream << "\n  ]\n}\n";
+
+    if (!output_stream)
+        throw std::runtime_error{ "Could not write report file." };
+}
+
+size_t compare_benchmark_reports(const char* baseline_path, const char* candidate_path, double threshold_percent)
+{
+    const benchmark_report baseline = read_benchmark_report(baseline_path);
+    const benchmark_report candidate = read_benchmark_report(candidate_path);
+
+    std::cout << "--- Benchmark Comparison ---\n\n";
+    std::cout << std::format("Baseline: {} ({})\n", std::filesystem::path(baseline_path).filename().string(), baseline.cpu);
+    std::cout << std::format("Candidate: {} ({})\n", std::filesystem::path(candidate_path).filename().string(), candidate.cpu);
+
+    // other work times other anchors, so there is nothing to compare
+    if (baseline.input_size != candidate.input_size || baseline.pair_count != candidate.pair_count)
+        throw std::runtime_error{ "The reports come from different inputs." };
+
+    if (baseline.kernel != candidate.kernel)
+        throw std::runtime_error{ "The reports ran different kernels." };
+
+    if (baseline.cpu != candidate.cpu || baseline.hardware_threads != candidate.hardware_threads)
+        std::cout << "Warning: the reports come from different machines.\n";
+
+    if (baseline.profiled != candidate.profiled)
+        std::cout << "Warning: only one report was profiled, and only its total includes the profiler's overhead.\n";
+
+    size_t regression_count = 0;
+    size_t untested_count = 0;
+
+    const auto compare = [&](const report_anchor& baseline_anchor, const report_anchor& candidate_anchor)
+    {
+        const anchor_change change = compare_anchor(baseline_anchor, candidate_anchor, threshold_percent);
+        regression_count += change.verdict == change_verdict::regressed;
+        untested_count += change.verdict == change_verdict::untested;
+
+        print_anchor_change(baseline_anchor, candidate_anchor, change);
+    };
+
+    std::cout << "\nTime:\n";
+    compare(baseline.total, candidate.total);
+
+    if (!baseline.anchors.empty() || !candidate.anchors.empty())
+        std::cout << "\nAnchors:\n";
+
+    for (const report_anchor& baseline_anchor : baseline.anchors)
+    {
+        const auto candidate_anchor = std::ranges::find(candidate.anchors, baseline_anchor.name, &report_anchor::name);
+        if (candidate_anchor != candidate.anchors.end())
+            compare(baseline_anchor, *candidate_anchor);
+    }
+
+    print_unmatched_anchors("Only in the baseline: ", baseline, candidate);
+    print_unmatched_anchors("Only in the candidate: ", candidate, baseline);
+
+    std::cout << std::format("\n{} regression{} past {}%.\n", regression_count, regression_count == 1 ? "" : "s", threshold_percent);
+
+    if (untested_count)
+    {
+        std::cout << std::format("{} change{} past it had too few repetitions or timed hits to test; record both reports with --repetitions=<count> above 1.\n",
+                                 untested_count, untested_count == 1 ? "" : "s");
+    }
+
+    return regression_count;
+}
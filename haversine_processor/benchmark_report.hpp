@@ -0,0 +1,53 @@
+﻿#ifndef WS_BENCHMARKREPORT_HPP
+#define WS_BENCHMARKREPORT_HPP
+
+#include <cstdint>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "thread_scaling.hpp"
+
+// one repetition of a pairs run: its time, and every profile anchor's running inclusive duration when it ended,
+// indexed like the profiler's anchors
+struct benchmark_repetition
+{
+    uint64_t elapsed_cycles{};
+    std::vector<double> inclusive_durations;
+};
+
+// what a pairs run computed, for the report; the timings come from the profiler
+struct benchmark_run
+{
+    std::string input_path;
+    uintmax_t input_size{};
+    uint64_t pair_count{};
+    double mean_distance{};
+    std::string_view kernel;
+    std::span<const benchmark_repetition> repetitions;
+};
+
+// reads the profiler's running totals at the end of a repetition that took elapsed_cycles
+benchmark_repetition record_benchmark_repetition(uint64_t elapsed_cycles);
+
+// Writes the run as JSON: the machine, the input, the total time and throughput, and every profile anchor that was
+// hit. Numbers are written plainly, without locale grouping, so reports can be diffed and read back. A profiled run
+// says so, since its total then includes the profiler's own overhead. A repeated run's total is the mean
+// repetition, and the total and every anchor also list each repetition's time; the anchors' other numbers are summed
+// over all of them.
+void write_benchmark_report(const char* path, const benchmark_run& run);
+
+// Writes a thread scaling run as JSON: the machine, the mode and input, and for every thread count the total and
+// per-stage times with their speedup and parallel efficiency.
+void write_scaling_report(const char* path, std::string_view mode, const char* input_path, std::span<const pass_scaling> scaling);
+
+// Compares two reports of the same input and kernel, and throws if they differ in either. The total time and every
+// anchor count as regressed when they grew by more than the threshold and a Welch t-test finds the growth
+// significant: over the repetitions' times when both reports have several, else over the timed hits' times where
+// both recorded their spread (sampled anchors, and every anchor in builds with PROFILER_VARIANCE). Changes past the
+// threshold with neither to test are reported as lacking the data, and don't count. Returns the number of
+// regressions.
+size_t compare_benchmark_reports(const char* baseline_path, const char* candidate_path, double threshold_percent);
+
+#endif
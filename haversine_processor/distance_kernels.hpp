@@ -0,0 +1,251 @@
+﻿#ifndef WS_DISTANCEKERNELS_HPP
+#define WS_DISTANCEKERNELS_HPP
+
+#include <algorithm>
+#include <cmath>
+#include <concepts>
+#include <numbers>
+#include <optional>
+#include <span>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "haversine_formula.hpp"
+
+// a distance kernel splits a great-circle distance into a per-point preparation step and a per-pair distance step,
+// so callers can hoist the expensive trigonometry out of the pair loop whenever a point is reused
+template<typename Kernel>
+concept distance_kernel = requires(globe_point p, const typename Kernel::point_data& d, double earth_radius)
+{
+    { Kernel::name } -> std::convertible_to<std::string_view>;
+    { Kernel::prepare(p) } -> std::same_as<typename Kernel::point_data>;
+    { Kernel::distance(d, d, earth_radius) } -> std::same_as<double>;
+};
+
+namespace kernel_detail
+{
+    inline double square(double x)
+    {
+        return x * x;
+    }
+
+    inline double radians_from_degrees(double degrees)
+    {
+        constexpr double factor = std::numbers::pi / 180.0;
+        return factor * degrees;
+    }
+
+    // wraps a longitude difference into [-pi, pi] so that pairs straddling the antimeridian stay short
+    inline double wrap_longitude(double d_lon)
+    {
+        constexpr double pi = std::numbers::pi;
+
+        if (d_lon > pi)
+            return d_lon - 2.0 * pi;
+        if (d_lon < -pi)
+            return d_lon + 2.0 * pi;
+
+        return d_lon;
+    }
+}
+
+// same formula as haversine_distance, with the radians conversion and cos(lat) done once per point
+struct haversine_kernel
+{
+    static constexpr std::string_view name = "haversine";
+
+    struct point_data
+    {
+        double lon{};
+        double lat{};
+        double cos_lat{};
+    };
+
+    static point_data prepare(globe_point p)
+    {
+        using namespace kernel_detail;
+
+        const double lat = radians_from_degrees(p.y);
+        return { .lon = radians_from_degrees(p.x), .lat = lat, .cos_lat = std::cos(lat) };
+    }
+
+    static double distance(const point_data& p0, const point_data& p1, double earth_radius)
+    {
+        using namespace kernel_detail;
+
+        const double d_lat = p1.lat - p0.lat;
+        const double d_lon = p1.lon - p0.lon;
+
+        const double a = square(std::sin(d_lat / 2.0)) + p0.cos_lat * p1.cos_lat * square(std::sin(d_lon / 2.0));
+        const double c = 2.0 * std::asin(std::sqrt(a));
+
+        return earth_radius * c;
+    }
+};
+
+// straight-line distance between unit vectors, converted to an arc length: 2R * asin(|p - q| / 2)
+struct chord_kernel
+{
+    static constexpr std::string_view name = "chord";
+
+    struct point_data
+    {
+        double x{};
+        double y{};
+        double z{};
+    };
+
+    static point_data prepare(globe_point p)
+    {
+        using namespace kernel_detail;
+
+        const double lon = radians_from_degrees(p.x);
+        const double lat = radians_from_degrees(p.y);
+        const double cos_lat = std::cos(lat);
+
+        return { .x = cos_lat * std::cos(lon), .y = cos_lat * std::sin(lon), .z = std::sin(lat) };
+    }
+
+    static double distance(const point_data& p0, const point_data& p1, double earth_radius)
+    {
+        using namespace kernel_detail;
+
+        const double chord = std::sqrt(square(p1.x - p0.x) + square(p1.y - p0.y) + square(p1.z - p0.z));
+        const double half_chord = std::min(chord / 2.0, 1.0); // rounding can push antipodal points slightly past 1
+
+        return 2.0 * earth_radius * std::asin(half_chord);
+    }
+};
+
+// flat-earth approximation around the pair's mean latitude; only accurate for short distances away from the poles
+struct equirectangular_kernel
+{
+    static constexpr std::string_view name = "equirectangular";
+
+    struct point_data
+    {
+        double lon{};
+        double lat{};
+    };
+
+    static point_data prepare(globe_point p)
+    {
+        using namespace kernel_detail;
+
+        return { .lon = radians_from_degrees(p.x), .lat = radians_from_degrees(p.y) };
+    }
+
+    static double distance(const point_data& p0, const point_data& p1, double earth_radius)
+    {
+        using namespace kernel_detail;
+
+        const double x = wrap_longitude(p1.lon - p0.lon) * std::cos((p0.lat + p1.lat) / 2.0);
+        const double y = p1.lat - p0.lat;
+
+        return earth_radius * std::sqrt(x * x + y * y);
+    }
+};
+
+// spherical law of cosines; exact on a sphere, but acos loses precision for very short distances
+struct spherical_cosines_kernel
+{
+    static constexpr std::string_view name = "cosines";
+
+    struct point_data
+    {
+        double lon{};
+        double sin_lat{};
+        double cos_lat{};
+    };
+
+    static point_data prepare(globe_point p)
+    {
+        using namespace kernel_detail;
+
+        const double lat = radians_from_degrees(p.y);
+        return { .lon = radians_from_degrees(p.x), .sin_lat = std::sin(lat), .cos_lat = std::cos(lat) };
+    }
+
+    static double distance(const point_data& p0, const point_data& p1, double earth_radius)
+    {
+        const double cos_c = p0.sin_lat * p1.sin_lat + p0.cos_lat * p1.cos_lat * std::cos(p1.lon - p0.lon);
+
+        return earth_radius * std::acos(std::clamp(cos_c, -1.0, 1.0));
+    }
+};
+
+enum class distance_kernel_type
+{
+    haversine,
+    chord,
+    equirectangular,
+    spherical_cosines
+};
+
+inline constexpr distance_kernel_type all_distance_kernels[] =
+{
+    distance_kernel_type::haversine,
+    distance_kernel_type::chord,
+    distance_kernel_type::equirectangular,
+    distance_kernel_type::spherical_cosines
+};
+
+template<distance_kernel Kernel>
+double kernel_distance(globe_point p0, globe_point p1, double earth_radius = default_earth_radius)
+{
+    return Kernel::distance(Kernel::prepare(p0), Kernel::prepare(p1), earth_radius);
+}
+
+// both endpoints of every pair prepared up front, pair i's at 2i and 2i + 1, so the pair loop runs only the distance
+// step and each kernel is timed on what it does per pair
+template<distance_kernel Kernel>
+std::vector<typename Kernel::point_data> prepare_point_pairs(std::span<const globe_point_pair> point_pairs)
+{
+    std::vector<typename Kernel::point_data> prepared_points;
+    prepared_points.reserve(2 * point_pairs.size());
+
+    for (const auto& [p1, p2] : point_pairs)
+    {
+        prepared_points.push_back(Kernel::prepare(p1));
+        prepared_points.push_back(Kernel::prepare(p2));
+    }
+
+    return prepared_points;
+}
+
+// invokes f with a default-constructed kernel object matching the runtime selection, so the work inside f is
+// still instantiated (and inlined) once per kernel
+auto dispatch_kernel(distance_kernel_type type, auto&& f)
+{
+    switch (type)
+    {
+        case distance_kernel_type::chord:
+            return std::forward<decltype(f)>(f)(chord_kernel{});
+        case distance_kernel_type::equirectangular:
+            return std::forward<decltype(f)>(f)(equirectangular_kernel{});
+        case distance_kernel_type::spherical_cosines:
+            return std::forward<decltype(f)>(f)(spherical_cosines_kernel{});
+        case distance_kernel_type::haversine:
+        default:
+            return std::forward<decltype(f)>(f)(haversine_kernel{});
+    }
+}
+
+inline std::string_view to_string(distance_kernel_type type)
+{
+    return dispatch_kernel(type, []<typename Kernel>(Kernel) { return Kernel::name; });
+}
+
+inline std::optional<distance_kernel_type> parse_distance_kernel(std::string_view name)
+{
+    for (const distance_kernel_type type : all_distance_kernels)
+    {
+        if (to_string(type) == name)
+            return type;
+    }
+
+    return {};
+}
+
+#endif
@@ -0,0 +1,176 @@
+#include "distance_matrix.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <stdexcept>
+#include <limits>
+
+#include "distance_kernels.hpp"
+#include "parallel.hpp"
+#include "profiler.hpp"
+
+namespace
+{
+    // structure-of-arrays copy of haversine_kernel::point_data, so the inner loop reads contiguous doubles
+    struct prepared_points
+    {
+        std::vector<double> lon;
+        std::vector<double> lat;
+        std::vector<double> cos_lat;
+
+        explicit prepared_points(std::span<const globe_point> points)
+        {
+            lon.reserve(points.size());
+            lat.reserve(points.size());
+            cos_lat.reserve(points.size());
+
+            for (const globe_point& point : points)
+            {
+                const haversine_kernel::point_data prepared = haversine_kernel::prepare(point);
+                lon.push_back(prepared.lon);
+                lat.push_back(prepared.lat);
+                cos_lat.push_back(prepared.cos_lat);
+            }
+        }
+    };
+
+    // distances from one row point to columns [column_begin, column_end); branch-free so it can be vectorized
+    void compute_row_segment(const prepared_points& rows, size_t row, const prepared_points& columns,
+                             size_t column_begin, size_t column_end, double earth_radius, double* output)
+    {
+        const double row_lon = rows.lon[row];
+        const double row_lat = rows.lat[row];
+        const double row_cos_lat = rows.cos_lat[row];
+
+        const double* column_lon = columns.lon.data();
+        const double* column_lat = columns.lat.data();
+        const double* column_cos_lat = columns.cos_lat.data();
+
+        for (size_t column = column_begin; column < column_end; ++column)
+        {
+            const double sin_d_lat = std::sin((column_lat[column] - row_lat) / 2.0);
+            const double sin_d_lon = std::sin((column_lon[column] - row_lon) / 2.0);
+
+            const double a = sin_d_lat * sin_d_lat + row_cos_lat * column_cos_lat[column] * sin_d_lon * sin_d_lon;
+            output[column - column_begin] = 2.0 * earth_radius * std::asin(std::sqrt(a));
+        }
+    }
+
+}
+
+size_t distance_matrix_size(std::span<const globe_point> rows, std::span<const globe_point> columns)
+{
+    if (rows.empty() || columns.empty())
+        throw std::runtime_error{ "Both point sets must contain at least one point." };
+
+    if (columns.size() > std::numeric_limits<uint32_t>::max())
+        throw std::runtime_error{ "The column point set is too large." };
+
+    if (rows.size() > std::numeric_limits<size_t>::max() / sizeof(double) / columns.size())
+        throw std::runtime_error{ "The distance matrix is too large." };
+
+    return rows.size() * columns.size() * sizeof(double);
+}
+
+void compute_distance_matrix(std::span<const globe_point> rows, std::span<const globe_point> columns, std::span<double> output,
+                             unsigned thread_count, double earth_radius)
+{
+    PROFILE_DATA_FUNCTION(rows.size() * columns.size() * sizeof(double));
+
+    if (output.size_bytes() < distance_matrix_size(rows, columns))
+        throw std::runtime_error{ "The distance matrix output is too small." };
+
+    const prepared_points row_points{ rows };
+    const prepared_points column_points{ columns };
+
+    const size_t column_count = columns.size();
+    const size_t row_tile_count = (rows.size() + matrix_tile_rows - 1) / matrix_tile_rows;
+
+    parallel_for(row_tile_count, thread_count, [&](size_t tile_begin, size_t tile_end)
+    {
+        PROFILE_DATA_BLOCK("compute_distance_tiles", (std::min(rows.size(), tile_end * matrix_tile_rows) - tile_begin * matrix_tile_rows) * column_count * sizeof(double));
+
+        for (size_t row_tile = tile_begin; row_tile < tile_end; ++row_tile)
+        {
+            const size_t row_begin = row_tile * matrix_tile_rows;
+            const size_t row_end = std::min(rows.size(), row_begin + matrix_tile_rows);
+
+            for (size_t column_begin = 0; column_begin < column_count; column_begin += matrix_tile_columns)
+            {
+                const size_t column_end = std::min(column_count, column_begin + matrix_tile_columns);
+
+                for (size_t row = row_begin; row < row_end; ++row)
+                {
+                    double* row_output = output.data() + row * column_count + column_begin;
+                    compute_row_segment(row_points, row, column_points, column_begin, column_end, earth_radius, row_output);
+                }
+            }
+        }
+    });
+}
+
+std::vector<row_reduction> reduce_distance_matrix(std::span<const globe_point> rows, std::span<const globe_point> columns,
+                                                  unsigned thread_count, double earth_radius)
+{
+    PROFILE_DATA_FUNCTION(rows.size() * columns.size() * sizeof(double));
+
+    // only for its checks; the reductions are a row each
+    distance_matrix_size(rows, columns);
+
+    const prepared_points row_points{ rows };
+    const prepared_points column_points{ columns };
+
+    const size_t column_count = columns.size();
+    const size_t row_tile_count = (rows.size() + matrix_tile_rows - 1) / matrix_tile_rows;
+
+    // in a point set's matrix with itself every row would find its own point at distance 0, so that column is
+    // left out; being 0, it only needs leaving out of the minimum and the mean's divisor
+    const bool self_matrix = rows.data() == columns.data() && rows.size() == columns.size();
+    const size_t other_column_count = self_matrix ? column_count - 1 : column_count;
+    const double mean_coeff = other_column_count ? 1.0 / other_column_count : 0.0;
+
+    std::vector<row_reduction> reductions(rows.size(), { .min_distance = std::numeric_limits<double>::infinity() });
+
+    parallel_for(row_tile_count, thread_count, [&](size_t tile_begin, size_t tile_end)
+    {
+        PROFILE_DATA_BLOCK("reduce_distance_tiles", (std::min(rows.size(), tile_end * matrix_tile_rows) - tile_begin * matrix_tile_rows) * column_count * sizeof(double));
+
+        std::array<double, matrix_tile_columns> segment{};
+
+        for (size_t row_tile = tile_begin; row_tile < tile_end; ++row_tile)
+        {
+            const size_t row_begin = row_tile * matrix_tile_rows;
+            const size_t row_end = std::min(rows.size(), row_begin + matrix_tile_rows);
+
+            for (size_t column_begin = 0; column_begin < column_count; column_begin += matrix_tile_columns)
+            {
+                const size_t column_end = std::min(column_count, column_begin + matrix_tile_columns);
+
+                for (size_t row = row_begin; row < row_end; ++row)
+                {
+                    compute_row_segment(row_points, row, column_points, column_begin, column_end, earth_radius, segment.data());
+
+                    row_reduction& reduction = reductions[row];
+                    const size_t own_column = self_matrix ? row : std::numeric_limits<size_t>::max();
+                    double sum = 0.0;
+
+                    for (size_t i = 0; i < column_end - column_begin; ++i)
+                    {
+                        sum += segment[i];
+
+                        if (segment[i] < reduction.min_distance && column_begin + i != own_column)
+                        {
+                            reduction.min_distance = segment[i];
+                            reduction.min_index = static_cast<uint32_t>(column_begin + i);
+                        }
+                    }
+
+                    reduction.mean_distance += mean_coeff * sum;
+                }
+            }
+        }
+    });
+
+    return reductions;
+}
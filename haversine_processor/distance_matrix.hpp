@@ -0,0 +1,37 @@
+﻿#ifndef WS_DISTANCEMATRIX_HPP
+#define WS_DISTANCEMATRIX_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+#include "haversine_formula.hpp"
+
+// Tile dimensions for the all-pairs matrix. A column tile's prepared coordinates (3 doubles per point, 24 KiB)
+// stay in L1/L2 while every row of the row tile is swept across it.
+inline constexpr size_t matrix_tile_rows = 64;
+inline constexpr size_t matrix_tile_columns = 1024;
+
+struct row_reduction
+{
+    double min_distance{};
+    uint32_t min_index{};
+    double mean_distance{};
+};
+
+// Bytes of the rows.size() x columns.size() matrix. Throws if either set is empty or the matrix is too large to
+// address, so callers can check before creating the output.
+size_t distance_matrix_size(std::span<const globe_point> rows, std::span<const globe_point> columns);
+
+// Writes the row-major rows.size() x columns.size() haversine distance matrix to output.
+void compute_distance_matrix(std::span<const globe_point> rows, std::span<const globe_point> columns, std::span<double> output,
+                             unsigned thread_count = 0, double earth_radius = default_earth_radius);
+
+// Computes the minimum (with its column index) and mean of every matrix row without storing the matrix. When
+// columns is rows itself, each row's own point is left out, so the minimum is its nearest other point; a single
+// point then has no minimum, which stays infinite.
+std::vector<row_reduction> reduce_distance_matrix(std::span<const globe_point> rows, std::span<const globe_point> columns,
+                                                  unsigned thread_count = 0, double earth_radius = default_earth_radius);
+
+#endif
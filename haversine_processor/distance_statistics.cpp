@@ -0,0 +1,222 @@
+#include "distance_statistics.hpp"
+
+#include <cmath>
+#include <stdexcept>
+#include <format>
+#include <iostream>
+#include <locale>
+#include <string>
+
+namespace
+{
+    // scale function k1 from the t-digest paper: centroids near q = 0 and q = 1 are kept small
+    double scale_from_quantile(double q, double compression)
+    {
+        return compression / (2.0 * std::numbers::pi) * std::asin(2.0 * q - 1.0);
+    }
+
+    double quantile_from_scale(double k, double compression)
+    {
+        const double angle = 2.0 * std::numbers::pi * k / compression;
+        return angle >= std::numbers::pi / 2.0 ? 1.0 : (std::sin(angle) + 1.0) / 2.0;
+    }
+}
+
+quantile_digest::quantile_digest(double compression)
+    : m_compression{ compression }
+    , m_buffer_limit{ static_cast<size_t>(8.0 * compression) }
+{
+    if (compression < 1.0)
+        throw std::runtime_error{ "The t-digest compression must be at least 1." };
+
+    // a full buffer is folded in with one sort, so memory stays bounded by a few multiples of the compression
+    m_buffer.reserve(m_buffer_limit + static_cast<size_t>(2.0 * compression));
+}
+
+void quantile_digest::compress()
+{
+    if (m_buffer.empty())
+        return;
+
+    m_buffer.insert(m_buffer.end(), m_centroids.begin(), m_centroids.end());
+    std::ranges::sort(m_buffer, [](const centroid& a, const centroid& b) { return a.mean < b.mean; });
+
+    m_centroids.clear();
+
+    centroid current = m_buffer.front();
+    double weight_before = 0.0;
+    double quantile_limit = quantile_from_scale(scale_from_quantile(0.0, m_compression) + 1.0, m_compression);
+
+    for (size_t i = 1; i < m_buffer.size(); ++i)
+    {
+        const centroid& next = m_buffer[i];
+
+        if ((weight_before + current.weight + next.weight) / m_total_weight <= quantile_limit)
+        {
+            current.weight += next.weight;
+            current.mean += (next.mean - current.mean) * next.weight / current.weight;
+            continue;
+        }
+
+        m_centroids.push_back(current);
+        weight_before += current.weight;
+        quantile_limit = quantile_from_scale(scale_from_quantile(weight_before / m_total_weight, m_compression) + 1.0, m_compression);
+        current = next;
+    }
+
+    m_centroids.push_back(current);
+    m_buffer.clear();
+}
+
+void quantile_digest::merge(const quantile_digest& other)
+{
+    if (other.m_total_weight == 0.0)
+        return;
+
+    m_total_weight += other.m_total_weight;
+    m_min = std::min(m_min, other.m_min);
+    m_max = std::max(m_max, other.m_max);
+
+    for (const std::vector<centroid>* source : { &other.m_centroids, &other.m_buffer })
+    {
+        for (const centroid& c : *source)
+        {
+            m_buffer.push_back(c);
+
+            if (m_buffer.size() >= m_buffer_limit)
+                compress();
+        }
+    }
+
+    compress();
+}
+
+double quantile_digest::quantile(double q) const
+{
+    if (m_total_weight == 0.0)
+        return 0.0;
+
+    if (!m_buffer.empty())
+    {
+        quantile_digest flushed = *this;
+        flushed.compress();
+        return flushed.quantile(q);
+    }
+
+    q = std::clamp(q, 0.0, 1.0);
+
+    if (m_centroids.size() == 1)
+        return m_centroids.front().mean;
+
+    // each centroid's mean sits at the middle of its weight; interpolate between neighboring centers and
+    // between the outer centers and the exact min/max
+    const double target = q * m_total_weight;
+
+    const centroid& first = m_centroids.front();
+    if (target < first.weight / 2.0)
+        return m_min + (first.mean - m_min) * target / (first.weight / 2.0);
+
+    const centroid& last = m_centroids.back();
+    if (target > m_total_weight - last.weight / 2.0)
+        return m_max - (m_max - last.mean) * (m_total_weight - target) / (last.weight / 2.0);
+
+    double center = first.weight / 2.0;
+
+    for (size_t i = 0; i + 1 < m_centroids.size(); ++i)
+    {
+        const centroid& left = m_centroids[i];
+        const centroid& right = m_centroids[i + 1];
+        const double next_center = center + (left.weight + right.weight) / 2.0;
+
+        if (target <= next_center)
+            return left.mean + (right.mean - left.mean) * (target - center) / (next_center - center);
+
+        center = next_center;
+    }
+
+    return last.mean;
+}
+
+distance_statistics::distance_statistics(double histogram_max)
+    : m_histogram_max{ histogram_max }
+{
+    if (!(histogram_max > 0.0))
+        throw std::runtime_error{ "The histogram range must be positive." };
+
+    m_bin_scale = histogram_bin_count / histogram_max;
+}
+
+void distance_statistics::merge(const distance_statistics& other)
+{
+    if (other.m_histogram_max != m_histogram_max)
+        throw std::runtime_error{ "Cannot merge distance statistics with different histogram ranges." };
+
+    if (other.m_count == 0)
+        return;
+
+    // Chan et al.'s pairwise update for the mean and sum of squared deviations
+    const uint64_t count = m_count + other.m_count;
+    const double delta = other.m_mean - m_mean;
+
+    m_m2 += other.m_m2 + delta * delta * (static_cast<double>(m_count) * other.m_count / count);
+    m_mean += delta * other.m_count / count;
+    m_count = count;
+
+    // ties go to the lower pair index, so the result doesn't depend on merge order
+    if (other.m_min < m_min || (other.m_min == m_min && other.m_min_index < m_min_index))
+    {
+        m_min = other.m_min;
+        m_min_index = other.m_min_index;
+    }
+
+    if (other.m_max > m_max || (other.m_max == m_max && other.m_max_index < m_max_index))
+    {
+        m_max = other.m_max;
+        m_max_index = other.m_max_index;
+    }
+
+    for (size_t bin = 0; bin < histogram_bin_count; ++bin)
+        m_histogram[bin] += other.m_histogram[bin];
+
+    m_digest.merge(other.m_digest);
+}
+
+double distance_statistics::standard_deviation() const
+{
+    return std::sqrt(variance());
+}
+
+void print_distance_statistics(const distance_statistics& statistics)
+{
+    if (!statistics.count())
+        return;
+
+    std::cout << "Distance statistics:\n";
+    std::cout << std::format("  Min: {:.16f} (pair {})\n", statistics.min(), statistics.min_index());
+    std::cout << std::format("  Max: {:.16f} (pair {})\n", statistics.max(), statistics.max_index());
+    std::cout << std::format("  Mean: {:.16f}\n", statistics.mean());
+    std::cout << std::format("  Std dev: {:.16f}\n", statistics.standard_deviation());
+
+    std::cout << "  Percentiles (approximate):\n";
+    for (const double percentile : { 1.0, 5.0, 25.0, 50.0, 75.0, 95.0, 99.0 })
+        std::cout << std::format("    p{:<3}{:.6f}\n", percentile, statistics.quantile(percentile / 100.0));
+
+    const auto& histogram = statistics.histogram();
+    const uint64_t largest_bin = *std::ranges::max_element(histogram);
+    const double bin_width = statistics.histogram_max() / distance_statistics::histogram_bin_count;
+
+    constexpr size_t max_bar_width = 40;
+
+    std::cout << "  Histogram:\n";
+    for (size_t bin = 0; bin < histogram.size(); ++bin)
+    {
+        if (!histogram[bin])
+            continue;
+
+        const auto bar_width = static_cast<size_t>(std::ceil(static_cast<double>(max_bar_width) * histogram[bin] / largest_bin));
+        std::cout << std::format(std::locale("en_US"), "    [{:8.1f}, {:8.1f}) {:>12Ld} {}\n",
+                                 bin * bin_width, (bin + 1) * bin_width, histogram[bin], std::string(bar_width, '#'));
+    }
+
+    std::cout << '\n';
+}
@@ -0,0 +1,133 @@
+﻿#ifndef WS_DISTANCESTATISTICS_HPP
+#define WS_DISTANCESTATISTICS_HPP
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <numbers>
+#include <vector>
+
+#include "haversine_formula.hpp"
+
+// Merging t-digest: a bounded set of weighted centroids that is dense near the tails, so extreme quantiles stay
+// accurate. New values are buffered and folded into the centroids in batches. Two digests merge by folding one's
+// centroids into the other, which keeps the result within the same error bounds as a single digest.
+class quantile_digest
+{
+private:
+    struct centroid
+    {
+        double mean{};
+        double weight{};
+    };
+
+    std::vector<centroid> m_centroids;
+    std::vector<centroid> m_buffer;
+    double m_compression{};
+    size_t m_buffer_limit{};
+    double m_total_weight{};
+    double m_min = std::numeric_limits<double>::infinity();
+    double m_max = -std::numeric_limits<double>::infinity();
+
+    void compress();
+
+public:
+    static constexpr double default_compression = 100.0;
+
+    explicit quantile_digest(double compression = default_compression);
+
+    void add(double value)
+    {
+        m_buffer.push_back({ value, 1.0 });
+        m_total_weight += 1.0;
+        m_min = std::min(m_min, value);
+        m_max = std::max(m_max, value);
+
+        if (m_buffer.size() >= m_buffer_limit)
+            compress();
+    }
+
+    void merge(const quantile_digest& other);
+
+    // approximate value at quantile q in [0, 1]; 0 for an empty digest
+    double quantile(double q) const;
+
+    size_t centroid_count() const { return m_centroids.size() + m_buffer.size(); }
+};
+
+// One-pass, constant-memory summary of a stream of distances: count, mean and variance (Welford), min/max with
+// the index of the pair that produced them, a fixed-bin histogram and a t-digest for quantiles. Instances
+// accumulated over separate chunks (e.g. one per thread) can be merged: counts, min/max and the histogram merge
+// exactly, the mean and variance up to rounding, and the quantiles within the digest's usual error.
+class distance_statistics
+{
+public:
+    static constexpr size_t histogram_bin_count = 32;
+
+private:
+    uint64_t m_count{};
+    double m_mean{};
+    double m_m2{};
+    double m_min = std::numeric_limits<double>::infinity();
+    double m_max = -std::numeric_limits<double>::infinity();
+    size_t m_min_index{};
+    size_t m_max_index{};
+    double m_histogram_max{};
+    double m_bin_scale{};
+    std::array<uint64_t, histogram_bin_count> m_histogram{};
+    quantile_digest m_digest;
+
+public:
+    // no great-circle distance is longer than half the circumference, so that is the default histogram range
+    explicit distance_statistics(double histogram_max = std::numbers::pi * default_earth_radius);
+
+    void add(double distance, size_t index)
+    {
+        ++m_count;
+
+        const double delta = distance - m_mean;
+        m_mean += delta / m_count;
+        m_m2 += delta * (distance - m_mean);
+
+        if (distance < m_min)
+        {
+            m_min = distance;
+            m_min_index = index;
+        }
+
+        if (distance > m_max)
+        {
+            m_max = distance;
+            m_max_index = index;
+        }
+
+        // anything outside the range is clamped into the first or last bin
+        const double bin = std::clamp(distance * m_bin_scale, 0.0, static_cast<double>(histogram_bin_count - 1));
+        ++m_histogram[static_cast<size_t>(bin)];
+
+        m_digest.add(distance);
+    }
+
+    void merge(const distance_statistics& other);
+
+    uint64_t count() const { return m_count; }
+    double mean() const { return m_mean; }
+    double variance() const { return m_count ? m_m2 / m_count : 0.0; }
+    double standard_deviation() const;
+
+    double min() const { return m_min; }
+    double max() const { return m_max; }
+    size_t min_index() const { return m_min_index; }
+    size_t max_index() const { return m_max_index; }
+
+    double histogram_max() const { return m_histogram_max; }
+    const std::array<uint64_t, histogram_bin_count>& histogram() const { return m_histogram; }
+
+    double quantile(double q) const { return m_digest.quantile(q); }
+};
+
+void print_distance_statistics(const distance_statistics& statistics);
+
+#endif
@@ -0,0 +1,116 @@
+#include "extreme_pairs.hpp"
+
+#include <algorithm>
+#include <format>
+#include <iostream>
+
+namespace
+{
+    // larger key first, then lower index; the heap's top is the entry no other entry ranks below
+    bool ranks_above(const ranked_pair& a, const ranked_pair& b)
+    {
+        return a.distance > b.distance || (a.distance == b.distance && a.index < b.index);
+    }
+
+    void print_ranked_pairs(const char* title, const std::vector<ranked_pair>& pairs, std::span<const globe_point_pair> point_pairs)
+    {
+        std::cout << title << '\n';
+
+        for (size_t rank = 0; rank < pairs.size(); ++rank)
+        {
+            const auto& [distance, index] = pairs[rank];
+            const auto& [p1, p2] = point_pairs[index];
+
+            std::cout << std::format("  {:>3}. {:.16f}  pair {}  ({:.6f}, {:.6f}) -> ({:.6f}, {:.6f})\n",
+                                     rank + 1, distance, index, p1.x, p1.y, p2.x, p2.y);
+        }
+    }
+}
+
+bounded_pair_heap::bounded_pair_heap(size_t capacity)
+    : m_capacity{ capacity }
+{
+    m_heap.reserve(capacity);
+
+    if (capacity == 0)
+        m_threshold = std::numeric_limits<double>::infinity();
+}
+
+void bounded_pair_heap::insert(double key, size_t index)
+{
+    const ranked_pair entry{ .distance = key, .index = index };
+
+    if (m_heap.size() < m_capacity)
+    {
+        m_heap.push_back(entry);
+        std::ranges::push_heap(m_heap, ranks_above);
+
+        if (m_heap.size() == m_capacity)
+            m_threshold = m_heap.front().distance;
+
+        return;
+    }
+
+    // only ties with the threshold get here without ranking above the current worst entry
+    if (!ranks_above(entry, m_heap.front()))
+        return;
+
+    std::ranges::pop_heap(m_heap, ranks_above);
+    m_heap.back() = entry;
+    std::ranges::push_heap(m_heap, ranks_above);
+
+    m_threshold = m_heap.front().distance;
+}
+
+void bounded_pair_heap::merge(const bounded_pair_heap& other)
+{
+    for (const auto& [key, index] : other.m_heap)
+        add(key, index);
+}
+
+std::vector<ranked_pair> bounded_pair_heap::sorted() const
+{
+    std::vector<ranked_pair> entries = m_heap;
+    std::ranges::sort(entries, ranks_above);
+
+    return entries;
+}
+
+extreme_pairs::extreme_pairs(size_t count)
+    : m_longest{ count }
+    , m_shortest{ count }
+{
+}
+
+void extreme_pairs::merge(const extreme_pairs& other)
+{
+    m_longest.merge(other.m_longest);
+    m_shortest.merge(other.m_shortest);
+}
+
+std::vector<ranked_pair> extreme_pairs::longest() const
+{
+    return m_longest.sorted();
+}
+
+std::vector<ranked_pair> extreme_pairs::shortest() const
+{
+    std::vector<ranked_pair> pairs = m_shortest.sorted();
+    for (ranked_pair& pair : pairs)
+        pair.distance = -pair.distance;
+
+    return pairs;
+}
+
+void print_extreme_pairs(const extreme_pairs& extremes, std::span<const globe_point_pair> point_pairs)
+{
+    const std::vector<ranked_pair> longest = extremes.longest();
+    if (longest.empty())
+        return;
+
+    print_ranked_pairs("Longest pairs:", longest, point_pairs);
+    std::cout << '\n';
+
+    print_ranked_pairs("Shortest pairs:", extremes.shortest(), point_pairs);
+    std::cout << '\n';
+}
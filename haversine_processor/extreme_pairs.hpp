@@ -0,0 +1,70 @@
+﻿#ifndef WS_EXTREMEPAIRS_HPP
+#define WS_EXTREMEPAIRS_HPP
+
+#include <cstddef>
+#include <limits>
+#include <span>
+#include <vector>
+
+#include "haversine_formula.hpp"
+
+struct ranked_pair
+{
+    double distance{};
+    size_t index{};
+};
+
+// The K largest keys seen so far, as a min-heap so the smallest kept key (the admission threshold) is on top.
+// Once the heap is full, almost every key is rejected by a single compare against the cached threshold before
+// the heap is touched. Equal keys keep the lower index, so merged results don't depend on how the input was split.
+class bounded_pair_heap
+{
+private:
+    std::vector<ranked_pair> m_heap;
+    size_t m_capacity{};
+    double m_threshold = -std::numeric_limits<double>::infinity();
+
+    void insert(double key, size_t index);
+
+public:
+    explicit bounded_pair_heap(size_t capacity);
+
+    void add(double key, size_t index)
+    {
+        if (key < m_threshold)
+            return;
+
+        insert(key, index);
+    }
+
+    void merge(const bounded_pair_heap& other);
+
+    // kept entries, largest key first
+    std::vector<ranked_pair> sorted() const;
+};
+
+// Tracks the K longest and K shortest pairs of a distance stream by pair index.
+class extreme_pairs
+{
+private:
+    bounded_pair_heap m_longest;
+    bounded_pair_heap m_shortest; // keyed on the negated distance
+
+public:
+    explicit extreme_pairs(size_t count);
+
+    void add(double distance, size_t index)
+    {
+        m_longest.add(distance, index);
+        m_shortest.add(-distance, index);
+    }
+
+    void merge(const extreme_pairs& other);
+
+    std::vector<ranked_pair> longest() const;
+    std::vector<ranked_pair> shortest() const;
+};
+
+void print_extreme_pairs(const extreme_pairs& extremes, std::span<const globe_point_pair> point_pairs);
+
+#endif
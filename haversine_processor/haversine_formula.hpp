@@ -7,6 +7,12 @@ struct globe_point
     double y{};
 };
 
+struct globe_point_pair
+{
+    globe_point point1{};
+    globe_point point2{};
+};
+
 inline constexpr double default_earth_radius = 6372.8;
 
 double haversine_distance(double x0, double y0, double x1, double y1, double earth_radius = default_earth_radius);
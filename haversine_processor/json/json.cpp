@@ -1,6 +1,6 @@
 ﻿#include "json.hpp"
 
-#include <exception>
+#include <stdexcept>
 #include <filesystem>
 #include <fstream>
 #include <string>
@@ -19,11 +19,11 @@ namespace json
         PROFILE_FUNCTION;
 
         if (!std::filesystem::exists(filepath))
-            throw std::exception{ "JSON file does not exist." };
+            throw std::runtime_error{ "JSON file does not exist." };
 
         std::ifstream json_file{ filepath };
         if (!json_file)
-            throw std::exception{ "Cannot open JSON file." };
+            throw std::runtime_error{ "Cannot open JSON file." };
 
         const std::vector<token> tokens = scanner::scan(json_file, std::filesystem::file_size(filepath));
         json_file.close();
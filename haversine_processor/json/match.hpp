@@ -1,7 +1,7 @@
 ﻿#ifndef WS_MATCH_HPP
 #define WS_MATCH_HPP
 
-#include <exception>
+#include <stdexcept>
 #include <type_traits>
 #include <variant>
 
@@ -30,7 +30,7 @@ auto match(auto&& f, const auto& v)
         case 5: return std::forward<decltype(f)>(f)(*std::get_if<5>(&v));
         case 6: return std::forward<decltype(f)>(f)(*std::get_if<6>(&v));
         case 7: return std::forward<decltype(f)>(f)(*std::get_if<7>(&v));
-        default: throw std::exception{ "Could not match variant alternative." }; // unreachable
+        default: throw std::runtime_error{ "Could not match variant alternative." }; // unreachable
     }
 }
 
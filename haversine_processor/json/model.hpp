@@ -6,7 +6,7 @@
 #include <variant>
 #include <vector>
 
-#include "..\container_utils.hpp"
+#include "../container_utils.hpp"
 #include "literals.hpp"
 
 namespace json
@@ -1,6 +1,6 @@
 ﻿#include "parser.hpp"
 
-#include <exception>
+#include <stdexcept>
 #include <span>
 #include <string>
 #include <unordered_set>
@@ -28,7 +28,7 @@ namespace json::parser
         const token* peek(const token_iterator& iter, token_span token_view)
         {
             if (iter >= token_view.end())
-                throw std::exception{ "Cannot peek out-of-range token." };
+                throw std::runtime_error{ "Cannot peek out-of-range token." };
 
             return &*iter;
         }
@@ -36,7 +36,7 @@ namespace json::parser
         const token* read_and_advance(token_iterator& iter, token_span token_view)
         {
             if (iter >= token_view.end())
-                throw std::exception{ "Cannot read out-of-range token." };
+                throw std::runtime_error{ "Cannot read out-of-range token." };
 
             return &*iter++;
         }
@@ -44,7 +44,7 @@ namespace json::parser
         void advance(token_iterator& iter, token_span token_view)
         {
             if (iter >= token_view.end())
-                throw std::exception{ "Cannot advance past the end of the token list." };
+                throw std::runtime_error{ "Cannot advance past the end of the token list." };
 
             ++iter;
         }
@@ -52,7 +52,7 @@ namespace json::parser
         void back_up(token_iterator& iter, token_span token_view)
         {
             if (iter <= token_view.begin())
-                throw std::exception{ "Cannot back up past the beginning of the token list." };
+                throw std::runtime_error{ "Cannot back up past the beginning of the token list." };
 
             --iter;
         }
@@ -258,7 +258,7 @@ namespace json::parser
         if (!errors.empty())
         {
             const std::string message = "Errors occurred while parsing JSON.\n" + join("\n", errors);
-            throw std::exception{ message.c_str() };
+            throw std::runtime_error{ message };
         }
 
         return document;
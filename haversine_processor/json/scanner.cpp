@@ -1,9 +1,11 @@
 ﻿#include "scanner.hpp"
 
-#include <exception>
+#include <charconv>
+#include <stdexcept>
 #include <ostream>
 #include <sstream>
 #include <string>
+#include <system_error>
 #include <vector>
 
 #include "utilities.hpp"
@@ -228,6 +230,12 @@ namespace json::scanner
             if (is_valid)
             {
                 const std::string number_string = builder.str();
+
+                // integers too large for integer_literal are kept as floats rather than failing to convert
+                int n{};
+                if (!is_float && std::from_chars(number_string.data(), number_string.data() + number_string.size(), n).ec != std::errc{})
+                    is_float = true;
+
                 if (is_float)
                 {
                     double d = std::stod(number_string);
@@ -235,7 +243,6 @@ namespace json::scanner
                 }
                 else
                 {
-                    int n = std::stoi(number_string);
                     tokens.push_back({ .type = token_type::number_integer, .lexeme = number_string, .literal = n, .line = line });
                 }
             }
@@ -402,7 +409,7 @@ namespace json::scanner
         if (!errors.empty())
         {
             const std::string message = "Errors occurred while scanning JSON.\n" + join("\n", errors);
-            throw std::exception{ message.c_str() };
+            throw std::runtime_error{ message };
         }
 
         return tokens;
@@ -1,8 +1,10 @@
 ﻿#include "utilities.hpp"
 
 #include <cstddef>
+#include <format>
 #include <sstream>
 #include <string>
+#include <string_view>
 #include <vector>
 
 namespace json
@@ -27,4 +29,29 @@ namespace json
 
         return builder.str();
     }
+
+    std::string to_json_string(std::string_view text)
+    {
+        std::string result = "\"";
+
+        for (const char ch : text)
+        {
+            switch (ch)
+            {
+                case '"': result += "\\\""; break;
+                case '\\': result += "\\\\"; break;
+                case '\n': result += "\\n"; break;
+                case '\r': result += "\\r"; break;
+                case '\t': result += "\\t"; break;
+
+                default:
+                    if (static_cast<unsigned char>(ch) < 0x20)
+                        result += std::format("\\u{:04x}", static_cast<unsigned>(ch));
+                    else
+                        result += ch;
+            }
+        }
+
+        return result + '"';
+    }
 }
@@ -2,12 +2,16 @@
 #define WS_JSON_UTILITIES_HPP
 
 #include <string>
+#include <string_view>
 #include <vector>
 
 namespace json
 {
     std::string format_error(const std::string& message, int line);
     std::string join(const std::string& delimiter, const std::vector<std::string>& parts);
+
+    // the text as a quoted JSON string, with quotes, backslashes and control characters escaped
+    std::string to_json_string(std::string_view text);
 }
 
 #endif
@@ -0,0 +1,109 @@
+#include "kernel_comparison.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <format>
+#include <iomanip>
+#include <iostream>
+#include <locale>
+
+#include "platform_metrics.hpp"
+#include "profiler.hpp"
+
+namespace
+{
+    template<distance_kernel Kernel>
+    kernel_comparison measure_kernel(std::span<const globe_point_pair> point_pairs, std::span<const double> reference_distances, double earth_radius)
+    {
+        // an anchor per kernel, so the profile lists them side by side; registered once, on the first call
+#if PROFILER
+        static const named_anchor anchor = profiler::register_anchor(std::format("measure_kernel_{}", Kernel::name));
+#endif
+        PROFILE_NAMED_DATA_BLOCK(anchor, point_pairs.size() * sizeof(globe_point_pair));
+
+        std::vector<double> distances(point_pairs.size());
+
+        // the per-point work is timed apart, as callers that reuse points pay it once per point rather than per pair
+        const uint64_t prepare_start = read_cpu_timer();
+        const std::vector<typename Kernel::point_data> prepared_points = prepare_point_pairs<Kernel>(point_pairs);
+        const uint64_t start_time = read_cpu_timer();
+
+        for (size_t i = 0; i < point_pairs.size(); ++i)
+            distances[i] = Kernel::distance(prepared_points[2 * i], prepared_points[2 * i + 1], earth_radius);
+
+        const uint64_t end_time = read_cpu_timer();
+
+        kernel_comparison result{ .name = Kernel::name, .prepare_cycles = start_time - prepare_start, .elapsed_cycles = end_time - start_time };
+        if (point_pairs.empty())
+            return result;
+
+        const double sum_coeff = 1.0 / point_pairs.size();
+
+        for (size_t i = 0; i < distances.size(); ++i)
+        {
+            const double reference = reference_distances[i];
+            const double abs_error = std::abs(distances[i] - reference);
+
+            result.mean_distance += sum_coeff * distances[i];
+            result.mean_abs_error += sum_coeff * abs_error;
+            result.max_abs_error = std::max(result.max_abs_error, abs_error);
+
+            if (reference > 0.0)
+                result.max_relative_error = std::max(result.max_relative_error, abs_error / reference);
+        }
+
+        return result;
+    }
+}
+
+std::vector<kernel_comparison> compare_distance_kernels(std::span<const globe_point_pair> point_pairs, double earth_radius)
+{
+    PROFILE_FUNCTION;
+
+    std::vector<double> reference_distances;
+    reference_distances.reserve(point_pairs.size());
+
+    for (const auto& [p1, p2] : point_pairs)
+        reference_distances.push_back(haversine_distance(p1, p2, earth_radius));
+
+    std::vector<kernel_comparison> comparisons;
+
+    for (const distance_kernel_type type : all_distance_kernels)
+    {
+        comparisons.push_back(dispatch_kernel(type, [&]<typename Kernel>(Kernel)
+        {
+            return measure_kernel<Kernel>(point_pairs, reference_distances, earth_radius);
+        }));
+    }
+
+    return comparisons;
+}
+
+void print_kernel_comparisons(std::span<const kernel_comparison> comparisons, size_t pair_count)
+{
+    const uint64_t cpu_freq = estimate_cpu_timer_freq();
+    if (!cpu_freq || comparisons.empty() || !pair_count)
+        return;
+
+    // the first entry is always the haversine kernel, which every other kernel is compared against
+    const uint64_t baseline_cycles = comparisons.front().elapsed_cycles;
+
+    std::cout << "Distance kernels:\n";
+
+    for (const kernel_comparison& comparison : comparisons)
+    {
+        const double seconds = static_cast<double>(comparison.elapsed_cycles) / cpu_freq;
+        const double ns_per_pair = 1.0e9 * seconds / pair_count;
+        const double pairs_per_second = seconds > 0.0 ? pair_count / seconds : 0.0;
+        const double speedup = comparison.elapsed_cycles ? static_cast<double>(baseline_cycles) / comparison.elapsed_cycles : 0.0;
+        const double prepare_ns_per_point = 1.0e9 * comparison.prepare_cycles / cpu_freq / (2 * pair_count);
+
+        std::cout << std::left << std::setw(20) << std::format("  {}:", comparison.name);
+        std::cout << std::format(std::locale("en_US"), "{:.2f} ns/pair ({:Ld} pairs/s, {:.2f}x), prepare {:.2f} ns/point",
+                                 ns_per_pair, static_cast<uint64_t>(pairs_per_second), speedup, prepare_ns_per_point);
+        std::cout << std::format("  [Mean error: {:.3e} km, Max error: {:.3e} km ({:.3e} relative)]\n",
+                                 comparison.mean_abs_error, comparison.max_abs_error, comparison.max_relative_error);
+    }
+
+    std::cout << '\n';
+}
@@ -0,0 +1,28 @@
+﻿#ifndef WS_KERNELCOMPARISON_HPP
+#define WS_KERNELCOMPARISON_HPP
+
+#include <cstdint>
+#include <span>
+#include <string_view>
+#include <vector>
+
+#include "distance_kernels.hpp"
+#include "haversine_formula.hpp"
+
+// throughput and accuracy of one distance kernel, measured against haversine_distance; elapsed_cycles times only
+// the per-pair distance step, over points prepared beforehand
+struct kernel_comparison
+{
+    std::string_view name;
+    uint64_t prepare_cycles{};
+    uint64_t elapsed_cycles{};
+    double mean_distance{};
+    double mean_abs_error{};
+    double max_abs_error{};
+    double max_relative_error{};
+};
+
+std::vector<kernel_comparison> compare_distance_kernels(std::span<const globe_point_pair> point_pairs, double earth_radius = default_earth_radius);
+void print_kernel_comparisons(std::span<const kernel_comparison> comparisons, size_t pair_count);
+
+#endif
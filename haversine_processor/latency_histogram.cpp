@@ -0,0 +1,43 @@
+#include "latency_histogram.hpp"
+
+#include <cmath>
+
+uint64_t latency_histogram::bucket_upper_bound(size_t index)
+{
+    if (index < 2 * sub_bucket_half_count)
+        return index;
+
+    // index = magnitude * half + (value >> magnitude), with value >> magnitude in [half, 2 * half)
+    const uint32_t magnitude = static_cast<uint32_t>(index / sub_bucket_half_count) - 1;
+    const uint64_t sub_bucket = index - static_cast<size_t>(magnitude) * sub_bucket_half_count;
+
+    return ((sub_bucket + 1) << magnitude) - 1;
+}
+
+void latency_histogram::merge(const latency_histogram& other)
+{
+    for (size_t i = 0; i < bucket_count; ++i)
+        m_buckets[i] += other.m_buckets[i];
+
+    m_count += other.m_count;
+    m_max = std::max(m_max, other.m_max);
+}
+
+uint64_t latency_histogram::quantile(double q) const
+{
+    if (!m_count)
+        return 0;
+
+    // rank of the requested value, counted from 1
+    const uint64_t rank = std::max<uint64_t>(1, static_cast<uint64_t>(std::ceil(std::clamp(q, 0.0, 1.0) * m_count)));
+
+    uint64_t seen = 0;
+    for (size_t i = 0; i < bucket_count; ++i)
+    {
+        seen += m_buckets[i];
+        if (seen >= rank)
+            return std::min(bucket_upper_bound(i), m_max);
+    }
+
+    return m_max;
+}
@@ -0,0 +1,55 @@
+﻿#ifndef WS_LATENCYHISTOGRAM_HPP
+#define WS_LATENCYHISTOGRAM_HPP
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+
+// Log-bucketed histogram of durations in fixed memory, HDR-style: values below 2 * sub_bucket_half_count get one
+// bucket each, and every power of two above that is split into sub_bucket_half_count equal buckets, so a bucket
+// is never wider than 1/16 of the values it holds. Values past max_value_bits share the last bucket; the exact
+// maximum is kept separately.
+class latency_histogram
+{
+public:
+    static constexpr uint32_t sub_bucket_bits = 5;
+    static constexpr uint32_t sub_bucket_half_count = 1u << (sub_bucket_bits - 1);
+    static constexpr uint32_t max_value_bits = 48;
+    static constexpr size_t bucket_count = 2 * sub_bucket_half_count + (max_value_bits - sub_bucket_bits) * sub_bucket_half_count;
+
+private:
+    std::array<uint32_t, bucket_count> m_buckets{};
+    uint64_t m_count{};
+    uint64_t m_max{};
+
+    static size_t bucket_index(uint64_t value)
+    {
+        const uint32_t magnitude = std::max(static_cast<uint32_t>(std::bit_width(value)), sub_bucket_bits) - sub_bucket_bits;
+        const size_t index = (magnitude * sub_bucket_half_count) + static_cast<size_t>(value >> magnitude);
+
+        return std::min(index, bucket_count - 1);
+    }
+
+    // the largest value that lands in the bucket
+    static uint64_t bucket_upper_bound(size_t index);
+
+public:
+    void add(uint64_t value)
+    {
+        ++m_buckets[bucket_index(value)];
+        ++m_count;
+        m_max = std::max(m_max, value);
+    }
+
+    void merge(const latency_histogram& other);
+
+    // value at quantile q in [0, 1], at most one bucket above the exact one; 0 for an empty histogram
+    uint64_t quantile(double q) const;
+
+    uint64_t count() const { return m_count; }
+    uint64_t max() const { return m_max; }
+};
+
+#endif
@@ -1,4 +1,7 @@
+﻿#include <algorithm>
+#include <charconv>
 #include <chrono>
+#include <cmath>
 #include <cstddef>
 #include <cstdint>
 #include <cstdlib>
@@ -8,26 +11,313 @@
 #include <fstream>
 #include <iostream>
 #include <optional>
+#include <span>
+#include <stdexcept>
 #include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
 
+#include "allocation_tracker.hpp"
+#include "benchmark_report.hpp"
+#include "distance_kernels.hpp"
+#include "distance_matrix.hpp"
+#include "distance_statistics.hpp"
+#include "extreme_pairs.hpp"
 #include "haversine_formula.hpp"
 #include "json/json.hpp"
+#include "kernel_comparison.hpp"
+#include "mapped_file.hpp"
+#include "memory_probe.hpp"
+#include "parallel.hpp"
 #include "platform_metrics.hpp"
+#include "point_cache.hpp"
+#include "point_input.hpp"
 #include "profiler.hpp"
+#include "spatial_index.hpp"
+#include "spatial_join.hpp"
+#include "task_scheduler.hpp"
+#include "thread_scaling.hpp"
 
 namespace
 {
+    enum class processor_mode
+    {
+        pairs,
+        matrix,
+        radius,
+        nearest,
+        join,
+        compare
+    };
+
+    // the modes that split their work across threads, and so have a scheduler to start and threads to scale
+    bool is_parallel_mode(processor_mode mode)
+    {
+        return mode != processor_mode::pairs && mode != processor_mode::compare;
+    }
+
     struct haversine_arguments
     {
+        processor_mode mode = processor_mode::pairs;
         const char* input_path = nullptr;
         const char* reference_path = nullptr;
+        const char* second_input_path = nullptr;
+        const char* output_path = nullptr;
+        const char* trace_path = nullptr;
+        const char* folded_path = nullptr;
+        const char* report_path = nullptr;
+        const char* scaling_report_path = nullptr;
+        unsigned thread_count = 0;
+        double radius = 0.0;
+        double threshold_percent = 5.0;
+        size_t repetition_count = 0;
+        size_t neighbor_count = 1;
+        bool reduce_only = false;
+        distance_kernel_type kernel = distance_kernel_type::haversine;
+        bool use_kernel = false;
+        bool compare_kernels = false;
+        bool cache_points = false;
+        bool collect_statistics = false;
+        bool profile = false;
+        bool scaling = false;
+        bool roofline = false;
+        bool pin_threads = false;
+        size_t extreme_pair_count = 0;
     };
 
-    struct globe_point_pair
+    template<typename T>
+    bool parse_number(std::string_view text, T& value)
     {
-        globe_point point1{};
-        globe_point point2{};
-    };
+        const auto [end, error] = std::from_chars(text.data(), text.data() + text.size(), value);
+        return error == std::errc{} && end == text.data() + text.size();
+    }
+
+    bool parse_option(std::string_view option, haversine_arguments& app_args)
+    {
+        constexpr std::string_view kernel_prefix = "--kernel=";
+        constexpr std::string_view mode_prefix = "--mode=";
+        constexpr std::string_view output_prefix = "--output=";
+        constexpr std::string_view threads_prefix = "--threads=";
+        constexpr std::string_view radius_prefix = "--radius=";
+        constexpr std::string_view neighbors_prefix = "--k=";
+        constexpr std::string_view top_prefix = "--top=";
+        constexpr std::string_view trace_prefix = "--trace=";
+        constexpr std::string_view folded_prefix = "--folded=";
+        constexpr std::string_view report_prefix = "--report=";
+        constexpr std::string_view threshold_prefix = "--threshold=";
+        constexpr std::string_view repetitions_prefix = "--repetitions=";
+        constexpr std::string_view scaling_report_prefix = "--scaling-report=";
+
+        if (option.starts_with(mode_prefix))
+        {
+            const std::string_view mode = option.substr(mode_prefix.size());
+
+            if (mode == "pairs")
+                app_args.mode = processor_mode::pairs;
+            else if (mode == "matrix")
+                app_args.mode = processor_mode::matrix;
+            else if (mode == "radius")
+                app_args.mode = processor_mode::radius;
+            else if (mode == "nearest")
+                app_args.mode = processor_mode::nearest;
+            else if (mode == "join")
+                app_args.mode = processor_mode::join;
+            else if (mode == "compare")
+                app_args.mode = processor_mode::compare;
+            else
+                return false;
+
+            return true;
+        }
+
+        if (option.starts_with(output_prefix))
+        {
+            app_args.output_path = option.data() + output_prefix.size();
+            return !option.substr(output_prefix.size()).empty();
+        }
+
+        if (option.starts_with(trace_prefix))
+        {
+            app_args.trace_path = option.data() + trace_prefix.size();
+            return !option.substr(trace_prefix.size()).empty();
+        }
+
+        if (option.starts_with(folded_prefix))
+        {
+            app_args.folded_path = option.data() + folded_prefix.size();
+            return !option.substr(folded_prefix.size()).empty();
+        }
+
+        if (option.starts_with(report_prefix))
+        {
+            app_args.report_path = option.data() + report_prefix.size();
+            return !option.substr(report_prefix.size()).empty();
+        }
+
+        if (option.starts_with(repetitions_prefix))
+            return parse_number(option.substr(repetitions_prefix.size()), app_args.repetition_count) && app_args.repetition_count > 0;
+
+        if (option.starts_with(scaling_report_prefix))
+        {
+            app_args.scaling_report_path = option.data() + scaling_report_prefix.size();
+            app_args.scaling = true;
+            return !option.substr(scaling_report_prefix.size()).empty();
+        }
+
+        if (option == "--scaling")
+        {
+            app_args.scaling = true;
+            return true;
+        }
+
+        if (option.starts_with(threshold_prefix))
+            return parse_number(option.substr(threshold_prefix.size()), app_args.threshold_percent) && app_args.threshold_percent >= 0.0;
+
+        if (option.starts_with(threads_prefix))
+            return parse_number(option.substr(threads_prefix.size()), app_args.thread_count);
+
+        if (option == "--pin-threads")
+        {
+            app_args.pin_threads = true;
+            return true;
+        }
+
+        if (option.starts_with(radius_prefix))
+            return parse_number(option.substr(radius_prefix.size()), app_args.radius) && app_args.radius >= 0.0;
+
+        if (option.starts_with(neighbors_prefix))
+            return parse_number(option.substr(neighbors_prefix.size()), app_args.neighbor_count) && app_args.neighbor_count > 0;
+
+        if (option == "--reduce")
+        {
+            app_args.reduce_only = true;
+            return true;
+        }
+
+        if (option.starts_with(kernel_prefix))
+        {
+            const std::optional<distance_kernel_type> kernel = parse_distance_kernel(option.substr(kernel_prefix.size()));
+            if (!kernel)
+                return false;
+
+            app_args.kernel = *kernel;
+            app_args.use_kernel = true;
+            return true;
+        }
+
+        if (option == "--compare-kernels")
+        {
+            app_args.compare_kernels = true;
+            return true;
+        }
+
+        if (option == "--cache-points")
+        {
+            app_args.cache_points = true;
+            return true;
+        }
+
+        if (option == "--stats")
+        {
+            app_args.collect_statistics = true;
+            return true;
+        }
+
+        if (option.starts_with(top_prefix))
+            return parse_number(option.substr(top_prefix.size()), app_args.extreme_pair_count) && app_args.extreme_pair_count > 0;
+
+        if (option == "--profile")
+        {
+            app_args.profile = true;
+            return true;
+        }
+
+        if (option == "--roofline")
+        {
+            app_args.roofline = true;
+            return true;
+        }
+
+        return false;
+    }
+
+    bool parse_arguments(int argc, char* argv[], haversine_arguments& app_args, const std::string& usage_message)
+    {
+        std::vector<const char*> positional_args;
+
+        for (int i = 1; i < argc; ++i)
+        {
+            const std::string_view arg = argv[i];
+
+            if (!arg.starts_with("--"))
+            {
+                positional_args.push_back(argv[i]);
+                continue;
+            }
+
+            if (!parse_option(arg, app_args))
+            {
+                std::cout << usage_message << "\n\n";
+                std::cout << "Unrecognized option '" << arg << "'.\n";
+                return false;
+            }
+        }
+
+        if (positional_args.empty() || positional_args.size() > 2 || (app_args.mode == processor_mode::compare && positional_args.size() != 2))
+        {
+            std::cout << usage_message << "\n";
+            return false;
+        }
+
+        // the report describes a pairs run; other modes would drop it without a word
+        if (app_args.report_path && app_args.mode != processor_mode::pairs)
+        {
+            std::cout << usage_message << "\n\n";
+            std::cout << "--report needs --mode=pairs.\n";
+            return false;
+        }
+
+        if (app_args.repetition_count && app_args.mode != processor_mode::pairs)
+        {
+            std::cout << usage_message << "\n\n";
+            std::cout << "--repetitions needs --mode=pairs.\n";
+            return false;
+        }
+
+        // the trace ring and the call tree cost every profile block, so they are only there when the build asks
+        if (app_args.trace_path && !PROFILER_TRACE)
+        {
+            std::cout << usage_message << "\n\n";
+            std::cout << "--trace needs a build with PROFILER_TRACE=1.\n";
+            return false;
+        }
+
+        if (app_args.folded_path && !PROFILER_CALL_TREE)
+        {
+            std::cout << usage_message << "\n\n";
+            std::cout << "--folded needs a build with PROFILER_CALL_TREE=1.\n";
+            return false;
+        }
+
+        if (app_args.scaling && !is_parallel_mode(app_args.mode))
+        {
+            std::cout << usage_message << "\n\n";
+            std::cout << "--scaling needs --mode=matrix, radius, nearest or join.\n";
+            return false;
+        }
+
+        app_args.input_path = positional_args[0];
+        if (positional_args.size() == 2)
+        {
+            if (app_args.mode == processor_mode::pairs)
+                app_args.reference_path = positional_args[1];
+            else
+                app_args.second_input_path = positional_args[1];
+        }
+
+        return true;
+    }
 
     void print_json_document(const json::json_document& document)
     {
@@ -41,106 +331,71 @@ namespace
         int pair_count{};
     };
 
-    haversine_result calculate_haversine(const json::json_document& document)
+    haversine_result calculate_haversine(const std::vector<globe_point_pair>& point_pairs, distance_statistics* statistics, extreme_pairs* extremes)
     {
         PROFILE_FUNCTION;
 
-        using namespace json;
-        const json_object* root = document.as<json_object>();
-        if (!root)
-            throw std::exception{ "The JSON root element is not an object." };
-
-        const json_array* point_pairs = root->get_as<json_array>("pairs");
-        if (!point_pairs)
-            throw std::exception{ "Could not find array member 'pairs'." };
-
         // calculate average haversine distance
-        const size_t point_pair_count = point_pairs->size();
-        constexpr long long max_pair_count = 1ULL << 30;
-        if (point_pair_count > max_pair_count)
-            throw std::exception{ "The input JSON has too many point pairs." };
-
-        const double sum_coeff = 1.0 / point_pair_count;
+        const double sum_coeff = 1.0 / point_pairs.size();
         double mean_distance = 0.0;
         int pair_count = 0;
 
-        for (const json_element& pair_element : *point_pairs)
-        {
-            const auto* point_pair = pair_element.as<json_object>();
-            if (!point_pair)
-                throw std::exception{ "Unexpected non-object found in pair array." };
-
-            if (point_pair->size() != 4)
-                throw std::exception{ "Point pair objects must have exactly 4 members: x0, y0, x1, y1" };
-
-            std::optional<float_literal> p_x0;
-            std::optional<float_literal> p_y0;
-            std::optional<float_literal> p_x1;
-            std::optional<float_literal> p_y1;
-
-            for (const auto& [name, value] : *point_pair)
-            {
-                if (name.size() != 2)
-                    throw std::exception{ "Unexpected point pair member found." };
-
-                switch (name[0])
-                {
-                    case 'x':
-                        switch (name[1])
-                        {
-                            case '0': p_x0 = value.as_number(); break;
-                            case '1': p_x1 = value.as_number(); break;
-                        }
-                        break;
-
-                    case 'y':
-                        switch (name[1])
-                        {
-                            case '0': p_y0 = value.as_number(); break;
-                            case '1': p_y1 = value.as_number(); break;
-                        }
-                        break;
-                }
-            }
-
-            if (!p_x0 || !p_y0 || !p_x1 || !p_y1)
-                throw std::exception{ "Could not find all 4 point pair members: x0, y0, x1, y1" };
-
-            const globe_point p1{ .x = *p_x0, .y = *p_y0 };
-            const globe_point p2{ .x = *p_x1, .y = *p_y1 };
+        // the t-digest behind --stats allocates as it compresses
+        ASSERT_NO_ALLOCATIONS_IF("haversine pair loop", !statistics);
 
+        for (const auto& [p1, p2] : point_pairs)
+        {
             const double distance = haversine_distance(p1, p2);
             mean_distance += sum_coeff * distance;
 
+            if (statistics)
+                statistics->add(distance, pair_count);
+
+            if (extremes)
+                extremes->add(distance, pair_count);
+
             ++pair_count;
         }
 
         return { mean_distance, pair_count };
     }
 
-    double read_reference_distance(const std::string& path, size_t expected_points)
+    template<distance_kernel Kernel>
+    std::vector<typename Kernel::point_data> prepare_kernel_points(const std::vector<globe_point_pair>& point_pairs)
+    {
+        PROFILE_DATA_BLOCK("prepare_kernel_points", point_pairs.size() * sizeof(globe_point_pair));
+        return prepare_point_pairs<Kernel>(point_pairs);
+    }
+
+    template<distance_kernel Kernel>
+    haversine_result calculate_kernel_distance(const std::vector<globe_point_pair>& point_pairs, distance_statistics* statistics, extreme_pairs* extremes)
     {
-        PROFILE_DATA_FUNCTION((expected_points + 1) * sizeof(double));
+        // prepared ahead of the pair loop, so the loop's block times the kernel's distance step alone
+        const std::vector<typename Kernel::point_data> prepared_points = prepare_kernel_points<Kernel>(point_pairs);
 
-        std::ifstream input_file{ path, std::ios::binary };
+        PROFILE_DATA_BLOCK("calculate_kernel_distance", prepared_points.size() * sizeof(typename Kernel::point_data));
+
+        const double sum_coeff = 1.0 / point_pairs.size();
+        double mean_distance = 0.0;
+        int pair_count = 0;
 
-        if (!input_file)
-            throw std::exception{ "Cannot open reference binary file." };
+        ASSERT_NO_ALLOCATIONS_IF("kernel pair loop", !statistics);
 
-        size_t distance_count = 0;
-        double distance = 0.0;
-        while (input_file && !input_file.eof())
+        for (size_t i = 0; i < prepared_points.size(); i += 2)
         {
-            input_file.read(reinterpret_cast<char*>(&distance), sizeof(decltype(distance)));
-            ++distance_count;
-            input_file.peek();
-        }
-        distance_count -= (distance_count > 0);
+            const double distance = Kernel::distance(prepared_points[i], prepared_points[i + 1], default_earth_radius);
+            mean_distance += sum_coeff * distance;
+
+            if (statistics)
+                statistics->add(distance, pair_count);
 
-        if (distance_count != expected_points)
-            throw std::exception{ "The binary answers file and input JSON do not have the same number of point pairs." };
+            if (extremes)
+                extremes->add(distance, pair_count);
+
+            ++pair_count;
+        }
 
-        return distance;
+        return { mean_distance, pair_count };
     }
 
     void print_haversine_results(uintmax_t input_file_size, double mean_distance, int pair_count)
@@ -150,45 +405,84 @@ namespace
         std::cout << std::format("Haversine mean: {:.16f}\n\n", mean_distance);
     }
 
+    void print_kernel_results(distance_kernel_type kernel)
+    {
+        std::cout << "Distance kernel: " << to_string(kernel) << "\n\n";
+    }
+
     void print_validation_results(double reference_mean_distance, double distance_difference)
     {
         std::cout << "Validation:\n";
         std::cout << std::format("  Reference mean: {:.16f}\n", reference_mean_distance);
         std::cout << std::format("  Difference: {:.16f}\n\n", distance_difference);
     }
-}
 
-int main(int argc, char* argv[])
-{
-    // read command line arguments
-    const std::string exe_filename = std::filesystem::path(argv[0]).filename().string();
-    const std::string usage_message = "Usage: " + exe_filename + " [haversine_input.json]\n"
-                                      "       " + exe_filename + " [haversine_input.json] [answers.f64]";
-
-    haversine_arguments app_args;
-    if (argc == 2)
+    // what one run over the pairs computed; a repeated run prints the last one
+    struct pairs_pass
     {
-        app_args = { .input_path = argv[1] };
-    }
-    else if (argc == 3)
+        std::vector<globe_point_pair> point_pairs;
+        std::optional<point_cache> cache;
+        cached_distance_result cached_result;
+        std::optional<distance_statistics> statistics;
+        std::optional<extreme_pairs> extremes;
+        std::vector<kernel_comparison> kernel_comparisons;
+        haversine_result result;
+        double reference_mean_distance = 0.0;
+    };
+
+    void run_pairs_pass(const haversine_arguments& app_args, pairs_pass& pass)
     {
-        app_args = haversine_arguments
+        using namespace json;
+        json_document document = deserialize_json(app_args.input_path);
+        //print_json_document(document);
+
+        pass.point_pairs = read_point_pairs(document);
+
+        if (app_args.collect_statistics)
+            pass.statistics.emplace();
+
+        distance_statistics* statistics_ptr = pass.statistics ? &*pass.statistics : nullptr;
+
+        if (app_args.extreme_pair_count)
+            pass.extremes.emplace(app_args.extreme_pair_count);
+
+        extreme_pairs* extremes_ptr = pass.extremes ? &*pass.extremes : nullptr;
+
+        if (app_args.cache_points)
         {
-            .input_path = argv[1],
-            .reference_path = argv[2]
-        };
-    }
-    else
-    {
-        std::cout << usage_message << "\n";
-        return EXIT_FAILURE;
+            point_cache& cache = pass.cache.emplace(pass.point_pairs);
+            pass.cached_result = dispatch_kernel(app_args.kernel, [&]<typename Kernel>(Kernel) { return calculate_cached_distance<Kernel>(cache, statistics_ptr, extremes_ptr); });
+            pass.result = { pass.cached_result.mean_distance, pass.cached_result.pair_count };
+
+            // after the cached pass rather than inside it, so its block times the cache alone
+            pass.cached_result.uncached_cycles_estimate = dispatch_kernel(app_args.kernel, [&]<typename Kernel>(Kernel) { return estimate_uncached_cycles<Kernel>(cache); });
+            annotate_point_cache_profile(cache, pass.cached_result);
+        }
+        else if (app_args.use_kernel)
+        {
+            pass.result = dispatch_kernel(app_args.kernel, [&]<typename Kernel>(Kernel) { return calculate_kernel_distance<Kernel>(pass.point_pairs, statistics_ptr, extremes_ptr); });
+        }
+        else
+        {
+            pass.result = calculate_haversine(pass.point_pairs, statistics_ptr, extremes_ptr);
+        }
+
+        if (app_args.compare_kernels)
+            pass.kernel_comparisons = compare_distance_kernels(pass.point_pairs);
+
+        if (app_args.reference_path)
+            pass.reference_mean_distance = read_reference_distance(app_args.reference_path, pass.result.pair_count);
     }
 
-    try
+    void run_point_pairs(const haversine_arguments& app_args)
     {
+        // a report gets enough repetitions for a comparison to tell a change from run-to-run noise
+        constexpr size_t report_repetition_count = 5;
+
         auto input_file_info = std::filesystem::path(app_args.input_path);
         const std::string input_filename = input_file_info.filename().string();
         const uintmax_t input_file_size = std::filesystem::file_size(input_file_info);
+        const size_t repetition_count = app_args.repetition_count ? app_args.repetition_count : app_args.report_path ? report_repetition_count : 1;
 
         std::cout << "--- Haversine Distance Processor ---\n\n";
         std::cout << "Input file: " << input_filename << "\n";
@@ -199,33 +493,588 @@ int main(int argc, char* argv[])
             std::cout << "Reference file: " << reference_filename << "\n";
         }
 
+        if (repetition_count > 1)
+            std::cout << "Repetitions: " << repetition_count << " (the results are the last one's, the profile sums them all)\n";
+
         std::cout << '\n';
 
-        double reference_mean_distance = 0.0;
-        double distance_difference = 0.0;
+        std::optional<pairs_pass> pass;
+        std::vector<benchmark_repetition> repetitions;
 
         profiler::start_profiling();
 
-        using namespace json;
-        json_document document = deserialize_json(app_args.input_path);
-        //print_json_document(document);
+        for (size_t repetition = 0; repetition < repetition_count; ++repetition)
+        {
+            // the previous results are freed first, so every repetition starts with the same memory
+            pass.reset();
 
-        auto [mean_distance, pair_count] = calculate_haversine(document);
+            const uint64_t start_time = read_cpu_timer();
+            run_pairs_pass(app_args, pass.emplace());
+            const uint64_t elapsed_cycles = read_cpu_timer() - start_time;
 
-        if (app_args.reference_path)
-        {
-            reference_mean_distance = read_reference_distance(app_args.reference_path, pair_count);
-            distance_difference = std::abs(mean_distance - reference_mean_distance);
+            if (app_args.report_path)
+                repetitions.push_back(record_benchmark_repetition(elapsed_cycles));
         }
 
         profiler::stop_profiling();
 
+        const auto [mean_distance, pair_count] = pass->result;
+        const std::vector<globe_point_pair>& point_pairs = pass->point_pairs;
+
         print_haversine_results(input_file_size, mean_distance, pair_count);
 
+        if (app_args.use_kernel || app_args.cache_points)
+            print_kernel_results(app_args.kernel);
+
         if (app_args.reference_path)
-            print_validation_results(reference_mean_distance, distance_difference);
+            print_validation_results(pass->reference_mean_distance, std::abs(mean_distance - pass->reference_mean_distance));
+
+        if (pass->statistics)
+            print_distance_statistics(*pass->statistics);
+
+        if (pass->extremes)
+            print_extreme_pairs(*pass->extremes, point_pairs);
+
+        if (pass->cache)
+            print_point_cache_results(*pass->cache, pass->cached_result);
+
+        if (app_args.compare_kernels)
+            print_kernel_comparisons(pass->kernel_comparisons, point_pairs.size());
+
+        profiler::print_results();
+
+        if (app_args.report_path)
+        {
+            write_benchmark_report(app_args.report_path, {
+                .input_path = app_args.input_path,
+                .input_size = input_file_size,
+                .pair_count = static_cast<uint64_t>(pair_count),
+                .mean_distance = mean_distance,
+                .kernel = to_string(app_args.kernel),
+                .repetitions = repetitions
+            });
+
+            std::cout << "\nReport written to " << std::filesystem::path(app_args.report_path).filename().string() << '\n';
+
+            if (PROFILER && profiler::is_enabled())
+                std::cout << "The profiler was on, so the report's total includes its overhead.\n";
+        }
+    }
+
+    void write_row_reductions(const char* path, std::span<const row_reduction> reductions)
+    {
+        PROFILE_DATA_FUNCTION(2 * reductions.size() * sizeof(double));
+
+        mapped_output_file output{ path, 2 * reductions.size() * sizeof(double) };
+        const std::span<double> values = output.as_span<double>();
+
+        for (size_t row = 0; row < reductions.size(); ++row)
+        {
+            values[2 * row] = reductions[row].min_distance;
+            values[2 * row + 1] = reductions[row].mean_distance;
+        }
+    }
+
+    void print_matrix_results(size_t row_count, size_t column_count, unsigned thread_count)
+    {
+        std::cout << std::format(std::locale("en_US"), "Matrix: {:Ld} x {:Ld} ({:Ld} distances)\n", row_count, column_count, row_count * column_count);
+        std::cout << "Threads: " << (thread_count ? thread_count : default_thread_count()) << "\n";
+    }
+
+    void print_reduction_results(std::span<const row_reduction> reductions)
+    {
+        const auto nearest = std::ranges::min_element(reductions, {}, &row_reduction::min_distance);
+        const double mean_coeff = 1.0 / reductions.size();
+
+        double mean_distance = 0.0;
+        for (const row_reduction& reduction : reductions)
+            mean_distance += mean_coeff * reduction.mean_distance;
+
+        std::cout << std::format("Haversine mean: {:.16f}\n", mean_distance);
+
+        if (std::isfinite(nearest->min_distance))
+            std::cout << std::format("Closest pair: row {} column {} ({:.16f})\n", nearest - reductions.begin(), nearest->min_index, nearest->min_distance);
+    }
+
+    void run_distance_matrix(const haversine_arguments& app_args)
+    {
+        const char* output_path = app_args.output_path;
+        if (!output_path && !app_args.reduce_only)
+            output_path = "haversine_matrix.f64";
+
+        std::cout << "--- Haversine Distance Processor ---\n\n";
+        std::cout << "Input file: " << std::filesystem::path(app_args.input_path).filename().string() << "\n";
+
+        if (app_args.second_input_path)
+            std::cout << "Second input file: " << std::filesystem::path(app_args.second_input_path).filename().string() << "\n";
+
+        if (output_path)
+            std::cout << "Output file: " << std::filesystem::path(output_path).filename().string() << "\n";
+
+        std::cout << '\n';
+
+        profiler::start_profiling();
+
+        using namespace json;
+        const std::vector<globe_point> rows = read_point_set(deserialize_json(app_args.input_path));
+
+        std::vector<globe_point> second;
+        if (app_args.second_input_path)
+            second = read_point_set(deserialize_json(app_args.second_input_path));
+
+        // a single set is its own columns, which lets the reduction skip each point's distance to itself
+        const std::span<const globe_point> columns = app_args.second_input_path ? std::span<const globe_point>{ second } : std::span<const globe_point>{ rows };
+
+        std::vector<row_reduction> reductions;
+        if (app_args.reduce_only)
+        {
+            reductions = reduce_distance_matrix(rows, columns, app_args.thread_count);
+
+            if (output_path)
+                write_row_reductions(output_path, reductions);
+        }
+        else
+        {
+            mapped_output_file output{ output_path, distance_matrix_size(rows, columns) };
+            compute_distance_matrix(rows, columns, output.as_span<double>(), app_args.thread_count);
+        }
+
+        profiler::stop_profiling();
+
+        print_matrix_results(rows.size(), columns.size(), app_args.thread_count);
+
+        if (app_args.reduce_only)
+            print_reduction_results(reductions);
+
+        std::cout << '\n';
+
+        profiler::print_results();
+    }
+
+    void write_spatial_results(const char* path, const std::vector<std::vector<spatial_neighbor>>& results)
+    {
+        PROFILE_FUNCTION;
+
+        std::ofstream output_stream{ path };
+
+        if (!output_stream)
+            throw std::runtime_error{ "Could not write spatial query results file." };
+
+        for (size_t query = 0; query < results.size(); ++query)
+        {
+            for (const spatial_neighbor& neighbor : results[query])
+                output_stream << std::format("{} {} {:.16f}\n", query, neighbor.index, neighbor.distance);
+        }
+    }
+
+    void print_spatial_results(const haversine_arguments& app_args, size_t point_count, const std::vector<std::vector<spatial_neighbor>>& results)
+    {
+        size_t neighbor_total = 0;
+        size_t nearest_count = 0;
+        double nearest_sum = 0.0;
+
+        for (const std::vector<spatial_neighbor>& neighbors : results)
+        {
+            neighbor_total += neighbors.size();
+
+            if (!neighbors.empty())
+            {
+                nearest_sum += neighbors.front().distance;
+                ++nearest_count;
+            }
+        }
+
+        if (app_args.mode == processor_mode::radius)
+            std::cout << std::format("Query: within {} of each point\n", app_args.radius);
+        else
+            std::cout << std::format(std::locale("en_US"), "Query: {:Ld} nearest to each point\n", app_args.neighbor_count);
+
+        std::cout << std::format(std::locale("en_US"), "Indexed points: {:Ld}\n", point_count);
+        std::cout << std::format(std::locale("en_US"), "Query points: {:Ld}\n", results.size());
+        std::cout << std::format(std::locale("en_US"), "Neighbors found: {:Ld}\n", neighbor_total);
+
+        if (nearest_count)
+            std::cout << std::format("Mean nearest distance: {:.16f}\n", nearest_sum / nearest_count);
+
+        std::cout << '\n';
+    }
+
+    void run_spatial_query(const haversine_arguments& app_args)
+    {
+        std::cout << "--- Haversine Distance Processor ---\n\n";
+        std::cout << "Input file: " << std::filesystem::path(app_args.input_path).filename().string() << "\n";
+
+        if (app_args.second_input_path)
+            std::cout << "Query file: " << std::filesystem::path(app_args.second_input_path).filename().string() << "\n";
+
+        if (app_args.output_path)
+            std::cout << "Output file: " << std::filesystem::path(app_args.output_path).filename().string() << "\n";
+
+        std::cout << '\n';
+
+        profiler::start_profiling();
+
+        using namespace json;
+        const std::vector<globe_point> points = read_point_set(deserialize_json(app_args.input_path));
+        const std::vector<globe_point> queries = app_args.second_input_path ? read_point_set(deserialize_json(app_args.second_input_path)) : points;
+
+        const spatial_index index{ points, app_args.thread_count };
+
+        const std::vector<std::vector<spatial_neighbor>> results = app_args.mode == processor_mode::radius
+            ? index.within_radius(queries, app_args.radius, app_args.thread_count)
+            : index.nearest(queries, app_args.neighbor_count, app_args.thread_count);
+
+        if (app_args.output_path)
+            write_spatial_results(app_args.output_path, results);
+
+        profiler::stop_profiling();
+
+        print_spatial_results(app_args, points.size(), results);
+
+        profiler::print_results();
+    }
+
+    void write_join_results(const char* path, const std::vector<join_pair>& pairs)
+    {
+        PROFILE_FUNCTION;
+
+        std::ofstream output_stream{ path };
+
+        if (!output_stream)
+            throw std::runtime_error{ "Could not write spatial join results file." };
+
+        for (const join_pair& pair : pairs)
+            output_stream << std::format("{} {} {:.16f}\n", pair.first, pair.second, pair.distance);
+    }
+
+    void print_join_results(const haversine_arguments& app_args, size_t first_count, size_t second_count, const std::vector<join_pair>& pairs)
+    {
+        double distance_sum = 0.0;
+        for (const join_pair& pair : pairs)
+            distance_sum += pair.distance;
+
+        std::cout << std::format("Join: pairs within {}\n", app_args.radius);
+        std::cout << std::format(std::locale("en_US"), "First set points: {:Ld}\n", first_count);
+
+        if (app_args.second_input_path)
+            std::cout << std::format(std::locale("en_US"), "Second set points: {:Ld}\n", second_count);
+
+        std::cout << std::format(std::locale("en_US"), "Pairs found: {:Ld}\n", pairs.size());
+
+        if (!pairs.empty())
+            std::cout << std::format("Mean pair distance: {:.16f}\n", distance_sum / pairs.size());
+
+        std::cout << '\n';
+    }
+
+    void run_spatial_join(const haversine_arguments& app_args)
+    {
+        std::cout << "--- Haversine Distance Processor ---\n\n";
+        std::cout << "Input file: " << std::filesystem::path(app_args.input_path).filename().string() << "\n";
+
+        if (app_args.second_input_path)
+            std::cout << "Second input file: " << std::filesystem::path(app_args.second_input_path).filename().string() << "\n";
+
+        if (app_args.output_path)
+            std::cout << "Output file: " << std::filesystem::path(app_args.output_path).filename().string() << "\n";
+
+        std::cout << '\n';
+
+        profiler::start_profiling();
+
+        using namespace json;
+        const std::vector<globe_point> first = read_point_set(deserialize_json(app_args.input_path));
+
+        std::vector<globe_point> second;
+        std::vector<join_pair> pairs;
+
+        if (app_args.second_input_path)
+        {
+            second = read_point_set(deserialize_json(app_args.second_input_path));
+            pairs = spatial_join(first, second, app_args.radius, app_args.thread_count);
+        }
+        else
+        {
+            pairs = spatial_self_join(first, app_args.radius, app_args.thread_count);
+        }
+
+        if (app_args.output_path)
+            write_join_results(app_args.output_path, pairs);
+
+        profiler::stop_profiling();
+
+        print_join_results(app_args, first.size(), second.size(), pairs);
+
+        profiler::print_results();
+    }
+
+    const char* to_string(processor_mode mode)
+    {
+        switch (mode)
+        {
+            case processor_mode::matrix: return "matrix";
+            case processor_mode::radius: return "radius";
+            case processor_mode::nearest: return "nearest";
+            case processor_mode::join: return "join";
+            case processor_mode::compare: return "compare";
+            case processor_mode::pairs:
+            default: return "pairs";
+        }
+    }
+
+    // One run of the mode's whole pipeline, from reading the input to writing the output, with each stage timed.
+    // The results are only kept until the next stage has used them.
+    void run_scaling_pass(const haversine_arguments& app_args, scaling_pass& pass)
+    {
+        using namespace json;
+        const unsigned thread_count = pass.thread_count;
+
+        const std::vector<globe_point> first = time_stage(pass, "read input", [&] { return read_point_set(deserialize_json(app_args.input_path)); });
+
+        std::vector<globe_point> second;
+        if (app_args.second_input_path)
+            second = time_stage(pass, "read second input", [&] { return read_point_set(deserialize_json(app_args.second_input_path)); });
+
+        const std::span<const globe_point> other = app_args.second_input_path ? std::span<const globe_point>{ second } : std::span<const globe_point>{ first };
+
+        switch (app_args.mode)
+        {
+            case processor_mode::matrix:
+                if (app_args.reduce_only)
+                {
+                    const std::vector<row_reduction> reductions = time_stage(pass, "reduce_distance_matrix", [&] { return reduce_distance_matrix(first, other, thread_count); });
+
+                    if (app_args.output_path)
+                        time_stage(pass, "write_row_reductions", [&] { write_row_reductions(app_args.output_path, reductions); });
+                }
+                else
+                {
+                    time_stage(pass, "compute_distance_matrix", [&]
+                    {
+                        mapped_output_file output{ app_args.output_path ? app_args.output_path : "haversine_matrix.f64", distance_matrix_size(first, other) };
+                        compute_distance_matrix(first, other, output.as_span<double>(), thread_count);
+                    });
+                }
+                break;
+
+            case processor_mode::radius:
+            case processor_mode::nearest:
+            {
+                const spatial_index index = time_stage(pass, "spatial_index", [&] { return spatial_index{ first, thread_count }; });
+
+                const std::vector<std::vector<spatial_neighbor>> results = app_args.mode == processor_mode::radius
+                    ? time_stage(pass, "within_radius", [&] { return index.within_radius(other, app_args.radius, thread_count); })
+                    : time_stage(pass, "nearest", [&] { return index.nearest(other, app_args.neighbor_count, thread_count); });
+
+                if (app_args.output_path)
+                    time_stage(pass, "write_spatial_results", [&] { write_spatial_results(app_args.output_path, results); });
+                break;
+            }
+
+            case processor_mode::join:
+            {
+                const std::vector<join_pair> pairs = app_args.second_input_path
+                    ? time_stage(pass, "spatial_join", [&] { return spatial_join(first, second, app_args.radius, thread_count); })
+                    : time_stage(pass, "spatial_self_join", [&] { return spatial_self_join(first, app_args.radius, thread_count); });
+
+                if (app_args.output_path)
+                    time_stage(pass, "write_join_results", [&] { write_join_results(app_args.output_path, pairs); });
+                break;
+            }
+
+            default:
+                break;
+        }
+    }
+
+    void run_thread_scaling(const haversine_arguments& app_args)
+    {
+        std::cout << "--- Haversine Distance Processor ---\n\n";
+        std::cout << "Mode: " << to_string(app_args.mode) << "\n";
+        std::cout << "Input file: " << std::filesystem::path(app_args.input_path).filename().string() << "\n";
+
+        if (app_args.second_input_path)
+            std::cout << "Second input file: " << std::filesystem::path(app_args.second_input_path).filename().string() << "\n";
+
+        std::cout << '\n';
+
+        const std::vector<unsigned> thread_counts = scaling_thread_counts(app_args.thread_count ? app_args.thread_count : default_thread_count());
+
+        profiler::start_profiling();
+
+        // an untimed pass first, so the single-thread pass doesn't also pay for a cold file cache and fresh pages
+        std::cout << "Warming up..." << std::flush;
+        scaling_pass warm_up{ .thread_count = thread_counts.back(), .stages = {} };
+        run_scaling_pass(app_args, warm_up);
+        std::cout << " done.\n";
+
+        std::vector<scaling_pass> passes;
+
+        for (const unsigned thread_count : thread_counts)
+        {
+            std::cout << "Running with " << thread_count << (thread_count == 1 ? " thread..." : " threads...") << std::flush;
+            run_scaling_pass(app_args, passes.emplace_back(scaling_pass{ .thread_count = thread_count, .stages = {} }));
+            std::cout << " done.\n";
+        }
+
+        profiler::stop_profiling();
+
+        std::cout << '\n';
+
+        const std::vector<pass_scaling> scaling = summarize_thread_scaling(passes);
+        print_thread_scaling(scaling);
 
         profiler::print_results();
+
+        if (app_args.scaling_report_path)
+        {
+            write_scaling_report(app_args.scaling_report_path, to_string(app_args.mode), app_args.input_path, scaling);
+
+            std::cout << "\nScaling report written to " << std::filesystem::path(app_args.scaling_report_path).filename().string() << '\n';
+        }
+    }
+
+#if PROFILER_TRACE
+    void write_profile_trace(const char* path)
+    {
+        const trace_summary summary = profiler::write_trace(path);
+
+        std::cout << std::format(std::locale("en_US"), "\nTrace: {:Ld} events written to {}", summary.event_count, std::filesystem::path(path).filename().string());
+
+        if (summary.dropped_count)
+            std::cout << std::format(std::locale("en_US"), " ({:Ld} older events overwritten)", summary.dropped_count);
+
+        std::cout << '\n';
+    }
+#endif
+
+#if PROFILER_CALL_TREE
+    void write_profile_folded_stacks(const char* path)
+    {
+        const size_t stack_count = profiler::write_folded_stacks(path);
+
+        std::cout << std::format(std::locale("en_US"), "Folded stacks: {:Ld} stacks written to {}\n", stack_count, std::filesystem::path(path).filename().string());
+    }
+#endif
+}
+
+int main(int argc, char* argv[])
+{
+    // measures the CPU timer while the input is being read, if the frequency isn't known up front
+    begin_timer_calibration();
+
+    // read command line arguments
+    const std::string exe_filename = std::filesystem::path(argv[0]).filename().string();
+    const std::string usage_message = "Usage: " + exe_filename + " [options] [haversine_input.json]\n"
+                                      "       " + exe_filename + " [options] [haversine_input.json] [answers.f64]\n\n"
+                                      "Options:\n"
+                                      "  --kernel=<name>     haversine, chord, equirectangular or cosines\n"
+                                      "  --compare-kernels   report each kernel's throughput and error against haversine\n"
+                                      "  --cache-points      prepare each unique point once and reuse it for every pair it appears in\n"
+                                      "  --stats             report min/max, standard deviation, percentiles and a histogram of the distances\n"
+                                      "  --top=<count>       report the longest and shortest pairs with their indices and coordinates\n"
+                                      "  --report=<path>     write the run's timings, throughput and machine as JSON for --mode=compare\n"
+                                      "  --repetitions=<count>  run the pairs that many times (default 1, or 5 with --report), so a comparison can test\n"
+                                      "                      its changes against the spread of the repetitions\n\n"
+                                      "       " + exe_filename + " --mode=matrix [options] [points.json] [second_points.json]\n\n"
+                                      "Options:\n"
+                                      "  --output=<path>     matrix file of row-major doubles (default haversine_matrix.f64)\n"
+                                      "  --reduce            write each row's minimum and mean instead of the full matrix\n"
+                                      "  --threads=<count>   worker threads (default: all hardware threads)\n\n"
+                                      "       " + exe_filename + " --mode=radius --radius=<distance> [options] [points.json] [query_points.json]\n"
+                                      "       " + exe_filename + " --mode=nearest --k=<count> [options] [points.json] [query_points.json]\n\n"
+                                      "Options:\n"
+                                      "  --output=<path>     text file of 'query neighbor distance' lines\n"
+                                      "  --threads=<count>   worker threads (default: all hardware threads)\n\n"
+                                      "       " + exe_filename + " --mode=join --radius=<distance> [options] [points.json] [second_points.json]\n\n"
+                                      "Options:\n"
+                                      "  --output=<path>     text file of 'first second distance' lines (a self-join lists each pair once)\n"
+                                      "  --threads=<count>   worker threads (default: all hardware threads)\n\n"
+                                      "       " + exe_filename + " --mode=compare [--threshold=<percent>] [baseline_report.json] [candidate_report.json]\n\n"
+                                      "Flags the total and the anchors that got slower by more than the threshold (default 5%) where the difference\n"
+                                      "is significant, and exits with an error if any did. Changes without repetitions or timed hits to test are\n"
+                                      "listed but not flagged. Reports of different inputs or kernels are refused.\n\n"
+                                      "The matrix, radius, nearest and join modes also take:\n"
+                                      "  --scaling           rerun the mode at 1, 2, 4, ... threads up to --threads and report each stage's speedup\n"
+                                      "  --scaling-report=<path>  the same, and write the scaling table as JSON\n"
+                                      "  --pin-threads       keep each worker thread on one hardware thread\n\n"
+                                      "Every mode also takes (in builds with the profiler compiled in):\n"
+                                      "  --profile           record and report profile blocks; HAVERSINE_PROFILE=1 does the same\n"
+                                      "  --roofline          measure the memory hierarchy first and report each block's GB/s against it\n"
+                                      "  --trace=<path>      write each profiled block as Chrome Trace Event JSON (Perfetto, chrome://tracing); needs PROFILER_TRACE=1\n"
+                                      "  --folded=<path>     write the profiled call tree as folded stacks for flame graph tools; needs PROFILER_CALL_TREE=1";
+
+    haversine_arguments app_args;
+    if (!parse_arguments(argc, argv, app_args, usage_message))
+        return EXIT_FAILURE;
+
+    try
+    {
+        // the exports need the blocks recorded, so they switch profiling on as well
+        if (app_args.profile || app_args.roofline || app_args.trace_path || app_args.folded_path || app_args.report_path || profiler::is_requested_by_environment())
+            profiler::enable();
+
+        // before the mode runs, so the probe's own traffic has left the caches by the time anything is profiled
+        if (app_args.roofline)
+        {
+            std::vector<memory_level> levels = probe_memory_hierarchy();
+            print_memory_hierarchy(levels);
+            profiler::set_memory_levels(std::move(levels));
+        }
+
+#if PROFILER_TRACE
+        if (app_args.trace_path)
+            profiler::enable_tracing();
+#endif
+
+        // one set of workers for every loop the mode runs; --threads above the hardware count still gets its threads
+        std::optional<task_scheduler_scope> scheduler;
+        if (is_parallel_mode(app_args.mode))
+            scheduler.emplace(task_scheduler_options{ .thread_count = std::max(app_args.thread_count, default_thread_count()), .pin_threads = app_args.pin_threads });
+
+        if (app_args.scaling)
+        {
+            run_thread_scaling(app_args);
+        }
+        else
+        {
+            switch (app_args.mode)
+            {
+                case processor_mode::matrix:
+                    run_distance_matrix(app_args);
+                    break;
+
+                case processor_mode::radius:
+                case processor_mode::nearest:
+                    run_spatial_query(app_args);
+                    break;
+
+                case processor_mode::join:
+                    run_spatial_join(app_args);
+                    break;
+
+                case processor_mode::compare:
+                    if (compare_benchmark_reports(app_args.input_path, app_args.second_input_path, app_args.threshold_percent))
+                        return EXIT_FAILURE;
+
+                    break;
+
+                case processor_mode::pairs:
+                default:
+                    run_point_pairs(app_args);
+                    break;
+            }
+        }
+
+#if PROFILER_TRACE
+        if (app_args.trace_path)
+            write_profile_trace(app_args.trace_path);
+#endif
+
+#if PROFILER_CALL_TREE
+        if (app_args.folded_path)
+            write_profile_folded_stacks(app_args.folded_path);
+#endif
     }
     catch (std::exception& ex)
     {
@@ -0,0 +1,173 @@
+#include "mapped_file.hpp"
+
+#include <cstdint>
+#include <stdexcept>
+
+#if _WIN32
+
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+
+mapped_output_file::mapped_output_file(const std::string& path, size_t size)
+    : m_size{ size }
+{
+    if (size == 0)
+        throw std::runtime_error{ "Cannot map an empty output file." };
+
+    m_file_handle = CreateFileA(path.c_str(), GENERIC_READ | GENERIC_WRITE, 0, nullptr, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (m_file_handle == INVALID_HANDLE_VALUE)
+    {
+        m_file_handle = nullptr;
+        throw std::runtime_error{ "Cannot create output file." };
+    }
+
+    const auto size_64 = static_cast<uint64_t>(size);
+    m_mapping_handle = CreateFileMappingA(m_file_handle, nullptr, PAGE_READWRITE, static_cast<DWORD>(size_64 >> 32), static_cast<DWORD>(size_64), nullptr);
+    if (!m_mapping_handle)
+    {
+        CloseHandle(m_file_handle);
+        throw std::runtime_error{ "Cannot create a mapping for the output file." };
+    }
+
+    m_data = static_cast<std::byte*>(MapViewOfFile(m_mapping_handle, FILE_MAP_WRITE, 0, 0, size));
+    if (!m_data)
+    {
+        CloseHandle(m_mapping_handle);
+        CloseHandle(m_file_handle);
+        throw std::runtime_error{ "Cannot map the output file into memory." };
+    }
+}
+
+mapped_output_file::~mapped_output_file()
+{
+    UnmapViewOfFile(m_data);
+    CloseHandle(m_mapping_handle);
+    CloseHandle(m_file_handle);
+}
+
+mapped_input_file::mapped_input_file(const std::string& path, bool populate)
+{
+    m_file_handle = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (m_file_handle == INVALID_HANDLE_VALUE)
+    {
+        m_file_handle = nullptr;
+        throw std::runtime_error{ "Cannot open input file." };
+    }
+
+    LARGE_INTEGER file_size{};
+    if (!GetFileSizeEx(m_file_handle, &file_size) || file_size.QuadPart == 0)
+    {
+        CloseHandle(m_file_handle);
+        throw std::runtime_error{ "Cannot map an empty input file." };
+    }
+
+    m_size = static_cast<size_t>(file_size.QuadPart);
+
+    m_mapping_handle = CreateFileMappingA(m_file_handle, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (!m_mapping_handle)
+    {
+        CloseHandle(m_file_handle);
+        throw std::runtime_error{ "Cannot create a mapping for the input file." };
+    }
+
+    m_data = static_cast<const std::byte*>(MapViewOfFile(m_mapping_handle, FILE_MAP_READ, 0, 0, 0));
+    if (!m_data)
+    {
+        CloseHandle(m_mapping_handle);
+        CloseHandle(m_file_handle);
+        throw std::runtime_error{ "Cannot map the input file into memory." };
+    }
+
+    if (populate)
+    {
+        WIN32_MEMORY_RANGE_ENTRY range{ const_cast<std::byte*>(m_data), m_size };
+        PrefetchVirtualMemory(GetCurrentProcess(), 1, &range, 0);
+    }
+}
+
+mapped_input_file::~mapped_input_file()
+{
+    UnmapViewOfFile(m_data);
+    CloseHandle(m_mapping_handle);
+    CloseHandle(m_file_handle);
+}
+
+#else
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+mapped_output_file::mapped_output_file(const std::string& path, size_t size)
+    : m_size{ size }
+{
+    if (size == 0)
+        throw std::runtime_error{ "Cannot map an empty output file." };
+
+    m_descriptor = open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (m_descriptor < 0)
+        throw std::runtime_error{ "Cannot create output file." };
+
+    if (ftruncate(m_descriptor, static_cast<off_t>(size)) != 0)
+    {
+        close(m_descriptor);
+        throw std::runtime_error{ "Cannot resize the output file." };
+    }
+
+    void* data = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, m_descriptor, 0);
+    if (data == MAP_FAILED)
+    {
+        close(m_descriptor);
+        throw std::runtime_error{ "Cannot map the output file into memory." };
+    }
+
+    m_data = static_cast<std::byte*>(data);
+}
+
+mapped_output_file::~mapped_output_file()
+{
+    munmap(m_data, m_size);
+    close(m_descriptor);
+}
+
+mapped_input_file::mapped_input_file(const std::string& path, bool populate)
+{
+    m_descriptor = open(path.c_str(), O_RDONLY);
+    if (m_descriptor < 0)
+        throw std::runtime_error{ "Cannot open input file." };
+
+    struct stat file_status{};
+    if (fstat(m_descriptor, &file_status) != 0 || file_status.st_size == 0)
+    {
+        close(m_descriptor);
+        throw std::runtime_error{ "Cannot map an empty input file." };
+    }
+
+    m_size = static_cast<size_t>(file_status.st_size);
+
+    int flags = MAP_PRIVATE;
+#ifdef MAP_POPULATE
+    if (populate)
+        flags |= MAP_POPULATE;
+#endif
+
+    void* data = mmap(nullptr, m_size, PROT_READ, flags, m_descriptor, 0);
+    if (data == MAP_FAILED)
+    {
+        close(m_descriptor);
+        throw std::runtime_error{ "Cannot map the input file into memory." };
+    }
+
+    m_data = static_cast<const std::byte*>(data);
+}
+
+mapped_input_file::~mapped_input_file()
+{
+    munmap(const_cast<std::byte*>(m_data), m_size);
+    close(m_descriptor);
+}
+
+#endif
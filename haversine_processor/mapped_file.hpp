@@ -0,0 +1,95 @@
+﻿#ifndef WS_MAPPEDFILE_HPP
+#define WS_MAPPEDFILE_HPP
+
+#include <cstddef>
+#include <span>
+#include <string>
+
+// Creates (or truncates) a file of the given size and maps it into memory for writing. The mapping is flushed and
+// released when the object is destroyed, so large outputs never need an intermediate buffer.
+class mapped_output_file final
+{
+private:
+    std::byte* m_data = nullptr;
+    size_t m_size{};
+
+#if _WIN32
+    void* m_file_handle = nullptr;
+    void* m_mapping_handle = nullptr;
+#else
+    int m_descriptor = -1;
+// Maps an existing file into memory for reading. Pages are read in as they are first touched, unless populate is
+// set, in which case the whole file is read in up front (MAP_POPULATE; PrefetchVirtualMemory on Windows).
+class mapped_input_file final
+{
+private:
+    const std::byte* m_data = nullptr;
+    size_t m_size{};
+
+#if _WIN32
+    void* m_file_handle = nullptr;
+    void* m_mapping_handle = nullptr;
+#else
+    int m_descriptor = -1;
+#endif
+
+public:
+    explicit mapped_input_file(const std::string& path, bool populate = false);
+    ~mapped_input_file();
+
+    mapped_input_file(const mapped_input_file&) = delete;
+    mapped_input_file& operator=(const mapped_input_file&) = delete;
+    mapped_input_file(mapped_input_file&&) noexcept = delete;
+    mapped_input_file& operator=(mapped_input_file&&) noexcept = delete;
+
+    std::span<const std::byte> bytes() const { return { m_data, m_size }; }
+};
+
+#endif
+
+public:
+    mapped_output_file(const std::string& path, size_t size);
+    ~mapped_output_file();
+
+    mapped_output_file(const mapped_output_file&) = delete;
+    mapped_output_file& operator=(const mapped_output_file&) = delete;
+    mapped_output_file(mapped_output_file&&) noexcept = delete;
+    mapped_output_file& operator=(mapped_output_file&&) noexcept = delete;
+
+    std::span<std::byte> bytes() { return { m_data, m_size }; }
+
+    template<typename T>
+    std::span<T> as_span()
+    {
+        return { reinterpret_cast<T*>(m_data), m_size / sizeof(T) };
+    }
+};
+
+// Maps an existing file into memory for reading. Pages are read in as they are first touched, unless populate is
+// set, in which case the whole file is read in up front (MAP_POPULATE; PrefetchVirtualMemory on Windows).
+class mapped_input_file final
+{
+private:
+    const std::byte* m_data = nullptr;
+    size_t m_size{};
+
+#if _WIN32
+    void* m_file_handle = nullptr;
+    void* m_mapping_handle = nullptr;
+#else
+    int m_descriptor = -1;
+#endif
+
+public:
+    explicit mapped_input_file(const std::string& path, bool populate = false);
+    ~mapped_input_file();
+
+    mapped_input_file(const mapped_input_file&) = delete;
+    mapped_input_file& operator=(const mapped_input_file&) = delete;
+    mapped_input_file(mapped_input_file&&) noexcept = delete;
+    mapped_input_file& operator=(mapped_input_file&&) noexcept = delete;
+
+    std::span<const std::byte> bytes() const { return { m_data, m_size }; }
+};
+
+#endif
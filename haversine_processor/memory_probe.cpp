@@ -0,0 +1,212 @@
+#include "memory_probe.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <stdexcept>
+#include <format>
+#include <iostream>
+#include <limits>
+#include <random>
+#include <span>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "platform_metrics.hpp"
+
+#if _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <unistd.h>
+#endif
+
+namespace
+{
+    constexpr size_t cache_line_size = 64;
+
+    // used when the OS doesn't say
+    constexpr std::array<size_t, 3> fallback_cache_sizes{ 32 * 1024, 1024 * 1024, 32 * 1024 * 1024 };
+
+    constexpr size_t min_main_memory_working_set = 128 * 1024 * 1024;
+
+    // each bandwidth trial reads at least this much, so the timer reads are noise even for an L1-sized buffer
+    constexpr size_t min_trial_bytes = 64 * 1024 * 1024;
+    constexpr int bandwidth_trial_count = 8;
+
+    constexpr size_t latency_step_count = size_t{ 1 } << 20;
+
+    // keeps the sums and chases from being optimized away
+    volatile uint64_t probe_sink{};
+
+    // the latency chase keeps the index of the next line in the first word
+    struct alignas(cache_line_size) cache_line
+    {
+        std::array<uint64_t, cache_line_size / sizeof(uint64_t)> words{};
+    };
+
+    // L1 data, L2 and L3 sizes in bytes; 0 where the OS doesn't know
+    std::array<size_t, 3> read_cache_sizes()
+    {
+        std::array<size_t, 3> sizes{};
+
+#if _WIN32
+        DWORD buffer_size = 0;
+        GetLogicalProcessorInformation(nullptr, &buffer_size);
+
+        std::vector<SYSTEM_LOGICAL_PROCESSOR_INFORMATION> entries(buffer_size / sizeof(SYSTEM_LOGICAL_PROCESSOR_INFORMATION));
+        if (entries.empty() || !GetLogicalProcessorInformation(entries.data(), &buffer_size))
+            return sizes;
+
+        for (const SYSTEM_LOGICAL_PROCESSOR_INFORMATION& entry : entries)
+        {
+            if (entry.Relationship != RelationCache || entry.Cache.Type == CacheInstruction)
+                continue;
+
+            if (entry.Cache.Level >= 1 && entry.Cache.Level <= 3)
+                sizes[entry.Cache.Level - 1] = std::max<size_t>(sizes[entry.Cache.Level - 1], entry.Cache.Size);
+        }
+#elif defined(_SC_LEVEL1_DCACHE_SIZE)
+        const std::array<int, 3> names{ _SC_LEVEL1_DCACHE_SIZE, _SC_LEVEL2_CACHE_SIZE, _SC_LEVEL3_CACHE_SIZE };
+
+        for (size_t level = 0; level < names.size(); ++level)
+        {
+            const long size = sysconf(names[level]);
+            sizes[level] = size > 0 ? static_cast<size_t>(size) : 0;
+        }
+#endif
+
+        return sizes;
+    }
+
+    uint64_t sum_lines(std::span<const cache_line> lines)
+    {
+        // independent sums, so the loop runs at the loads' pace rather than the adds'
+        uint64_t sum_0 = 0;
+        uint64_t sum_1 = 0;
+        uint64_t sum_2 = 0;
+        uint64_t sum_3 = 0;
+
+        for (const cache_line& line : lines)
+        {
+            sum_0 += line.words[0] + line.words[4];
+            sum_1 += line.words[1] + line.words[5];
+            sum_2 += line.words[2] + line.words[6];
+            sum_3 += line.words[3] + line.words[7];
+        }
+
+        return sum_0 + sum_1 + sum_2 + sum_3;
+    }
+
+    double measure_read_bandwidth(std::span<const cache_line> lines, double cpu_freq)
+    {
+        const size_t working_set = lines.size_bytes();
+        const size_t sweep_count = std::max<size_t>(1, min_trial_bytes / working_set);
+
+        uint64_t best_cycles = std::numeric_limits<uint64_t>::max();
+        uint64_t sum = 0;
+
+        for (int trial = 0; trial < bandwidth_trial_count; ++trial)
+        {
+            const uint64_t start_time = read_cpu_timer();
+
+            for (size_t sweep = 0; sweep < sweep_count; ++sweep)
+                sum += sum_lines(lines);
+
+            best_cycles = std::min(best_cycles, read_cpu_timer() - start_time);
+        }
+
+        probe_sink = sum;
+
+        const double seconds = best_cycles / cpu_freq;
+        return seconds > 0.0 ? static_cast<double>(sweep_count * working_set) / seconds : 0.0;
+    }
+
+    double measure_load_latency(std::span<cache_line> lines, double cpu_freq)
+    {
+        // Sattolo's shuffle of the identity: a random permutation that is a single cycle through every line
+        for (size_t i = 0; i < lines.size(); ++i)
+            lines[i].words[0] = i;
+
+        std::mt19937_64 engine{ 0x5eed };
+        for (size_t i = lines.size() - 1; i > 0; --i)
+        {
+            std::uniform_int_distribution<size_t> distribution{ 0, i - 1 };
+            std::swap(lines[i].words[0], lines[distribution(engine)].words[0]);
+        }
+
+        // one lap first, so the timed chase starts with the buffer as warm as it will get
+        uint64_t current = 0;
+        for (size_t i = 0; i < lines.size(); ++i)
+            current = lines[current].words[0];
+
+        const uint64_t start_time = read_cpu_timer();
+
+        for (size_t i = 0; i < latency_step_count; ++i)
+            current = lines[current].words[0];
+
+        const uint64_t elapsed_cycles = read_cpu_timer() - start_time;
+
+        probe_sink = current;
+
+        return 1.0e9 * elapsed_cycles / cpu_freq / latency_step_count;
+    }
+
+    // at least two lines, so the chase has somewhere to go
+    size_t round_to_cache_lines(size_t size)
+    {
+        return std::max(2 * cache_line_size, size / cache_line_size * cache_line_size);
+    }
+}
+
+std::vector<memory_level> probe_memory_hierarchy()
+{
+    const uint64_t cpu_freq = estimate_cpu_timer_freq();
+    if (!cpu_freq)
+        throw std::runtime_error{ "Failed to estimate CPU frequency." };
+
+    std::array<size_t, 3> cache_sizes = read_cache_sizes();
+    for (size_t level = 0; level < cache_sizes.size(); ++level)
+    {
+        if (!cache_sizes[level])
+            cache_sizes[level] = fallback_cache_sizes[level];
+    }
+
+    std::vector<memory_level> levels
+    {
+        { .name = "L1", .capacity = cache_sizes[0], .working_set = round_to_cache_lines(cache_sizes[0] / 2) },
+        { .name = "L2", .capacity = cache_sizes[1], .working_set = round_to_cache_lines(cache_sizes[1] / 2) },
+        { .name = "L3", .capacity = cache_sizes[2], .working_set = round_to_cache_lines(cache_sizes[2] / 2) },
+        { .name = "DRAM", .capacity = 0, .working_set = std::max(min_main_memory_working_set, 2 * cache_sizes[2]) },
+    };
+
+    for (memory_level& level : levels)
+    {
+        std::vector<cache_line> lines(level.working_set / cache_line_size);
+
+        level.read_bytes_per_second = measure_read_bandwidth(lines, static_cast<double>(cpu_freq));
+        level.load_latency_ns = measure_load_latency(lines, static_cast<double>(cpu_freq));
+    }
+
+    return levels;
+}
+
+void print_memory_hierarchy(std::span<const memory_level> levels)
+{
+    constexpr double gigabyte = 1024.0 * 1024.0 * 1024.0;
+
+    std::cout << "Memory hierarchy:\n";
+
+    for (const memory_level& level : levels)
+    {
+        const std::string capacity = level.capacity ? std::format("{} KiB", level.capacity / 1024) : std::string{ "-" };
+
+        std::cout << std::format("  {:<5} {:>12}  working set {:>9} KiB  {:>9.3f} GB/s  {:>8.2f} ns/load\n",
+                                 level.name, capacity, level.working_set / 1024, level.read_bytes_per_second / gigabyte, level.load_latency_ns);
+    }
+
+    std::cout << '\n';
+}
@@ -0,0 +1,32 @@
+﻿#ifndef WS_MEMORYPROBE_HPP
+#define WS_MEMORYPROBE_HPP
+
+#include <cstddef>
+#include <span>
+#include <vector>
+
+// what one level of the memory hierarchy sustains on this host
+struct memory_level
+{
+    const char* name = nullptr;
+
+    // the cache's size, or 0 for main memory
+    size_t capacity{};
+
+    // the buffer the level was measured with: half the cache, so the level above it never has to help out
+    size_t working_set{};
+
+    double read_bytes_per_second{};
+    double load_latency_ns{};
+};
+
+// Measures read bandwidth and load-to-use latency with working sets sized to the L1, L2 and L3 data caches (as the
+// OS reports them, with common sizes as a fallback) and to main memory. Bandwidth is the best of several sweeps
+// summing the buffer's 64-bit words; latency is a pointer chase through the buffer's cache lines in a random cycle,
+// so the prefetchers cannot guess the next line. The main memory buffer is twice the L3, so on hosts with a large
+// shared L3 most of the time goes to faulting it in.
+std::vector<memory_level> probe_memory_hierarchy();
+
+void print_memory_hierarchy(std::span<const memory_level> levels);
+
+#endif
@@ -0,0 +1,47 @@
+﻿#ifndef WS_PARALLEL_HPP
+#define WS_PARALLEL_HPP
+
+#include <cstddef>
+#include <memory>
+#include <type_traits>
+
+#include "task_scheduler.hpp"
+
+// Calls func(begin, end) over ranges that together cover [0, count), on up to thread_count threads including the
+// calling one, and returns once all have run. A thread_count of 0 uses every hardware thread. The ranges and how
+// many there are depend on how the work gets stolen, so func must not rely on either. Runs on the active
+// task_scheduler_scope, or on threads started for the call outside one.
+template<typename Func>
+void parallel_for(size_t count, unsigned thread_count, Func&& func)
+{
+    if (count == 0)
+        return;
+
+    if (thread_count == 0)
+        thread_count = default_thread_count();
+
+    if (thread_count == 1 || count == 1)
+    {
+        func(size_t{ 0 }, count);
+        return;
+    }
+
+    using body_type = std::remove_reference_t<Func>;
+
+    const parallel_body body
+    {
+        .context = const_cast<void*>(static_cast<const void*>(std::addressof(func))),
+        .invoke = [](void* context, size_t begin, size_t end) { (*static_cast<body_type*>(context))(begin, end); }
+    };
+
+    if (task_scheduler* scheduler = task_scheduler::get_active())
+    {
+        scheduler->run(count, thread_count, body);
+        return;
+    }
+
+    task_scheduler scheduler{ { .thread_count = thread_count } };
+    scheduler.run(count, thread_count, body);
+}
+
+#endif
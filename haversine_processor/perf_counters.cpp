@@ -0,0 +1,146 @@
+#include "perf_counters.hpp"
+
+#if __linux__
+
+#include <cstring>
+
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace
+{
+    struct counter_config
+    {
+        uint32_t type{};
+        uint64_t config{};
+    };
+
+    constexpr uint64_t cache_event(uint64_t cache, uint64_t operation, uint64_t result)
+    {
+        return cache | (operation << 8) | (result << 16);
+    }
+
+    // in perf_counter order
+    constexpr std::array<counter_config, perf_counter_count> counter_configs
+    {{
+        { PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS },
+        { PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES },
+        { PERF_TYPE_HW_CACHE, cache_event(PERF_COUNT_HW_CACHE_L1D, PERF_COUNT_HW_CACHE_OP_READ, PERF_COUNT_HW_CACHE_RESULT_MISS) },
+        { PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES },
+        { PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES },
+        { PERF_TYPE_SOFTWARE, PERF_COUNT_SW_PAGE_FAULTS }
+    }};
+
+    int open_counter(const counter_config& counter, int group_fd)
+    {
+        perf_event_attr attr;
+        std::memset(&attr, 0, sizeof(attr));
+
+        attr.size = sizeof(attr);
+        attr.type = counter.type;
+        attr.config = counter.config;
+        attr.read_format = PERF_FORMAT_GROUP;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+
+        // pid 0 and cpu -1: the calling thread, on whichever CPU it runs
+        return static_cast<int>(syscall(SYS_perf_event_open, &attr, 0, -1, group_fd, 0));
+    }
+}
+
+bool perf_counter_group::open()
+{
+    close();
+
+    for (size_t i = 0; i < perf_counter_count; ++i)
+    {
+        const int fd = open_counter(counter_configs[i], m_leader_fd);
+        if (fd < 0)
+            continue;
+
+        if (m_leader_fd < 0)
+            m_leader_fd = fd;
+
+        m_fds[i] = fd;
+        m_read_slots[i] = static_cast<int8_t>(m_open_count++);
+    }
+
+    return is_open();
+}
+
+void perf_counter_group::close()
+{
+    for (size_t i = 0; i < perf_counter_count; ++i)
+    {
+        if (m_fds[i] >= 0)
+            ::close(m_fds[i]);
+
+        m_fds[i] = -1;
+        m_read_slots[i] = -1;
+    }
+
+    m_leader_fd = -1;
+    m_open_count = 0;
+}
+
+perf_counter_values perf_counter_group::read() const
+{
+    perf_counter_values values{};
+
+    if (m_leader_fd < 0)
+        return values;
+
+    // PERF_FORMAT_GROUP layout: the number of counters, then one value per counter in the order they were opened
+    std::array<uint64_t, perf_counter_count + 1> buffer{};
+    if (::read(m_leader_fd, buffer.data(), sizeof(buffer)) < static_cast<ssize_t>((m_open_count + 1) * sizeof(uint64_t)))
+        return values;
+
+    for (size_t i = 0; i < perf_counter_count; ++i)
+    {
+        if (m_read_slots[i] >= 0)
+            values[i] = buffer[1 + m_read_slots[i]];
+    }
+
+    return values;
+}
+
+#else
+
+bool perf_counter_group::open()
+{
+    return false;
+}
+
+void perf_counter_group::close()
+{
+}
+
+perf_counter_values perf_counter_group::read() const
+{
+    return {};
+}
+
+#endif
+
+const char* to_string(perf_counter counter)
+{
+    switch (counter)
+    {
+        case perf_counter::instructions:
+            return "instructions";
+        case perf_counter::cycles:
+            return "cycles";
+        case perf_counter::l1d_read_misses:
+            return "L1D read misses";
+        case perf_counter::llc_misses:
+            return "LLC misses";
+        case perf_counter::branch_misses:
+            return "branch misses";
+        case perf_counter::page_faults:
+            return "page faults";
+        default:
+            return "unknown";
+    }
+}
@@ -0,0 +1,56 @@
+﻿#ifndef WS_PERFCOUNTERS_HPP
+#define WS_PERFCOUNTERS_HPP
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+enum class perf_counter : uint8_t
+{
+    instructions,
+    cycles,
+    l1d_read_misses,
+    llc_misses,
+    branch_misses,
+    page_faults
+};
+
+inline constexpr size_t perf_counter_count = 6;
+
+using perf_counter_values = std::array<uint64_t, perf_counter_count>;
+
+const char* to_string(perf_counter counter);
+
+// Hardware and OS event counters for the calling thread, read together as one group. On Linux these are
+// perf_event_open counters limited to user mode. Counters the CPU, VM or perf_event_paranoid setting doesn't
+// allow are left out, and on other platforms nothing is available; missing counters always read as 0.
+class perf_counter_group final
+{
+private:
+    int m_leader_fd = -1;
+    std::array<int, perf_counter_count> m_fds{ -1, -1, -1, -1, -1, -1 };
+
+    // position of each counter's value in a group read, or -1 when the counter isn't open
+    std::array<int8_t, perf_counter_count> m_read_slots{ -1, -1, -1, -1, -1, -1 };
+    uint32_t m_open_count{};
+
+public:
+    perf_counter_group() = default;
+    ~perf_counter_group() { close(); }
+
+    // opens the counters for the calling thread; false when none of them could be opened
+    bool open();
+    void close();
+
+    bool is_open() const { return m_open_count != 0; }
+    bool is_available(perf_counter counter) const { return m_read_slots[static_cast<size_t>(counter)] >= 0; }
+
+    perf_counter_values read() const;
+
+    perf_counter_group(const perf_counter_group&) = delete;
+    perf_counter_group& operator=(const perf_counter_group&) = delete;
+    perf_counter_group(perf_counter_group&&) noexcept = delete;
+    perf_counter_group& operator=(perf_counter_group&&) noexcept = delete;
+};
+
+#endif
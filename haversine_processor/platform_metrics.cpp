@@ -0,0 +1,228 @@
+#include "platform_metrics.hpp"
+
+#include <filesystem>
+#include <fstream>
+#include <future>
+#include <string>
+#include <system_error>
+
+#if !_WIN32
+#include <cpuid.h>
+#endif
+
+namespace
+{
+	constexpr uint64_t calibration_milliseconds = 20;
+
+	// A cached frequency further than this from the CPUID base frequency is stale or not ours, and is measured
+	// again. Without a base frequency, only values outside the plausible range are rejected.
+	constexpr double max_cached_freq_deviation = 0.1;
+	constexpr uint64_t min_plausible_timer_freq = 100'000'000;
+	constexpr uint64_t max_plausible_timer_freq = 10'000'000'000;
+
+	struct cpuid_result
+	{
+		uint32_t eax{};
+		uint32_t ebx{};
+		uint32_t ecx{};
+		uint32_t edx{};
+	};
+
+	cpuid_result read_cpuid(uint32_t leaf)
+	{
+		cpuid_result result;
+
+#if _WIN32
+		int info[4];
+		__cpuidex(info, static_cast<int>(leaf), 0);
+		result = { static_cast<uint32_t>(info[0]), static_cast<uint32_t>(info[1]), static_cast<uint32_t>(info[2]), static_cast<uint32_t>(info[3]) };
+#else
+		__cpuid_count(leaf, 0, result.eax, result.ebx, result.ecx, result.edx);
+#endif
+
+		return result;
+	}
+
+	// the nominal base frequency from leaf 0x16, or 0 where it isn't reported
+	uint64_t read_cpuid_base_freq()
+	{
+		if (read_cpuid(0).eax < 0x16)
+			return 0;
+
+		const uint64_t base_mhz = read_cpuid(0x16).eax & 0xffff;
+		return base_mhz * 1000000;
+	}
+
+	// Leaf 0x15 gives the TSC as a ratio of the core crystal clock; when the crystal frequency is left out, the
+	// nominal base frequency from leaf 0x16 is the TSC rate. Hypervisors and AMD CPUs usually report neither.
+	uint64_t read_cpuid_timer_freq()
+	{
+		if (read_cpuid(0).eax < 0x15)
+			return 0;
+
+		const cpuid_result tsc_ratio = read_cpuid(0x15);
+		const uint32_t denominator = tsc_ratio.eax;
+		const uint32_t numerator = tsc_ratio.ebx;
+		const uint32_t crystal_freq = tsc_ratio.ecx;
+
+		if (!denominator || !numerator)
+			return 0;
+
+		if (crystal_freq)
+			return static_cast<uint64_t>(crystal_freq) * numerator / denominator;
+
+		return read_cpuid_base_freq();
+	}
+
+	bool is_plausible_timer_freq(uint64_t cpu_freq)
+	{
+		if (cpu_freq < min_plausible_timer_freq || cpu_freq > max_plausible_timer_freq)
+			return false;
+
+		const uint64_t base_freq = read_cpuid_base_freq();
+		if (!base_freq)
+			return true;
+
+		const double deviation = (static_cast<double>(cpu_freq) - static_cast<double>(base_freq)) / static_cast<double>(base_freq);
+		return deviation <= max_cached_freq_deviation && deviation >= -max_cached_freq_deviation;
+	}
+
+	std::filesystem::path get_cache_path()
+	{
+		std::error_code error;
+		const std::filesystem::path directory = std::filesystem::temp_directory_path(error);
+
+		return error ? std::filesystem::path{} : directory / "haversine_timer_freq.txt";
+	}
+
+	uint64_t read_cached_timer_freq(const std::filesystem::path& path, const std::string& cpu_brand)
+	{
+		std::ifstream input_file{ path };
+
+		std::string cached_brand;
+		uint64_t cpu_freq = 0;
+
+		if (!std::getline(input_file, cached_brand) || !(input_file >> cpu_freq) || cached_brand != cpu_brand)
+			return 0;
+
+		// the file sits in a shared directory, so anyone could have left it there
+		return is_plausible_timer_freq(cpu_freq) ? cpu_freq : 0;
+	}
+
+	// Best effort: a host where the file can't be written just calibrates on every run. The file is written under
+	// a name of its own and renamed into place, so a concurrent run never reads it half-written.
+	void write_cached_timer_freq(const std::filesystem::path& path, const std::string& cpu_brand, uint64_t cpu_freq)
+	{
+		std::filesystem::path temp_path = path;
+		temp_path += "." + std::to_string(read_cpu_timer()) + ".tmp";
+
+		bool written = false;
+		{
+			std::ofstream output_file{ temp_path };
+			output_file << cpu_brand << '\n' << cpu_freq << '\n';
+			written = static_cast<bool>(output_file.flush());
+		}
+
+		std::error_code error;
+		if (written)
+			std::filesystem::rename(temp_path, path, error);
+
+		if (!written || error)
+			std::filesystem::remove(temp_path, error);
+	}
+
+	timer_calibration calibrate_cpu_timer()
+	{
+		if (const uint64_t cpu_freq = read_cpuid_timer_freq())
+			return { cpu_freq, timer_freq_source::cpuid };
+
+		const std::filesystem::path cache_path = get_cache_path();
+		const std::string cpu_brand = read_cpu_brand();
+
+		if (!cache_path.empty())
+		{
+			if (const uint64_t cpu_freq = read_cached_timer_freq(cache_path, cpu_brand))
+				return { cpu_freq, timer_freq_source::cached };
+		}
+
+		const uint64_t cpu_freq = measure_cpu_timer_freq(calibration_milliseconds);
+		if (!cpu_freq)
+			return {};
+
+		if (!cache_path.empty())
+			write_cached_timer_freq(cache_path, cpu_brand, cpu_freq);
+
+		return { cpu_freq, timer_freq_source::calibrated };
+	}
+
+	const std::shared_future<timer_calibration>& get_calibration_future()
+	{
+		static const std::shared_future<timer_calibration> calibration = std::async(std::launch::async, calibrate_cpu_timer).share();
+		return calibration;
+	}
+}
+
+std::string read_cpu_brand()
+{
+	if (read_cpuid(0x80000000).eax < 0x80000004)
+		return "unknown";
+
+	char brand[49]{};
+	for (uint32_t i = 0; i < 3; ++i)
+	{
+		const cpuid_result part = read_cpuid(0x80000002 + i);
+		const uint32_t registers[4]{ part.eax, part.ebx, part.ecx, part.edx };
+
+		for (uint32_t j = 0; j < 16; ++j)
+			brand[16 * i + j] = static_cast<char>(registers[j / 4] >> (8 * (j % 4)));
+	}
+
+	return brand;
+}
+
+const char* to_string(timer_freq_source source)
+{
+	switch (source)
+	{
+		case timer_freq_source::cpuid:
+			return "CPUID";
+		case timer_freq_source::cached:
+			return "cached";
+		case timer_freq_source::calibrated:
+			return "calibrated";
+		case timer_freq_source::none:
+		default:
+			return "none";
+	}
+}
+
+void begin_timer_calibration()
+{
+	get_calibration_future();
+}
+
+timer_calibration get_timer_calibration()
+{
+	return get_calibration_future().get();
+}
+
+uint64_t measure_cpu_timer_freq(uint64_t milliseconds_to_wait)
+{
+	const uint64_t os_freq = get_os_timer_freq();
+	const uint64_t os_wait_time = os_freq * milliseconds_to_wait / 1000;
+
+	const uint64_t cpu_start = read_cpu_timer();
+	const uint64_t os_start = read_os_timer();
+
+	uint64_t os_elapsed = 0;
+	while (os_elapsed < os_wait_time)
+		os_elapsed = read_os_timer() - os_start;
+
+	const uint64_t cpu_elapsed = read_cpu_timer() - cpu_start;
+
+	if (!os_elapsed)
+		return 0;
+
+	// scale before dividing; cpu_elapsed / os_elapsed alone truncates to whole ticks per OS tick
+	return static_cast<uint64_t>(static_cast<double>(cpu_elapsed) * os_freq / os_elapsed);
+}
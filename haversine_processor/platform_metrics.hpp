@@ -2,7 +2,10 @@
 #define WS_PLATFORMMETRICS_HPP
 
 #include <cstdint>
+#include <string>
 
+// the timer profile blocks read: read_cpu_timer (plain rdtsc, cheapest, but free to drift past neighbouring
+// instructions) or read_cpu_timer_serialized (rdtscp + lfence, so a short block measures only its own work)
 #ifndef READ_BLOCK_TIMER
 #define READ_BLOCK_TIMER read_cpu_timer
 #endif
@@ -10,6 +13,10 @@
 #if _WIN32
 
 #include <intrin.h>
+// keeps windows.h from defining min and max macros over std::min and std::max
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
 #include <windows.h>
 
 inline uint64_t get_os_timer_freq()
@@ -29,19 +36,20 @@ inline uint64_t read_os_timer()
 #else
 
 #include <x86intrin.h>
-#include <sys/time.h>
+#include <time.h>
 
 inline uint64_t get_os_timer_freq()
 {
-	return 1000000;
+	return 1000000000;
 }
 
+// nanoseconds, not slewed by NTP
 inline uint64_t read_os_timer()
 {
-	timeval value;
-	gettimeofday(&value, 0);
+	timespec value;
+	clock_gettime(CLOCK_MONOTONIC_RAW, &value);
 
-	const uint64_t result = get_os_timer_freq() * static_cast<uint64_t>(value.tv_sec) + static_cast<uint64_t>(value.tv_usec);
+	const uint64_t result = get_os_timer_freq() * static_cast<uint64_t>(value.tv_sec) + static_cast<uint64_t>(value.tv_nsec);
 	return result;
 }
 
@@ -52,32 +60,47 @@ inline uint64_t read_cpu_timer()
 	return __rdtsc();
 }
 
+// rdtscp waits for every earlier instruction to finish, and the lfence keeps later ones from starting before the read
+inline uint64_t read_cpu_timer_serialized()
+{
+	unsigned int processor_id;
+	const uint64_t result = __rdtscp(&processor_id);
+	_mm_lfence();
+	return result;
+}
+
+// the CPU's brand string from CPUID, or "unknown"; it also keys the cached timer frequency, so a cache on a shared
+// or copied disk is ignored on other hardware
+std::string read_cpu_brand();
+
+enum class timer_freq_source
+{
+	none,
+	cpuid,
+	cached,
+	calibrated
+};
+
+const char* to_string(timer_freq_source source);
+
+struct timer_calibration
+{
+	uint64_t cpu_freq{};
+	timer_freq_source source = timer_freq_source::none;
+};
+
+// The CPU timer frequency, from the first source that has it: CPUID leaf 0x15/0x16, a value this host cached on
+// an earlier run, or a short measurement against the OS timer (which is then cached). The result is computed once
+// per process; begin_timer_calibration starts that on a background thread so it overlaps the program's startup.
+void begin_timer_calibration();
+timer_calibration get_timer_calibration();
+
+// spins for the given time and compares the CPU timer against the OS timer
+uint64_t measure_cpu_timer_freq(uint64_t milliseconds_to_wait);
+
 inline uint64_t estimate_cpu_timer_freq()
 {
-	constexpr uint64_t milliseconds_to_wait = 100;
-	const uint64_t os_freq = get_os_timer_freq();
-
-	const uint64_t cpu_start = READ_BLOCK_TIMER();
-	const uint64_t os_start = read_os_timer();
-	uint64_t os_elapsed = 0;
-	const uint64_t os_wait_time = os_freq * milliseconds_to_wait / 1000;
-
-	while (os_elapsed < os_wait_time)
-	{
-		const uint64_t os_end = read_os_timer();
-		os_elapsed = os_end - os_start;
-	}
-
-	const uint64_t cpu_end = READ_BLOCK_TIMER();
-	const uint64_t cpu_elapsed = cpu_end - cpu_start;
-
-	uint64_t cpu_freq = 0;
-	if (os_elapsed)
-	{
-		cpu_freq = os_freq * (cpu_elapsed / os_elapsed);
-	}
-
-	return cpu_freq;
+	return get_timer_calibration().cpu_freq;
 }
 
 #endif
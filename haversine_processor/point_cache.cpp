@@ -0,0 +1,108 @@
+#include "point_cache.hpp"
+
+#include <bit>
+#include <stdexcept>
+#include <format>
+#include <iostream>
+#include <limits>
+#include <locale>
+#include <unordered_map>
+
+namespace
+{
+    struct point_key
+    {
+        uint64_t x_bits{};
+        uint64_t y_bits{};
+
+        bool operator==(const point_key&) const = default;
+    };
+
+    struct point_key_hash
+    {
+        size_t operator()(const point_key& key) const
+        {
+            // 64-bit mix (from splitmix64) so nearby coordinates don't collide in the low bits
+            uint64_t h = key.x_bits ^ (key.y_bits * 0x9e3779b97f4a7c15ULL);
+            h ^= h >> 30;
+            h *= 0xbf58476d1ce4e5b9ULL;
+            h ^= h >> 27;
+            h *= 0x94d049bb133111ebULL;
+            h ^= h >> 31;
+
+            return static_cast<size_t>(h);
+        }
+    };
+
+    point_key make_key(globe_point point)
+    {
+        return { .x_bits = std::bit_cast<uint64_t>(point.x), .y_bits = std::bit_cast<uint64_t>(point.y) };
+    }
+}
+
+point_cache::point_cache(std::span<const globe_point_pair> point_pairs)
+{
+    PROFILE_DATA_FUNCTION(point_pairs.size() * sizeof(globe_point_pair));
+
+    const uint64_t start_time = read_cpu_timer();
+
+    if (point_pairs.size() > std::numeric_limits<uint32_t>::max() / 2)
+        throw std::runtime_error{ "Too many point pairs for the point cache." };
+
+    std::unordered_map<point_key, uint32_t, point_key_hash> point_indices;
+    point_indices.reserve(2 * point_pairs.size());
+    m_pair_indices.reserve(2 * point_pairs.size());
+
+    auto add_point = [&](globe_point point)
+    {
+        const auto [iter, inserted] = point_indices.try_emplace(make_key(point), static_cast<uint32_t>(m_unique_points.size()));
+        if (inserted)
+            m_unique_points.push_back(point);
+
+        m_pair_indices.push_back(iter->second);
+    };
+
+    for (const auto& [p1, p2] : point_pairs)
+    {
+        add_point(p1);
+        add_point(p2);
+    }
+
+    m_build_cycles = read_cpu_timer() - start_time;
+}
+
+double estimate_point_cache_speedup(const point_cache& cache, const cached_distance_result& result)
+{
+    const uint64_t cached_cycles = cache.build_cycles() + result.prepare_cycles + result.pair_loop_cycles;
+    return cached_cycles ? static_cast<double>(result.uncached_cycles_estimate) / cached_cycles : 0.0;
+}
+
+void print_point_cache_results(const point_cache& cache, const cached_distance_result& result)
+{
+    const uint64_t cpu_freq = estimate_cpu_timer_freq();
+    if (!cpu_freq || !cache.unique_count())
+        return;
+
+    const double uncached_cycles = static_cast<double>(result.uncached_cycles_estimate);
+    const double speedup = estimate_point_cache_speedup(cache, result);
+
+    auto to_ms = [cpu_freq](double cycles) { return 1000.0 * cycles / cpu_freq; };
+
+    std::cout << "Point cache:\n";
+    std::cout << std::format(std::locale("en_US"), "  Unique points: {:Ld} of {:Ld} ({:.2f}% hit rate)\n",
+                             cache.unique_count(), cache.lookup_count(), 100.0 * cache.hit_rate());
+    std::cout << std::format("  Build: {:.4f} ms, Prepare: {:.4f} ms, Pair loop: {:.4f} ms\n",
+                             to_ms(static_cast<double>(cache.build_cycles())), to_ms(static_cast<double>(result.prepare_cycles)),
+                             to_ms(static_cast<double>(result.pair_loop_cycles)));
+    std::cout << std::format("  Estimated speedup: {:.2f}x (uncached estimate: {:.4f} ms)\n\n", speedup, to_ms(uncached_cycles));
+}
+
+void annotate_point_cache_profile(const point_cache& cache, const cached_distance_result& result)
+{
+    if (!cache.unique_count())
+        return;
+
+    profiler::annotate_anchor("calculate_cached_distance",
+                              std::format(std::locale("en_US"), "point cache: {:Ld} unique of {:Ld} points ({:.2f}% hit rate), estimated {:.2f}x faster than uncached",
+                                          cache.unique_count(), cache.lookup_count(), 100.0 * cache.hit_rate(), estimate_point_cache_speedup(cache, result)));
+}
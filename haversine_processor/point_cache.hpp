@@ -0,0 +1,148 @@
+﻿#ifndef WS_POINTCACHE_HPP
+#define WS_POINTCACHE_HPP
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+#include "allocation_tracker.hpp"
+#include "distance_kernels.hpp"
+#include "distance_statistics.hpp"
+#include "extreme_pairs.hpp"
+#include "haversine_formula.hpp"
+#include "platform_metrics.hpp"
+#include "profiler.hpp"
+
+// Deduplicates pair endpoints by their exact bit pattern, so repeated coordinates (depots, hubs) only go through
+// a kernel's per-point preparation once. Each pair is stored as two indices into the unique point list.
+class point_cache
+{
+private:
+    std::vector<globe_point> m_unique_points;
+    std::vector<uint32_t> m_pair_indices;
+    uint64_t m_build_cycles{};
+
+public:
+    explicit point_cache(std::span<const globe_point_pair> point_pairs);
+
+    std::span<const globe_point> unique_points() const { return m_unique_points; }
+    std::span<const uint32_t> pair_indices() const { return m_pair_indices; }
+
+    uint64_t build_cycles() const { return m_build_cycles; }
+
+    size_t pair_count() const { return m_pair_indices.size() / 2; }
+    size_t lookup_count() const { return m_pair_indices.size(); }
+    size_t unique_count() const { return m_unique_points.size(); }
+    size_t hit_count() const { return lookup_count() - unique_count(); }
+
+    double hit_rate() const
+    {
+        return lookup_count() ? static_cast<double>(hit_count()) / lookup_count() : 0.0;
+    }
+};
+
+struct cached_distance_result
+{
+    double mean_distance{};
+    int pair_count{};
+    uint64_t prepare_cycles{};
+    uint64_t pair_loop_cycles{};
+
+    // from estimate_uncached_cycles, which runs apart so the estimate isn't timed as part of the cached pass
+    uint64_t uncached_cycles_estimate{};
+};
+
+// upper bound on the pairs re-run without the cache to estimate what the cache saved
+inline constexpr size_t max_uncached_sample_pairs = 1 << 16;
+
+template<distance_kernel Kernel>
+cached_distance_result calculate_cached_distance(const point_cache& cache, distance_statistics* statistics = nullptr,
+                                                 extreme_pairs* extremes = nullptr, double earth_radius = default_earth_radius)
+{
+    PROFILE_DATA_BLOCK("calculate_cached_distance", cache.lookup_count() * sizeof(uint32_t));
+
+    cached_distance_result result;
+
+    const std::span<const globe_point> unique_points = cache.unique_points();
+    std::vector<typename Kernel::point_data> prepared_points;
+    prepared_points.reserve(unique_points.size());
+
+    const uint64_t prepare_start = read_cpu_timer();
+
+    {
+        PROFILE_DATA_BLOCK("prepare_cached_points", unique_points.size() * sizeof(globe_point));
+
+        for (const globe_point& point : unique_points)
+            prepared_points.push_back(Kernel::prepare(point));
+    }
+
+    const uint64_t pair_loop_start = read_cpu_timer();
+
+    const std::span<const uint32_t> indices = cache.pair_indices();
+    const double sum_coeff = 1.0 / cache.pair_count();
+
+    ASSERT_NO_ALLOCATIONS_IF("cached pair loop", !statistics);
+
+    for (size_t i = 0; i < indices.size(); i += 2)
+    {
+        const double distance = Kernel::distance(prepared_points[indices[i]], prepared_points[indices[i + 1]], earth_radius);
+        result.mean_distance += sum_coeff * distance;
+
+        if (statistics)
+            statistics->add(distance, i / 2);
+
+        if (extremes)
+            extremes->add(distance, i / 2);
+
+        ++result.pair_count;
+    }
+
+    const uint64_t pair_loop_end = read_cpu_timer();
+
+    result.prepare_cycles = pair_loop_start - prepare_start;
+    result.pair_loop_cycles = pair_loop_end - pair_loop_start;
+
+    return result;
+}
+
+// Times a bounded sample of the pairs the uncached way, both endpoints prepared for every pair, and extrapolates it
+// to every pair: the cycles calculate_cached_distance would have taken without the cache.
+template<distance_kernel Kernel>
+uint64_t estimate_uncached_cycles(const point_cache& cache, double earth_radius = default_earth_radius)
+{
+    const std::span<const globe_point> unique_points = cache.unique_points();
+    const std::span<const uint32_t> indices = cache.pair_indices();
+
+    const size_t sample_pairs = std::min(cache.pair_count(), max_uncached_sample_pairs);
+    if (!sample_pairs)
+        return 0;
+
+    PROFILE_DATA_BLOCK("estimate_uncached_cycles", 2 * sample_pairs * sizeof(globe_point));
+
+    volatile double sample_sink = 0.0;
+
+    const uint64_t sample_start = read_cpu_timer();
+
+    for (size_t i = 0; i < 2 * sample_pairs; i += 2)
+    {
+        const typename Kernel::point_data p1 = Kernel::prepare(unique_points[indices[i]]);
+        const typename Kernel::point_data p2 = Kernel::prepare(unique_points[indices[i + 1]]);
+        sample_sink = sample_sink + Kernel::distance(p1, p2, earth_radius);
+    }
+
+    const uint64_t sample_end = read_cpu_timer();
+
+    return (sample_end - sample_start) * cache.pair_count() / sample_pairs;
+}
+
+// the uncached estimate over the cache's whole cost: building it, preparing the unique points and the pair loop
+double estimate_point_cache_speedup(const point_cache& cache, const cached_distance_result& result);
+
+void print_point_cache_results(const point_cache& cache, const cached_distance_result& result);
+
+// puts the hit rate and estimated speedup under calculate_cached_distance in the profile
+void annotate_point_cache_profile(const point_cache& cache, const cached_distance_result& result);
+
+#endif
@@ -0,0 +1,165 @@
+#include "point_input.hpp"
+
+#include <cstddef>
+#include <stdexcept>
+#include <fstream>
+#include <optional>
+
+#include "profiler.hpp"
+
+namespace
+{
+    constexpr long long max_pair_count = 1ULL << 30;
+
+    globe_point read_point(const json::json_element& point_element)
+    {
+        using namespace json;
+
+        const auto* point = point_element.as<json_object>();
+        if (!point)
+            throw std::runtime_error{ "Unexpected non-object found in point array." };
+
+        if (point->size() != 2)
+            throw std::runtime_error{ "Point objects must have exactly 2 members: x, y" };
+
+        const std::optional<float_literal> x = point->get_as_number("x");
+        const std::optional<float_literal> y = point->get_as_number("y");
+
+        if (!x || !y)
+            throw std::runtime_error{ "Could not find both point members: x, y" };
+
+        return { .x = *x, .y = *y };
+    }
+}
+
+std::vector<globe_point_pair> read_point_pairs(const json::json_document& document)
+{
+    PROFILE_FUNCTION;
+
+    using namespace json;
+    const json_object* root = document.as<json_object>();
+    if (!root)
+        throw std::runtime_error{ "The JSON root element is not an object." };
+
+    const json_array* point_pairs = root->get_as<json_array>("pairs");
+    if (!point_pairs)
+        throw std::runtime_error{ "Could not find array member 'pairs'." };
+
+    const size_t point_pair_count = point_pairs->size();
+    if (point_pair_count > max_pair_count)
+        throw std::runtime_error{ "The input JSON has too many point pairs." };
+
+    std::vector<globe_point_pair> result;
+    result.reserve(point_pair_count);
+
+    for (const json_element& pair_element : *point_pairs)
+    {
+        const auto* point_pair = pair_element.as<json_object>();
+        if (!point_pair)
+            throw std::runtime_error{ "Unexpected non-object found in pair array." };
+
+        if (point_pair->size() != 4)
+            throw std::runtime_error{ "Point pair objects must have exactly 4 members: x0, y0, x1, y1" };
+
+        std::optional<float_literal> p_x0;
+        std::optional<float_literal> p_y0;
+        std::optional<float_literal> p_x1;
+        std::optional<float_literal> p_y1;
+
+        for (const auto& [name, value] : *point_pair)
+        {
+            if (name.size() != 2)
+                throw std::runtime_error{ "Unexpected point pair member found." };
+
+            switch (name[0])
+            {
+                case 'x':
+                    switch (name[1])
+                    {
+                        case '0': p_x0 = value.as_number(); break;
+                        case '1': p_x1 = value.as_number(); break;
+                    }
+                    break;
+
+                case 'y':
+                    switch (name[1])
+                    {
+                        case '0': p_y0 = value.as_number(); break;
+                        case '1': p_y1 = value.as_number(); break;
+                    }
+                    break;
+            }
+        }
+
+        if (!p_x0 || !p_y0 || !p_x1 || !p_y1)
+            throw std::runtime_error{ "Could not find all 4 point pair members: x0, y0, x1, y1" };
+
+        result.push_back(
+        {
+            .point1 = { .x = *p_x0, .y = *p_y0 },
+            .point2 = { .x = *p_x1, .y = *p_y1 }
+        });
+    }
+
+    return result;
+}
+
+std::vector<globe_point> read_point_set(const json::json_document& document)
+{
+    PROFILE_FUNCTION;
+
+    using namespace json;
+    const json_object* root = document.as<json_object>();
+    if (!root)
+        throw std::runtime_error{ "The JSON root element is not an object." };
+
+    const json_array* points = root->get_as<json_array>("points");
+    if (!points)
+    {
+        std::vector<globe_point> result;
+
+        for (const auto& [p1, p2] : read_point_pairs(document))
+        {
+            result.push_back(p1);
+            result.push_back(p2);
+        }
+
+        return result;
+    }
+
+    if (points->size() > 2 * max_pair_count)
+        throw std::runtime_error{ "The input JSON has too many points." };
+
+    std::vector<globe_point> result;
+    result.reserve(points->size());
+
+    for (const json_element& point_element : *points)
+        result.push_back(read_point(point_element));
+
+    return result;
+}
+
+double read_reference_distance(const std::string& path, size_t expected_points)
+{
+    PROFILE_DATA_FUNCTION((expected_points + 1) * sizeof(double));
+
+    std::ifstream input_file{ path, std::ios::binary };
+
+    if (!input_file)
+        throw std::runtime_error{ "Cannot open reference binary file." };
+
+    size_t distance_count = 0;
+    double distance = 0.0;
+    while (input_file && !input_file.eof())
+    {
+        input_file.read(reinterpret_cast<char*>(&distance), sizeof(decltype(distance)));
+        ++distance_count;
+        input_file.peek();
+    }
+    distance_count -= (distance_count > 0);
+
+    if (distance_count != expected_points)
+        throw std::runtime_error{ "The binary answers file and input JSON do not have the same number of point pairs." };
+
+    return distance;
+}
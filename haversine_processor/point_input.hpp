@@ -0,0 +1,21 @@
+﻿#ifndef WS_POINTINPUT_HPP
+#define WS_POINTINPUT_HPP
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+#include "haversine_formula.hpp"
+#include "json/model.hpp"
+
+// reads the "pairs" array written by haversine_input_generator
+std::vector<globe_point_pair> read_point_pairs(const json::json_document& document);
+
+// reads a "points" array of { "x", "y" } objects; a "pairs" document contributes both endpoints of every pair
+std::vector<globe_point> read_point_set(const json::json_document& document);
+
+// reads the answers file written by haversine_input_generator, one double per pair followed by their mean, and
+// returns the mean
+double read_reference_distance(const std::string& path, size_t expected_points);
+
+#endif
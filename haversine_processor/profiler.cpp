@@ -1,31 +1,524 @@
 #include "profiler.hpp"
 
 #include <algorithm>
+#include <array>
+#include <cctype>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <stdexcept>
 #include <format>
+#include <fstream>
 #include <iomanip>
 #include <iostream>
+#include <limits>
 #include <locale>
+#include <memory>
+#include <mutex>
+#include <span>
+#include <string>
+#include <unordered_map>
+#include <utility>
 #include <vector>
 
+#include "json/utilities.hpp"
+#include "latency_histogram.hpp"
+
 #if PROFILER
 
-#define PRINT_ANCHORS(...) print_anchors(__VA_ARGS__)
+#define PRINT_PROFILES(...) print_profiles(__VA_ARGS__)
 
 #else
 
-#define PRINT_ANCHORS(...)
+#define PRINT_PROFILES(...)
 
 #endif
 
 namespace
 {
-    void print_anchor(const profile_anchor& anchor, uint64_t cpu_freq, uint64_t overall_duration)
+    struct thread_registry
+    {
+        std::mutex mutex;
+        std::vector<std::unique_ptr<profiler::thread_profile>> profiles;
+        std::vector<profiler::thread_profile*> free_profiles;
+    };
+
+    thread_registry& get_registry()
+    {
+        static thread_registry registry;
+        return registry;
+    }
+
+    // runtime-named anchors by name; map nodes never move, so the keys double as the anchors' names
+    struct named_anchor_registry
+    {
+        std::mutex mutex;
+        std::unordered_map<std::string, uint32_t> ids;
+    };
+
+    named_anchor_registry& get_named_anchors()
+    {
+        static named_anchor_registry named_anchors;
+        return named_anchors;
+    }
+
+    struct anchor_note_registry
+    {
+        std::mutex mutex;
+        std::unordered_map<std::string, std::string> notes;
+    };
+
+    anchor_note_registry& get_anchor_notes()
+    {
+        static anchor_note_registry anchor_notes;
+        return anchor_notes;
+    }
+
+    void resize_thread_profile(profiler::thread_profile& profile, size_t anchor_count)
+    {
+        if (anchor_count <= profile.anchors.size())
+            return;
+
+        profile.anchors.resize(anchor_count);
+
+#if PROFILER_HISTOGRAMS
+        profile.latencies.resize(anchor_count);
+#endif
+    }
+
+    // hands the thread's table back when the thread exits, so short-lived worker threads reuse tables instead of
+    // growing the registry (the recorded anchors stay and keep accumulating under the same thread index)
+    struct thread_profile_release
+    {
+        profiler::thread_profile* profile = nullptr;
+
+        ~thread_profile_release()
+        {
+            if (!profile)
+                return;
+
+#if PROFILER_COUNTERS
+            profile->counters.close();
+#endif
+
+            thread_registry& registry = get_registry();
+            std::scoped_lock lock{ registry.mutex };
+            registry.free_profiles.push_back(profile);
+        }
+    };
+
+    // the exclusive duration without the profiler's own cost: every timed hit carries its inner overhead, and
+    // every nested block adds the rest of its cost; a parent whose sampled children were overestimated goes below 0
+    double compensate_exclusive(uint64_t exclusive_duration, uint64_t timed_count, uint64_t child_count)
+    {
+        const profile_overhead overhead = profiler::get_block_overhead();
+        return static_cast<double>(static_cast<int64_t>(exclusive_duration)) - timed_count * overhead.inner - child_count * (overhead.outer - overhead.inner);
+    }
+
+    // durations without the profiler's own cost, the inclusive one losing every nested block's whole cost
+    compensated_durations compensate_overhead(uint64_t exclusive_duration, uint64_t inclusive_duration, uint64_t timed_count, uint64_t child_count, uint64_t descendant_count)
+    {
+        const profile_overhead overhead = profiler::get_block_overhead();
+
+        const double compensated_exclusive = compensate_exclusive(exclusive_duration, timed_count, child_count);
+        const double compensated_inclusive = static_cast<double>(inclusive_duration) - timed_count * overhead.inner - descendant_count * overhead.outer;
+
+        return { std::max(compensated_exclusive, 0.0), std::max(compensated_inclusive, 0.0) };
+    }
+
+    // Sampled blocks extrapolate their untimed hits from the timed ones, which overshoots when a few timed hits ran
+    // slow. The parent timed those hits directly, so where its compensated exclusive duration would go below zero,
+    // the excess comes off the extrapolations charged to it, in proportion to them.
+    void bound_extrapolations(std::span<profile_anchor> anchors)
+    {
+        std::vector<uint64_t> child_extrapolations(anchors.size());
+
+        // a top-level block's parent is the unused anchor 0, which measured nothing
+        for (const profile_anchor& anchor : anchors)
+        {
+            if (anchor.extrapolated_duration && anchor.sampled_parent_index && anchor.sampled_parent_index < anchors.size())
+                child_extrapolations[anchor.sampled_parent_index] += anchor.extrapolated_duration;
+        }
+
+        std::vector<double> excess_fractions(anchors.size());
+
+        for (size_t i = 0; i < anchors.size(); ++i)
+        {
+            if (!child_extrapolations[i])
+                continue;
+
+            const profile_anchor& parent = anchors[i];
+            const double excess = -compensate_exclusive(parent.exclusive_duration, parent.timed_count, parent.child_count);
+
+            if (excess > 0.0)
+                excess_fractions[i] = std::min(excess / child_extrapolations[i], 1.0);
+        }
+
+        for (profile_anchor& anchor : anchors)
+        {
+            if (!anchor.extrapolated_duration || anchor.sampled_parent_index >= anchors.size() || excess_fractions[anchor.sampled_parent_index] <= 0.0)
+                continue;
+
+            const auto excess = static_cast<uint64_t>(excess_fractions[anchor.sampled_parent_index] * anchor.extrapolated_duration);
+
+            anchor.exclusive_duration -= excess;
+            anchor.inclusive_duration -= excess;
+            anchor.extrapolated_duration -= excess;
+            anchor.trimmed_duration += excess;
+            anchors[anchor.sampled_parent_index].exclusive_duration += excess;
+        }
+    }
+
+#if PROFILER_CALL_TREE
+    struct merged_call_tree_node
+    {
+        const char* name = nullptr;
+        uint32_t anchor_index{};
+        size_t parent{};
+        uint64_t hit_count{};
+        uint64_t timed_count{};
+        uint64_t child_timed_count{};
+        uint64_t descendant_timed_count{};
+        uint64_t exclusive_duration{};
+        uint64_t inclusive_duration{};
+        uint64_t extrapolated_duration{};
+        std::vector<size_t> children;
+    };
+
+    // the calling-context trees of every thread merged by path, node 0 being the root; a node always comes after
+    // its parent
+    struct merged_call_tree
+    {
+        std::vector<merged_call_tree_node> nodes;
+        bool truncated = false;
+    };
+
+    void merge_call_tree_node(merged_call_tree& tree, size_t merged_index, const profiler::thread_profile& profile, uint32_t node_index)
+    {
+        for (uint32_t child = profile.call_tree[node_index].first_child; child; child = profile.call_tree[child].next_sibling)
+        {
+            const call_tree_node& source = profile.call_tree[child];
+
+            const std::vector<size_t>& siblings = tree.nodes[merged_index].children;
+            const auto match = std::ranges::find(siblings, source.anchor_index, [&](size_t i) { return tree.nodes[i].anchor_index; });
+
+            size_t merged_child = 0;
+            if (match != siblings.end())
+            {
+                merged_child = *match;
+            }
+            else
+            {
+                merged_child = tree.nodes.size();
+                tree.nodes.push_back({ .anchor_index = source.anchor_index, .parent = merged_index, .children = {} });
+                tree.nodes[merged_index].children.push_back(merged_child);
+            }
+
+            merged_call_tree_node& node = tree.nodes[merged_child];
+
+            // blocks still open have no name yet
+            if (const char* name = profile.anchors[source.anchor_index].name)
+                node.name = name;
+
+            node.hit_count += source.hit_count;
+            node.timed_count += source.timed_count;
+            node.exclusive_duration += source.exclusive_duration;
+            node.inclusive_duration += source.inclusive_duration;
+            node.extrapolated_duration += source.extrapolated_duration;
+
+            merge_call_tree_node(tree, merged_child, profile, child);
+        }
+    }
+
+    // as for anchors, but every node knows its one parent
+    void bound_extrapolations(merged_call_tree& tree)
+    {
+        std::vector<uint64_t> child_extrapolations(tree.nodes.size());
+
+        for (const merged_call_tree_node& node : tree.nodes)
+        {
+            if (node.extrapolated_duration && node.parent)
+                child_extrapolations[node.parent] += node.extrapolated_duration;
+        }
+
+        std::vector<double> excess_fractions(tree.nodes.size());
+
+        for (size_t i = 1; i < tree.nodes.size(); ++i)
+        {
+            if (!child_extrapolations[i])
+                continue;
+
+            const merged_call_tree_node& parent = tree.nodes[i];
+            const double excess = -compensate_exclusive(parent.exclusive_duration, parent.timed_count, parent.child_timed_count);
+
+            if (excess > 0.0)
+                excess_fractions[i] = std::min(excess / child_extrapolations[i], 1.0);
+        }
+
+        for (merged_call_tree_node& node : tree.nodes)
+        {
+            if (!node.extrapolated_duration || excess_fractions[node.parent] <= 0.0)
+                continue;
+
+            const auto excess = static_cast<uint64_t>(excess_fractions[node.parent] * node.extrapolated_duration);
+
+            node.exclusive_duration -= excess;
+            node.inclusive_duration -= excess;
+            node.extrapolated_duration -= excess;
+            tree.nodes[node.parent].exclusive_duration += excess;
+        }
+    }
+
+    merged_call_tree get_call_tree()
+    {
+        merged_call_tree tree;
+        tree.nodes.emplace_back();
+
+        {
+            thread_registry& registry = get_registry();
+            std::scoped_lock lock{ registry.mutex };
+
+            for (const auto& profile : registry.profiles)
+            {
+                merge_call_tree_node(tree, 0, *profile, 0);
+                tree.truncated |= profile->call_tree_size == profiler::max_call_tree_nodes;
+            }
+        }
+
+        // children always follow their parent, so a backwards pass sees every subtree complete
+        for (size_t i = tree.nodes.size() - 1; i > 0; --i)
+        {
+            const merged_call_tree_node& node = tree.nodes[i];
+            merged_call_tree_node& parent = tree.nodes[node.parent];
+
+            parent.child_timed_count += node.timed_count;
+            parent.descendant_timed_count += node.timed_count + node.descendant_timed_count;
+        }
+
+        bound_extrapolations(tree);
+
+        return tree;
+    }
+#endif
+
+#if PROFILER_CALL_TREE
+    compensated_durations compensate_overhead(const merged_call_tree_node& node)
+    {
+        return compensate_overhead(node.exclusive_duration, node.inclusive_duration, node.timed_count, node.child_timed_count, node.descendant_timed_count);
+    }
+
+    // one "outer;inner;leaf nanoseconds" line per path with exclusive time; returns the number of lines
+    size_t write_folded_node(std::ostream& output_stream, const merged_call_tree& tree, size_t node_index, std::string& stack, double nanoseconds_per_tick)
+    {
+        size_t stack_count = 0;
+
+        for (const size_t child : tree.nodes[node_index].children)
+        {
+            const merged_call_tree_node& node = tree.nodes[child];
+
+            if (!node.name)
+                continue;
+
+            const size_t stack_size = stack.size();
+            if (stack_size)
+                stack += ';';
+
+            // runtime names may hold anything, but ';' separates frames and a space ends the stack
+            const size_t name_start = stack.size();
+            stack += node.name;
+            std::replace_if(stack.begin() + name_start, stack.end(), [](char ch) { return ch == ';' || std::isspace(static_cast<unsigned char>(ch)); }, '_');
+
+            const auto nanoseconds = static_cast<uint64_t>(std::llround(compensate_overhead(node).exclusive_duration * nanoseconds_per_tick));
+            if (nanoseconds)
+            {
+                output_stream << stack << ' ' << nanoseconds << '\n';
+                ++stack_count;
+            }
+
+            stack_count += write_folded_node(output_stream, tree, child, stack, nanoseconds_per_tick);
+            stack.resize(stack_size);
+        }
+
+        return stack_count;
+    }
+#endif
+
+#if PROFILER
+    // the time a thread spent inside top-level blocks, which every top-level block subtracts from the unused
+    // anchor 0's exclusive duration
+    uint64_t get_profiled_duration(const profiler::thread_profile& profile)
+    {
+        return 0 - profile.anchors[0].exclusive_duration;
+    }
+
+#if PROFILER_COUNTERS
+    // counters that opened on the thread that started profiling; the others read as 0 and aren't printed
+    size_t available_counter_count{};
+    std::array<perf_counter, perf_counter_count> available_counters{};
+
+    void print_counter_availability(const profiler::thread_profile& profile)
+    {
+        available_counter_count = 0;
+        for (size_t i = 0; i < perf_counter_count; ++i)
+        {
+            const auto counter = static_cast<perf_counter>(i);
+            if (profile.counters.is_available(counter))
+                available_counters[available_counter_count++] = counter;
+        }
+
+        if (!available_counter_count)
+        {
+            std::cout << "\nHardware counters: unavailable\n";
+            return;
+        }
+
+        std::cout << "\nHardware counters:";
+        for (size_t i = 0; i < available_counter_count; ++i)
+            std::cout << (i ? ", " : " ") << to_string(available_counters[i]);
+
+        std::cout << '\n';
+    }
+
+    // exclusive counts, scaled per byte when the block reports the data it processed and per hit otherwise
+    void print_anchor_counters(const profile_anchor& anchor)
+    {
+        if (!available_counter_count)
+            return;
+
+        const auto count = [&](perf_counter counter) { return anchor.exclusive_counters[static_cast<size_t>(counter)]; };
+        const auto is_available = [&](perf_counter counter)
+        {
+            return std::find(available_counters.begin(), available_counters.begin() + available_counter_count, counter) != available_counters.begin() + available_counter_count;
+        };
+
+        const double scale = anchor.data_processed ? static_cast<double>(anchor.data_processed) : static_cast<double>(anchor.hit_count);
+        const char* unit = anchor.data_processed ? "B" : "hit";
+
+        std::string line;
+
+        if (is_available(perf_counter::instructions) && is_available(perf_counter::cycles) && count(perf_counter::cycles))
+            line += std::format("IPC {:.2f}", static_cast<double>(count(perf_counter::instructions)) / count(perf_counter::cycles));
+
+        for (const perf_counter counter : { perf_counter::l1d_read_misses, perf_counter::llc_misses, perf_counter::branch_misses })
+        {
+            if (is_available(counter))
+                line += std::format("{}{} {:.4f}/{}", line.empty() ? "" : " | ", to_string(counter), count(counter) / scale, unit);
+        }
+
+        if (is_available(perf_counter::page_faults))
+            line += std::format(std::locale("en_US"), "{}{} {:Ld}", line.empty() ? "" : " | ", to_string(perf_counter::page_faults), count(perf_counter::page_faults));
+
+        if (!line.empty())
+            std::cout << "      " << line << '\n';
+    }
+#endif
+
+    void print_overhead(std::span<const profile_anchor> anchors, uint64_t cpu_freq, uint64_t overall_duration)
+    {
+        constexpr double unreliable_percent = 5.0;
+
+        // only timed hits pay the full cost of a block
+        uint64_t block_count = 0;
+        for (const profile_anchor& anchor : anchors)
+            block_count += anchor.timed_count;
+
+        const profile_overhead overhead = profiler::get_block_overhead();
+        const double overhead_duration = block_count * overhead.outer;
+        const double overhead_percent = overall_duration ? 100.0 * overhead_duration / overall_duration : 0.0;
+
+        std::cout << std::format(std::locale("en_US"), "Profiler overhead: {:.4f} ms ({:.2f}%), {:Ld} blocks at {:.0f} cycles each\n",
+                                 1000.0 * overhead_duration / cpu_freq, overhead_percent, block_count, overhead.outer);
+
+        if (overhead_percent > unreliable_percent)
+            std::cout << "  Durations below are compensated, but blocks with many short hits are still approximate.\n";
+    }
+
+    // the 95% confidence interval of the extrapolated duration, relative to it, from the spread of the timed hits
+    // around their mean without the timer reads
+    double sampled_duration_error(const profile_anchor& anchor)
+    {
+        const double hit_duration = anchor.timed_mean - profiler::get_block_overhead().inner;
+
+        if (anchor.timed_count < 2 || hit_duration <= 0.0)
+            return 0.0;
+
+        const double variance = anchor.timed_m2 / (anchor.timed_count - 1.0);
+        return 1.96 * std::sqrt(variance / static_cast<double>(anchor.timed_count)) / hit_duration;
+    }
+
+    // percentiles of the raw per-hit inclusive durations, overhead included; sampled anchors only have their timed
+    // hits, and a single hit has no distribution worth printing
+    void print_anchor_latencies(const latency_histogram& latencies, uint64_t cpu_freq)
+    {
+        if (latencies.count() < 2)
+            return;
+
+        const auto to_microseconds = [&](uint64_t duration) { return 1000000.0 * duration / cpu_freq; };
+
+        std::cout << std::format("      p50 {:.3f} us | p99 {:.3f} us | p99.9 {:.3f} us | max {:.3f} us\n",
+                                 to_microseconds(latencies.quantile(0.5)), to_microseconds(latencies.quantile(0.99)),
+                                 to_microseconds(latencies.quantile(0.999)), to_microseconds(latencies.max()));
+    }
+
+    void print_anchor_note(const profile_anchor& anchor)
+    {
+        anchor_note_registry& anchor_notes = get_anchor_notes();
+        std::scoped_lock lock{ anchor_notes.mutex };
+
+        const auto note = anchor_notes.notes.find(anchor.name);
+        if (note != anchor_notes.notes.end())
+            std::cout << "      " << note->second << '\n';
+    }
+
+#if PROFILER_ALLOCATIONS
+    void print_anchor_allocations(const profile_anchor& anchor)
+    {
+        const uint64_t fault_count = anchor.exclusive_minor_faults + anchor.exclusive_major_faults;
+
+        if (!anchor.exclusive_allocation_count && !anchor.peak_live_bytes && !fault_count)
+            return;
+
+        std::cout << std::format(std::locale("en_US"), "      allocations {:Ld} ({:Ld} bytes) | peak live {:Ld} bytes | page faults {:Ld} ({:Ld} major)\n",
+                                 anchor.exclusive_allocation_count, anchor.exclusive_allocated_bytes, anchor.peak_live_bytes,
+                                 fault_count, anchor.exclusive_major_faults);
+    }
+#endif
+
+    // The anchor's throughput, and how close it comes to the bandwidth of the memory level its data fits in. That is
+    // all the data it processed, not the data per hit: a block hit once per element streams the whole array through,
+    // however few bytes each hit reads.
+    void print_anchor_throughput(const profile_anchor& anchor, double inclusive_duration, uint64_t cpu_freq)
+    {
+        constexpr double gigabyte = 1024.0 * 1024.0 * 1024.0;
+
+        const double seconds = inclusive_duration / cpu_freq;
+        if (seconds <= 0.0)
+            return;
+
+        const double bytes_per_second = anchor.data_processed / seconds;
+        std::cout << std::format(", {:.3f} GB/s", bytes_per_second / gigabyte);
+
+        const std::vector<memory_level>& levels = profiler::get_memory_levels();
+        if (levels.empty())
+            return;
+
+        const auto fitting_level = std::ranges::find_if(levels, [&](const memory_level& level) { return !level.capacity || anchor.data_processed <= level.capacity; });
+        const memory_level& roof = fitting_level != levels.end() ? *fitting_level : levels.back();
+
+        if (roof.read_bytes_per_second > 0.0)
+            std::cout << std::format(", {:.1f}% of {}", 100.0 * bytes_per_second / roof.read_bytes_per_second, roof.name);
+    }
+
+    // notes only go with the anchors merged over every thread, as the per-thread tables would repeat them
+    void print_anchor(const profile_anchor& anchor, const latency_histogram* latencies, bool print_note, uint64_t cpu_freq, uint64_t overall_duration)
     {
         constexpr int column_1_width = 35;
         constexpr int column_2_width = 40;
 
-        const double exclusive_duration_ms = 1000.0 * anchor.exclusive_duration / cpu_freq;
-        const double exclusive_percent = 100.0 * anchor.exclusive_duration / overall_duration;
+        const compensated_durations durations = profiler::get_compensated_durations(anchor);
+
+        const double exclusive_duration_ms = 1000.0 * durations.exclusive_duration / cpu_freq;
+        const double exclusive_percent = 100.0 * durations.exclusive_duration / overall_duration;
 
         std::cout << std::left << std::setw(column_1_width) << std::fixed << std::setfill(' ');
         std::cout << std::format(std::locale("en_US"), "  {}[{:Ld}]: ", anchor.name, anchor.hit_count);
@@ -37,26 +530,52 @@ namespace
         }
         else
         {
-            const double inclusive_duration_ms = 1000.0 * anchor.inclusive_duration / cpu_freq;
-            const double inclusive_percent = 100.0 * anchor.inclusive_duration / overall_duration;
+            const double inclusive_duration_ms = 1000.0 * durations.inclusive_duration / cpu_freq;
+            const double inclusive_percent = 100.0 * durations.inclusive_duration / overall_duration;
 
             std::cout << std::format("{:.4f} ms ({:.2f}%, {:.2f}% w/ children)", exclusive_duration_ms, exclusive_percent, inclusive_percent);
         }
 
         if (anchor.data_processed)
         {
-            std::cout << std::format(std::locale("en_US"), "[Data processed: {:Ld} bytes]", anchor.data_processed);
+            std::cout << std::format(std::locale("en_US"), "[Data processed: {:Ld} bytes", anchor.data_processed);
+            print_anchor_throughput(anchor, durations.inclusive_duration, cpu_freq);
+            std::cout << ']';
+        }
+
+        if (anchor.sample_period)
+        {
+            std::cout << std::format(std::locale("en_US"), "[Sampled 1/{}: {:Ld} hits timed, +/-{:.2f}%",
+                                     anchor.sample_period, anchor.timed_count, 100.0 * sampled_duration_error(anchor));
+
+            if (anchor.trimmed_duration)
+                std::cout << std::format(", {:.2f}% over its parent trimmed", 100.0 * anchor.trimmed_duration / (anchor.inclusive_duration + anchor.trimmed_duration));
+
+            std::cout << ']';
         }
 
         std::cout << '\n';
+
+        if (print_note)
+            print_anchor_note(anchor);
+
+        if (latencies)
+            print_anchor_latencies(*latencies, cpu_freq);
+
+#if PROFILER_ALLOCATIONS
+        print_anchor_allocations(anchor);
+#endif
+
+#if PROFILER_COUNTERS
+        print_anchor_counters(anchor);
+#endif
     }
 
-    void print_anchors(uint64_t cpu_freq, uint64_t overall_duration)
+    // latencies is either empty or indexed like anchors
+    void print_anchors(std::span<const profile_anchor> anchors, std::span<const latency_histogram> latencies, bool print_notes, uint64_t cpu_freq, uint64_t overall_duration)
     {
-        const auto& anchors = profiler::get_anchors();
-
         std::vector<const profile_anchor*> sorted_anchors;
-        sorted_anchors.reserve(detail::anchor_id_counter);
+        sorted_anchors.reserve(anchors.size());
 
         for (const profile_anchor& anchor : anchors)
         {
@@ -72,19 +591,464 @@ namespace
             //return a1->hit_count > a2->hit_count;
         });
 
+        for (const profile_anchor* anchor : sorted_anchors)
+        {
+            const size_t anchor_index = anchor - anchors.data();
+            print_anchor(*anchor, latencies.empty() ? nullptr : &latencies[anchor_index], print_notes, cpu_freq, overall_duration);
+        }
+    }
+
+    void print_threads(uint64_t cpu_freq, uint64_t overall_duration)
+    {
+        thread_registry& registry = get_registry();
+        std::scoped_lock lock{ registry.mutex };
+
+        if (registry.profiles.size() < 2)
+            return;
+
+        uint64_t summed_duration = 0;
+        for (const auto& profile : registry.profiles)
+            summed_duration += get_profiled_duration(*profile);
+
+        const double overall_duration_ms = 1000.0 * overall_duration / cpu_freq;
+        const double summed_duration_ms = 1000.0 * summed_duration / cpu_freq;
+        const double parallelism = overall_duration ? static_cast<double>(summed_duration) / overall_duration : 0.0;
+
+        std::cout << std::format("\nThreads: {}\n", registry.profiles.size());
+        std::cout << std::format("  Wall clock: {:.4f} ms, summed thread time in blocks: {:.4f} ms ({:.2f}x)\n",
+                                 overall_duration_ms, summed_duration_ms, parallelism);
+
+        for (const auto& profile : registry.profiles)
+        {
+            const double profiled_duration_ms = 1000.0 * get_profiled_duration(*profile) / cpu_freq;
+
+            std::cout << std::format("\nThread {} ({:.4f} ms in blocks):\n", profile->thread_index, profiled_duration_ms);
+            std::vector<profile_anchor> anchors = profile->anchors;
+            bound_extrapolations(anchors);
+
+#if PROFILER_HISTOGRAMS
+            print_anchors(anchors, profile->latencies, false, cpu_freq, overall_duration);
+#else
+            print_anchors(anchors, {}, false, cpu_freq, overall_duration);
+#endif
+        }
+    }
+
+#if PROFILER_CALL_TREE
+    // children are printed heaviest first
+    void print_call_tree_node(const merged_call_tree& tree, size_t node_index, size_t depth, uint64_t cpu_freq, uint64_t overall_duration)
+    {
+        std::vector<size_t> children = tree.nodes[node_index].children;
+        std::ranges::sort(children, std::ranges::greater{}, [&](size_t i) { return tree.nodes[i].inclusive_duration; });
+
+        for (const size_t child : children)
+        {
+            const merged_call_tree_node& node = tree.nodes[child];
+
+            if (!node.name)
+                continue;
+
+            const compensated_durations durations = compensate_overhead(node);
+
+            const double inclusive_duration_ms = 1000.0 * durations.inclusive_duration / cpu_freq;
+            const double inclusive_percent = 100.0 * durations.inclusive_duration / overall_duration;
+            const double exclusive_duration_ms = 1000.0 * durations.exclusive_duration / cpu_freq;
+
+            std::cout << std::format(std::locale("en_US"), "{:{}}{}[{:Ld}]: {:.4f} ms ({:.2f}%), {:.4f} ms exclusive\n",
+                                     "", 2 * (depth + 1), node.name, node.hit_count, inclusive_duration_ms, inclusive_percent, exclusive_duration_ms);
+
+            print_call_tree_node(tree, child, depth + 1, cpu_freq, overall_duration);
+        }
+    }
+
+    void print_call_tree(uint64_t cpu_freq, uint64_t overall_duration)
+    {
+        const merged_call_tree tree = get_call_tree();
+
+        if (tree.nodes.size() < 2)
+            return;
+
+        std::cout << "\nCall tree:\n";
+        print_call_tree_node(tree, 0, 0, cpu_freq, overall_duration);
+
+        if (tree.truncated)
+            std::cout << std::format("  Truncated: a thread reached {} paths; blocks on later paths count towards their parent.\n", profiler::max_call_tree_nodes);
+    }
+#endif
+
+    void print_profiles(uint64_t cpu_freq, uint64_t overall_duration)
+    {
+        if (!profiler::is_enabled())
+        {
+            std::cout << "Profiling is off; enable it with --profile or HAVERSINE_PROFILE=1.\n";
+            return;
+        }
+
+#if PROFILER_COUNTERS
+        {
+            thread_registry& registry = get_registry();
+            std::scoped_lock lock{ registry.mutex };
+
+            // the first registered table belongs to the thread that started profiling
+            if (!registry.profiles.empty())
+                print_counter_availability(*registry.profiles.front());
+        }
+#endif
+
+        const std::vector<profile_anchor> anchors = profiler::get_anchors();
+
+        print_overhead(anchors, cpu_freq, overall_duration);
+
+#if PROFILER_HISTOGRAMS
+        const std::vector<latency_histogram> latencies = profiler::get_latencies();
+#else
+        const std::vector<latency_histogram> latencies;
+#endif
+
         std::cout << "\nProfiles:\n";
+        print_anchors(anchors, latencies, true, cpu_freq, overall_duration);
 
-        for (const profile_anchor* anchor : sorted_anchors)
+#if PROFILER_CALL_TREE
+        print_call_tree(cpu_freq, overall_duration);
+#endif
+
+        print_threads(cpu_freq, overall_duration);
+    }
+#endif
+}
+
+profiler::thread_profile& profiler::register_thread()
+{
+    thread_local thread_profile_release release;
+
+    thread_registry& registry = get_registry();
+    std::scoped_lock lock{ registry.mutex };
+
+    thread_profile* profile = nullptr;
+
+    if (!registry.free_profiles.empty())
+    {
+        // reuse the lowest thread index, so the main thread and the first workers keep stable numbers
+        const auto lowest = std::ranges::min_element(registry.free_profiles, {}, &thread_profile::thread_index);
+        profile = *lowest;
+        registry.free_profiles.erase(lowest);
+    }
+    else
+    {
+        registry.profiles.push_back(std::make_unique<thread_profile>());
+        profile = registry.profiles.back().get();
+        profile->thread_index = static_cast<uint32_t>(registry.profiles.size() - 1);
+    }
+
+    resize_thread_profile(*profile, get_anchor_count());
+
+#if PROFILER_TRACE
+    if (tracing && !profile->trace_events)
+        profile->trace_events = std::make_unique<trace_event[]>(trace_capacity);
+#endif
+
+#if PROFILER_COUNTERS
+    profile->counters.open();
+#endif
+
+    release.profile = profile;
+    local_profile = profile;
+
+    return *profile;
+}
+
+compensated_durations profiler::get_compensated_durations(const profile_anchor& anchor)
+{
+    return compensate_overhead(anchor.exclusive_duration, anchor.inclusive_duration, anchor.timed_count, anchor.child_count, anchor.descendant_count);
+}
+
+bool profiler::is_requested_by_environment()
+{
+    constexpr const char* variable_name = "HAVERSINE_PROFILE";
+
+#if _WIN32
+    char* value = nullptr;
+    size_t value_size = 0;
+    if (_dupenv_s(&value, &value_size, variable_name) != 0 || !value)
+        return false;
+
+    const bool requested = std::strcmp(value, "") != 0 && std::strcmp(value, "0") != 0;
+    std::free(value);
+#else
+    const char* value = std::getenv(variable_name);
+    const bool requested = value && std::strcmp(value, "") != 0 && std::strcmp(value, "0") != 0;
+#endif
+
+    return requested;
+}
+
+void profiler::grow_thread_profile(thread_profile& profile)
+{
+    thread_registry& registry = get_registry();
+    std::scoped_lock lock{ registry.mutex };
+
+    resize_thread_profile(profile, get_anchor_count());
+}
+
+named_anchor profiler::register_anchor(std::string_view name)
+{
+    named_anchor_registry& named_anchors = get_named_anchors();
+    std::scoped_lock lock{ named_anchors.mutex };
+
+    const auto [entry, inserted] = named_anchors.ids.try_emplace(std::string{ name });
+    if (inserted)
+        entry->second = detail::anchor_id_counter.fetch_add(1, std::memory_order_relaxed);
+
+    return { entry->first.c_str(), entry->second };
+}
+
+void profiler::annotate_anchor(std::string_view anchor_name, std::string note)
+{
+    anchor_note_registry& anchor_notes = get_anchor_notes();
+    std::scoped_lock lock{ anchor_notes.mutex };
+
+    anchor_notes.notes.insert_or_assign(std::string{ anchor_name }, std::move(note));
+}
+
+std::vector<profile_anchor> profiler::get_anchors()
+{
+    thread_registry& registry = get_registry();
+    std::scoped_lock lock{ registry.mutex };
+
+    // read under the lock, so no table has grown past it
+    std::vector<profile_anchor> anchors(get_anchor_count());
+
+    for (const auto& profile : registry.profiles)
+    {
+        for (size_t i = 0; i < profile->anchors.size(); ++i)
         {
-            print_anchor(*anchor, cpu_freq, overall_duration);
+            const profile_anchor& source = profile->anchors[i];
+            profile_anchor& anchor = anchors[i];
+
+            if (source.name)
+                anchor.name = source.name;
+
+            anchor.exclusive_duration += source.exclusive_duration;
+            anchor.inclusive_duration += source.inclusive_duration;
+            anchor.hit_count += source.hit_count;
+            anchor.data_processed += source.data_processed;
+            anchor.child_count += source.child_count;
+            anchor.descendant_count += source.descendant_count;
+            anchor.sample_period = std::max(anchor.sample_period, source.sample_period);
+            anchor.extrapolated_duration += source.extrapolated_duration;
+
+            if (source.timed_count)
+            {
+                if (!anchor.timed_count)
+                    anchor.sampled_parent_index = source.sampled_parent_index;
+                else if (anchor.sampled_parent_index != source.sampled_parent_index)
+                    anchor.sampled_parent_index = profile_anchor::several_parents;
+
+                // Chan et al.'s pairwise update, as distance_statistics::merge does it
+                const uint64_t timed_count = anchor.timed_count + source.timed_count;
+                const double delta = source.timed_mean - anchor.timed_mean;
+
+                anchor.timed_m2 += source.timed_m2 + delta * delta * (static_cast<double>(anchor.timed_count) * source.timed_count / timed_count);
+                anchor.timed_mean += delta * source.timed_count / timed_count;
+                anchor.timed_count = timed_count;
+            }
+
+#if PROFILER_COUNTERS
+            for (size_t counter = 0; counter < perf_counter_count; ++counter)
+                anchor.exclusive_counters[counter] += source.exclusive_counters[counter];
+#endif
+
+#if PROFILER_ALLOCATIONS
+            anchor.exclusive_allocation_count += source.exclusive_allocation_count;
+            anchor.exclusive_allocated_bytes += source.exclusive_allocated_bytes;
+            anchor.exclusive_minor_faults += source.exclusive_minor_faults;
+            anchor.exclusive_major_faults += source.exclusive_major_faults;
+            anchor.peak_live_bytes = std::max(anchor.peak_live_bytes, source.peak_live_bytes);
+#endif
         }
     }
+
+    bound_extrapolations(anchors);
+
+    return anchors;
 }
 
-void profiler::print_results()
+#if PROFILER_HISTOGRAMS
+std::vector<latency_histogram> profiler::get_latencies()
+{
+    thread_registry& registry = get_registry();
+    std::scoped_lock lock{ registry.mutex };
+
+    std::vector<latency_histogram> latencies(get_anchor_count());
+
+    for (const auto& profile : registry.profiles)
+    {
+        for (size_t i = 0; i < profile->latencies.size(); ++i)
+            latencies[i].merge(profile->latencies[i]);
+    }
+
+    return latencies;
+}
+#endif
+
+size_t profiler::get_thread_count()
+{
+    thread_registry& registry = get_registry();
+    std::scoped_lock lock{ registry.mutex };
+
+    return registry.profiles.size();
+}
+
+void profiler::calibrate_overhead()
+{
+    constexpr int round_count = 16;
+    constexpr int blocks_per_round = 1000;
+    constexpr uint32_t calibration_anchor = 1;
+
+    // a scratch table keeps the calibration blocks out of the results; it records and traces like a real one so
+    // the blocks cost the same
+    const auto scratch_profile = std::make_unique<thread_profile>();
+    resize_thread_profile(*scratch_profile, calibration_anchor + 1);
+
+#if PROFILER_TRACE
+    if (tracing)
+        scratch_profile->trace_events = std::make_unique<trace_event[]>(trace_capacity);
+#endif
+
+#if PROFILER_COUNTERS
+    scratch_profile->counters.open();
+#endif
+
+    thread_profile* const saved_profile = local_profile;
+    local_profile = scratch_profile.get();
+
+    const profile_anchor& anchor = scratch_profile->anchors[calibration_anchor];
+    profile_overhead overhead{ std::numeric_limits<double>::max(), std::numeric_limits<double>::max() };
+
+    // the fastest round is the one least disturbed by interrupts
+    for (int round = 0; round < round_count; ++round)
+    {
+        const uint64_t prev_exclusive_duration = anchor.exclusive_duration;
+        const uint64_t start_time = READ_BLOCK_TIMER();
+
+        for (int i = 0; i < blocks_per_round; ++i)
+        {
+            profile_block block{ "calibration", calibration_anchor, 0 };
+        }
+
+        const uint64_t end_time = READ_BLOCK_TIMER();
+
+        overhead.inner = std::min(overhead.inner, static_cast<double>(anchor.exclusive_duration - prev_exclusive_duration) / blocks_per_round);
+        overhead.outer = std::min(overhead.outer, static_cast<double>(end_time - start_time) / blocks_per_round);
+    }
+
+    local_profile = saved_profile;
+    block_overhead = overhead;
+}
+
+#if PROFILER_TRACE
+void profiler::enable_tracing()
+{
+    thread_registry& registry = get_registry();
+    std::scoped_lock lock{ registry.mutex };
+
+    tracing = true;
+
+    for (const auto& profile : registry.profiles)
+    {
+        if (!profile->trace_events)
+            profile->trace_events = std::make_unique<trace_event[]>(trace_capacity);
+    }
+}
+
+trace_summary profiler::write_trace(const char* path)
+{
+    const uint64_t cpu_freq = estimate_cpu_timer_freq();
+
+    if (!cpu_freq)
+        throw std::runtime_error{ "Failed to estimate CPU frequency." };
+
+    std::ofstream output_stream{ path };
+
+    if (!output_stream)
+        throw std::runtime_error{ "Could not write trace file." };
+
+    thread_registry& registry = get_registry();
+    std::scoped_lock lock{ registry.mutex };
+
+    // timestamps are microseconds since start_profiling
+    const double microseconds_per_tick = 1000000.0 / cpu_freq;
+    const auto to_microseconds = [&](uint64_t time) { return static_cast<int64_t>(time - overall_start_time) * microseconds_per_tick; };
+
+    trace_summary summary;
+    const char* separator = "";
+
+    output_stream << "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n";
+
+    for (const auto& profile : registry.profiles)
+    {
+        output_stream << std::format("{}{{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":{},\"args\":{{\"name\":\"Thread {}\"}}}}",
+                                     separator, profile->thread_index, profile->thread_index);
+        separator = ",\n";
+
+        if (!profile->trace_events)
+            continue;
+
+        const uint64_t kept_count = std::min<uint64_t>(profile->trace_event_count, trace_capacity);
+        summary.event_count += kept_count;
+        summary.dropped_count += profile->trace_event_count - kept_count;
+
+        // oldest first
+        for (uint64_t i = profile->trace_event_count - kept_count; i < profile->trace_event_count; ++i)
+        {
+            const trace_event& event = profile->trace_events[i & (trace_capacity - 1)];
+
+            // names registered at run time may hold quotes or backslashes
+            output_stream << std::format("{}{{\"name\":{},\"ph\":\"X\",\"pid\":1,\"tid\":{},\"ts\":{:.3f},\"dur\":{:.3f}}}",
+                                         separator, json::to_json_string(event.name), profile->thread_index,
+                                         to_microseconds(event.start_time), (event.end_time - event.start_time) * microseconds_per_tick);
+        }
+    }
+
+    output_stream << "\n]}\n";
+
+    if (!output_stream)
+        throw std::runtime_error{ "Could not write trace file." };
+
+    return summary;
+}
+#endif
+
+#if PROFILER_CALL_TREE
+size_t profiler::write_folded_stacks(const char* path)
 {
     const uint64_t cpu_freq = estimate_cpu_timer_freq();
 
+    if (!cpu_freq)
+        throw std::runtime_error{ "Failed to estimate CPU frequency." };
+
+    std::ofstream output_stream{ path };
+
+    if (!output_stream)
+        throw std::runtime_error{ "Could not write folded stacks file." };
+
+    const merged_call_tree tree = get_call_tree();
+
+    std::string stack;
+    const size_t stack_count = write_folded_node(output_stream, tree, 0, stack, 1000000000.0 / cpu_freq);
+
+    if (!output_stream)
+        throw std::runtime_error{ "Could not write folded stacks file." };
+
+    return stack_count;
+}
+#endif
+
+void profiler::print_results()
+{
+    const timer_calibration calibration = get_timer_calibration();
+    const uint64_t cpu_freq = calibration.cpu_freq;
+
     if (!cpu_freq)
     {
         std::cout << "Failed to estimate CPU frequency.\n";
@@ -94,7 +1058,7 @@ void profiler::print_results()
     const uint64_t overall_duration = get_overall_duration();
 
     const double overall_duration_ms = 1000.0 * overall_duration / cpu_freq;
-    std::cout << std::format(std::locale("en_US"), "Total time: {:.4f} ms (CPU freq {:Ld})\n", overall_duration_ms, cpu_freq);
+    std::cout << std::format(std::locale("en_US"), "Total time: {:.4f} ms (CPU freq {:Ld}, {})\n", overall_duration_ms, cpu_freq, to_string(calibration.source));
 
-    PRINT_ANCHORS(cpu_freq, overall_duration);
+    PRINT_PROFILES(cpu_freq, overall_duration);
 }
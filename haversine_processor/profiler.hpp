@@ -1,17 +1,61 @@
 ﻿#ifndef WS_PROFILER_HPP
 #define WS_PROFILER_HPP
 
+#include <algorithm>
 #include <array>
-#include <cassert>
+#include <atomic>
 #include <cstddef>
 #include <cstdint>
-
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "allocation_tracker.hpp"
+#include "memory_probe.hpp"
 #include "platform_metrics.hpp"
 
+// compiles the profile blocks in; they still record nothing until profiler::enable is called at run time
 #ifndef PROFILER
 #define PROFILER 0
 #endif
 
+// per-anchor hardware counters (perf_event_open on Linux); each block reads them twice, which costs a system call
+#ifndef PROFILER_COUNTERS
+#define PROFILER_COUNTERS 0
+#endif
+
+#if PROFILER_COUNTERS
+#include "perf_counters.hpp"
+#endif
+
+// per-anchor histograms of hit durations, for percentiles; each thread's table grows by about 3 KB per anchor
+#ifndef PROFILER_HISTOGRAMS
+#define PROFILER_HISTOGRAMS 0
+#endif
+
+#if PROFILER_HISTOGRAMS
+#include "latency_histogram.hpp"
+#endif
+
+// the call tree behind the per-path report and --folded; each block looks itself up among its parent's children
+#ifndef PROFILER_CALL_TREE
+#define PROFILER_CALL_TREE 0
+#endif
+
+// the per-thread ring of recent blocks behind --trace; each block checks for the ring and writes an event into it
+#ifndef PROFILER_TRACE
+#define PROFILER_TRACE 0
+#endif
+
+// per-anchor mean and spread of the timed hits for report comparisons, which sampled anchors keep regardless; each
+// block charges its time to the enclosing one and pays for a division
+#ifndef PROFILER_VARIANCE
+#define PROFILER_VARIANCE 0
+#endif
+
 #if PROFILER
 
 #ifdef _MSC_VER
@@ -31,6 +75,36 @@
 #define PROFILE_BLOCK(name) PROFILE_DATA_BLOCK((name), 0)
 #define PROFILE_FUNCTION PROFILE_DATA_FUNCTION(0)
 
+// sampled variants for very hot blocks: every hit is counted, but only one in sample_period is timed
+#define PROFILE_SAMPLED_DATA_BLOCK_CORE(name, short_name, data_processed, sample_period) sampled_profile_block<(sample_period)> VAR_NAME(activity){ (short_name), detail::anchor_id<detail::fixed_string{ (name) }>, (data_processed) }
+#define PROFILE_SAMPLED_DATA_BLOCK(name, data_processed, sample_period) PROFILE_SAMPLED_DATA_BLOCK_CORE((name), (name), (data_processed), (sample_period))
+#define PROFILE_SAMPLED_DATA_FUNCTION(data_processed, sample_period) PROFILE_SAMPLED_DATA_BLOCK_CORE(CURRENT_FUNCTION, __func__, (data_processed), (sample_period))
+
+#define PROFILE_SAMPLED_BLOCK(name, sample_period) PROFILE_SAMPLED_DATA_BLOCK((name), 0, (sample_period))
+#define PROFILE_SAMPLED_FUNCTION(sample_period) PROFILE_SAMPLED_DATA_FUNCTION(0, (sample_period))
+
+// blocks for anchors named at run time, e.g. per input file; the argument is a named_anchor from
+// profiler::register_anchor, which is best registered once and kept rather than looked up on every hit
+#define PROFILE_NAMED_DATA_BLOCK(anchor, data_processed) profile_block VAR_NAME(activity){ (anchor), (data_processed) }
+#define PROFILE_NAMED_BLOCK(anchor) PROFILE_NAMED_DATA_BLOCK((anchor), 0)
+
+#else
+
+#define PROFILE_DATA_BLOCK(...)
+#define PROFILE_DATA_FUNCTION(...)
+#define PROFILE_BLOCK(...)
+#define PROFILE_FUNCTION
+
+#define PROFILE_SAMPLED_DATA_BLOCK(...)
+#define PROFILE_SAMPLED_DATA_FUNCTION(...)
+#define PROFILE_SAMPLED_BLOCK(...)
+#define PROFILE_SAMPLED_FUNCTION(...)
+
+#define PROFILE_NAMED_DATA_BLOCK(...)
+#define PROFILE_NAMED_BLOCK(...)
+
+#endif
+
 // this generates unique identifiers from anchor names in a way that works across translation units
 // it counts template instantiations based on string literal _content_ using c++20 structural nttp
 namespace detail
@@ -44,21 +118,14 @@ namespace detail
     template<size_t N>
     fixed_string(const char(&)[N]) -> fixed_string<N>;
 
-    inline uint32_t anchor_id_counter = 1; // 0 is reserved for "no anchor"
+    // Ids are dense: anchors named in code take theirs during static initialization, and runtime-named anchors
+    // continue from there as they are registered. 0 is reserved for "no anchor".
+    inline std::atomic<uint32_t> anchor_id_counter = 1;
 
     template<fixed_string AnchorName>
-    inline const uint32_t anchor_id = anchor_id_counter++;
+    inline const uint32_t anchor_id = anchor_id_counter.fetch_add(1, std::memory_order_relaxed);
 }
 
-#else
-
-#define PROFILE_DATA_BLOCK(...)
-#define PROFILE_DATA_FUNCTION(...)
-#define PROFILE_BLOCK(...)
-#define PROFILE_FUNCTION
-
-#endif
-
 // stores information about a single profiling unit
 struct profile_anchor
 {
@@ -67,25 +134,266 @@ struct profile_anchor
     uint64_t inclusive_duration{};
     uint64_t hit_count{};
     uint64_t data_processed{};
+
+    // blocks that ran inside this one, for overhead compensation: directly nested, and nested at any depth
+    uint64_t child_count{};
+    uint64_t descendant_count{};
+
+    // marks a sampled anchor timed under more than one parent, whose extrapolation can't be bounded by a parent
+    inline constexpr static uint32_t several_parents = ~uint32_t{ 0 };
+
+    // Every hit is timed except in sampled anchors, whose durations are extrapolated from the timed ones.
+    uint32_t sample_period{};
+    uint64_t timed_count{};
+
+    // The part of a sampled anchor's durations that stands for its untimed hits, the anchor it was charged to, and
+    // what the report took off where it came to more than that parent measured.
+    uint64_t extrapolated_duration{};
+    uint64_t trimmed_duration{};
+    uint32_t sampled_parent_index{};
+
+    // Mean and sum of squared deviations (Welford) of the timed hits' raw exclusive durations, exclusive so the
+    // hits of a recursive block are alike at every depth. Sampled anchors always keep them, for the error of their
+    // estimate; with PROFILER_VARIANCE every anchor does, for the confidence of report comparisons.
+    double timed_mean{};
+    double timed_m2{};
+
+#if PROFILER_COUNTERS
+    perf_counter_values exclusive_counters{};
+#endif
+
+#if PROFILER_ALLOCATIONS
+    uint64_t exclusive_allocation_count{};
+    uint64_t exclusive_allocated_bytes{};
+    uint64_t exclusive_minor_faults{};
+    uint64_t exclusive_major_faults{};
+
+    // the most live memory grew inside a single hit, children included
+    uint64_t peak_live_bytes{};
+#endif
 };
 
+// one completed block, in CPU timer ticks
+struct trace_event
+{
+    const char* name = nullptr;
+    uint64_t start_time{};
+    uint64_t end_time{};
+};
+
+// CPU ticks a block adds to its own duration (between its two timer reads), and to its parent's duration (its
+// whole constructor and destructor)
+struct profile_overhead
+{
+    double inner{};
+    double outer{};
+};
+
+// durations in CPU timer ticks with the profiler's own cost taken out
+struct compensated_durations
+{
+    double exclusive_duration{};
+    double inclusive_duration{};
+};
+
+// One distinct path of nested blocks, e.g. parse_element inside parse_array inside parse_element. Children are an
+// intrusive list, with 0 (the thread's root) marking the end.
+struct call_tree_node
+{
+    uint32_t anchor_index{};
+    uint32_t first_child{};
+    uint32_t next_sibling{};
+    uint64_t hit_count{};
+    uint64_t timed_count{};
+    uint64_t exclusive_duration{};
+    uint64_t inclusive_duration{};
+    uint64_t extrapolated_duration{};
+};
+
+// an anchor registered at run time; the name stays valid for the rest of the program
+struct named_anchor
+{
+    const char* name = nullptr;
+    uint32_t id{};
+};
+
+struct trace_summary
+{
+    uint64_t event_count{};
+    uint64_t dropped_count{};
+};
+
+class profile_block;
+
 class profiler
 {
     friend class profile_block;
 
+    template<uint32_t SamplePeriod>
+    friend class sampled_profile_block;
+
+public:
+#if PROFILER_TRACE
+    // events kept per thread while tracing; older events are overwritten once a thread records more
+    inline constexpr static size_t trace_capacity = size_t{ 1 } << 16;
+#endif
+
+#if PROFILER_CALL_TREE
+    // paths kept per thread; blocks on new paths past that are left out of the tree and count towards their parent
+    inline constexpr static uint32_t max_call_tree_nodes = 4096;
+    inline constexpr static uint32_t no_call_tree_node = ~uint32_t{ 0 };
+#endif
+
+    // Anchors recorded by one thread. Each thread gets its own table the first time it enters a profile block, so
+    // blocks never write to memory shared with another thread. Tables are aligned so two of them never share a
+    // cache line, and a table is handed to the next new thread once its owner exits. The anchors are indexed by id
+    // and sized to the anchors registered so far, growing when a block meets a newer one.
+    struct alignas(64) thread_profile
+    {
+        std::vector<profile_anchor> anchors;
+        uint32_t parent_index{};
+        uint32_t thread_index{};
+        uint64_t block_count{};
+
+#if PROFILER_VARIANCE
+        // innermost open block, which nested blocks charge their time to
+        profile_block* current_block = nullptr;
+#endif
+
+#if PROFILER_CALL_TREE
+        std::array<call_tree_node, max_call_tree_nodes> call_tree{};
+        uint32_t call_tree_size = 1;
+        uint32_t current_node{};
+#endif
+
+#if PROFILER_TRACE
+        // ring of the thread's most recent blocks, allocated only while tracing; written by the owning thread
+        // alone, so recording needs no locks or atomics
+        std::unique_ptr<trace_event[]> trace_events;
+        uint64_t trace_event_count{};
+#endif
+
+#if PROFILER_COUNTERS
+        // opened for whichever thread currently owns the table
+        perf_counter_group counters;
+#endif
+
+#if PROFILER_HISTOGRAMS
+        // indexed and sized like anchors; kept apart so copies of the anchors stay small
+        std::vector<latency_histogram> latencies;
+#endif
+    };
+
 private:
     inline static uint64_t overall_start_time{};
     inline static uint64_t overall_end_time{};
 
-    inline constexpr static size_t max_anchors = 1024;
-    inline static std::array<profile_anchor, max_anchors> anchors{};
+    inline static thread_local thread_profile* local_profile = nullptr;
+
+#if PROFILER_TRACE
+    inline static bool tracing = false;
+#endif
+
+    // an atomic only so blocks reload it each time rather than the compiler folding the test out of a loop
+    inline static std::atomic<bool> enabled = false;
+
+    inline static profile_overhead block_overhead{};
+
+    inline static std::vector<memory_level> memory_levels;
+
+    // times empty blocks on a scratch table
+    static void calibrate_overhead();
+
+    static thread_profile& register_thread();
+
+    // sizes the thread's tables for every anchor registered so far; under the registry lock, so merging never
+    // reads a table while it moves
+    static void grow_thread_profile(thread_profile& profile);
+
+#if PROFILER_CALL_TREE
+    // the current node's child for the anchor, added if the path is new
+    static uint32_t enter_call_tree_node(thread_profile& profile, uint32_t anchor_index)
+    {
+        call_tree_node* nodes = profile.call_tree.data();
+        const uint32_t parent = profile.current_node;
+
+        for (uint32_t child = nodes[parent].first_child; child; child = nodes[child].next_sibling)
+        {
+            if (nodes[child].anchor_index == anchor_index)
+                return child;
+        }
+
+        if (profile.call_tree_size == max_call_tree_nodes) [[unlikely]]
+            return no_call_tree_node;
+
+        const uint32_t child = profile.call_tree_size++;
+        nodes[child] = { .anchor_index = anchor_index, .next_sibling = nodes[parent].first_child };
+        nodes[parent].first_child = child;
+
+        return child;
+    }
+#endif
+
+    static thread_profile& get_thread_profile(uint32_t anchor_index)
+    {
+        thread_profile* profile = local_profile;
+        if (!profile) [[unlikely]]
+            profile = &register_thread();
+
+        if (anchor_index >= profile->anchors.size()) [[unlikely]]
+            grow_thread_profile(*profile);
+
+        return *profile;
+    }
 
 public:
-    static std::array<profile_anchor, max_anchors>& get_anchors()
+    // Turns profiling on for the rest of the run. Until then profile blocks only test a flag, so a profiler build
+    // can run at close to full speed and still be profiled on demand. Call before any profiled code runs.
+    static void enable()
+    {
+        enabled.store(true, std::memory_order_relaxed);
+    }
+
+    static bool is_enabled()
     {
-        return anchors;
+        return enabled.load(std::memory_order_relaxed);
     }
 
+    // true when the HAVERSINE_PROFILE environment variable is set to anything but 0
+    static bool is_requested_by_environment();
+
+    // Registers an anchor named at run time, or returns the one already registered under the name. Takes a lock,
+    // so register once per name and keep the result; blocks then find the anchor by id like any other.
+    static named_anchor register_anchor(std::string_view name);
+
+    // Prints note on its own line under the named anchor in the merged report, for figures the caller works out
+    // itself, such as a cache's hit rate. A later note for the same anchor replaces the earlier one.
+    static void annotate_anchor(std::string_view anchor_name, std::string note);
+
+    // ids handed out so far, the reserved 0 included
+    static uint32_t get_anchor_count()
+    {
+        return detail::anchor_id_counter.load(std::memory_order_relaxed);
+    }
+
+    // anchors summed over every thread, indexed by id; only meaningful once the profiled loops have returned
+    static std::vector<profile_anchor> get_anchors();
+
+    static size_t get_thread_count();
+
+#if PROFILER_HISTOGRAMS
+    // histograms summed over every thread, indexed like get_anchors
+    static std::vector<latency_histogram> get_latencies();
+#endif
+
+    static profile_overhead get_block_overhead()
+    {
+        return block_overhead;
+    }
+
+    // the anchor's durations as the report prints them, without the overhead of its own and nested blocks
+    static compensated_durations get_compensated_durations(const profile_anchor& anchor);
+
     static uint64_t get_overall_duration()
     {
         return overall_end_time - overall_start_time;
@@ -93,6 +401,11 @@ public:
 
     static void start_profiling()
     {
+#if PROFILER
+        if (is_enabled())
+            calibrate_overhead();
+#endif
+
         overall_start_time = READ_BLOCK_TIMER();
     }
 
@@ -102,56 +415,264 @@ public:
     }
 
     static void print_results();
+
+    // The measured memory hierarchy, smallest level first. Once set, the report shows every anchor that counts its
+    // data as a fraction of the read bandwidth of the smallest level all of its data fits in: its roofline. The
+    // anchor's time is summed over threads, so this is against one core's bandwidth.
+    static void set_memory_levels(std::vector<memory_level> levels)
+    {
+        memory_levels = std::move(levels);
+    }
+
+    static const std::vector<memory_level>& get_memory_levels()
+    {
+        return memory_levels;
+    }
+
+#if PROFILER_TRACE
+    // Records every block's start and end into its thread's trace ring from now on. Call before the profiled
+    // threads start; the trace can be written once their work has finished.
+    static void enable_tracing();
+
+    // writes the recorded blocks as Chrome Trace Event JSON, for Perfetto or chrome://tracing
+    static trace_summary write_trace(const char* path);
+#endif
+
+#if PROFILER_CALL_TREE
+    // Writes the call tree merged over every thread as folded stacks ("outer;inner;leaf nanoseconds" per line), the
+    // input of flamegraph.pl, speedscope and similar tools. Returns the number of stacks written.
+    static size_t write_folded_stacks(const char* path);
+#endif
 };
 
-// Records the duration of a block of code in CPU time. Not thread-safe.
+// Records the duration of a block of code in CPU time into the calling thread's anchor table.
 class profile_block final
 {
 private:
+    profiler::thread_profile* m_profile = nullptr;
     const char* m_operation_name = nullptr;
     uint64_t m_start_time{};
     uint64_t m_prev_inclusive_duration{};
     uint64_t m_data_processed{};
+    uint64_t m_prev_descendant_count{};
+    uint64_t m_start_block_count{};
     uint32_t m_parent_index{};
     uint32_t m_anchor_index{};
+    uint32_t m_sample_period{};
+
+#if PROFILER_CALL_TREE
+    uint32_t m_parent_node{};
+    uint32_t m_node{};
+#endif
 
-    inline static uint32_t m_global_parent_index = 0;
+#if PROFILER_VARIANCE
+    profile_block* m_parent_block = nullptr;
+    uint64_t m_child_duration{};
+#endif
+
+#if PROFILER_COUNTERS
+    perf_counter_values m_start_counters{};
+#endif
+
+#if PROFILER_ALLOCATIONS
+    allocation_counters m_start_allocations{};
+    page_fault_counts m_start_faults{};
+    int64_t m_outer_peak_live_bytes{};
+#endif
 
     using p = profiler;
 
+    // Welford's update with one more timed hit, which timed_count already counts
+    static void add_timed_hit(profile_anchor& anchor, uint64_t hit_duration)
+    {
+        const double delta = static_cast<double>(hit_duration) - anchor.timed_mean;
+        anchor.timed_mean += delta / static_cast<double>(anchor.timed_count);
+        anchor.timed_m2 += delta * (static_cast<double>(hit_duration) - anchor.timed_mean);
+    }
+
 public:
-    profile_block(const char* operation_name, uint32_t anchor_index, uint64_t data_processed)
+    // a nonzero sample_period marks a timed hit of a sampled block, which stands for the hits since the last one
+    profile_block(const char* operation_name, uint32_t anchor_index, uint64_t data_processed, uint32_t sample_period = 0)
     {
-        assert(anchor_index < p::max_anchors, "Too many profile anchors");
+        if (!p::is_enabled())
+            return;
 
-        m_parent_index = m_global_parent_index;
+        m_profile = &p::get_thread_profile(anchor_index);
+        m_parent_index = m_profile->parent_index;
         m_anchor_index = anchor_index;
         m_operation_name = operation_name;
         m_data_processed = data_processed;
+        m_sample_period = sample_period;
 
-        const profile_anchor& anchor = p::anchors[m_anchor_index];
+        const profile_anchor& anchor = m_profile->anchors[m_anchor_index];
         m_prev_inclusive_duration = anchor.inclusive_duration;
+        m_prev_descendant_count = anchor.descendant_count;
+        m_start_block_count = m_profile->block_count;
+
+        m_profile->parent_index = m_anchor_index;
+
+#if PROFILER_VARIANCE
+        m_parent_block = m_profile->current_block;
+        m_profile->current_block = this;
+#endif
+
+#if PROFILER_CALL_TREE
+        m_parent_node = m_profile->current_node;
+        m_node = p::enter_call_tree_node(*m_profile, m_anchor_index);
+        if (m_node != p::no_call_tree_node)
+            m_profile->current_node = m_node;
+#endif
+
+#if PROFILER_COUNTERS
+        m_start_counters = m_profile->counters.read();
+#endif
+
+#if PROFILER_ALLOCATIONS
+        // the thread's high-water mark restarts at the current live bytes, so on exit it holds this block's peak
+        m_start_faults = read_page_faults();
+        m_start_allocations = thread_allocations;
+        m_outer_peak_live_bytes = thread_allocations.peak_live_bytes;
+        thread_allocations.peak_live_bytes = thread_allocations.live_bytes;
+#endif
 
-        m_global_parent_index = m_anchor_index;
         m_start_time = READ_BLOCK_TIMER();
     }
 
     ~profile_block()
     {
+        // disabled, or the profiler was enabled while the block was open
+        if (!m_profile)
+            return;
+
         const uint64_t end_time = READ_BLOCK_TIMER();
         const uint64_t elapsed_time = end_time - m_start_time;
 
-        m_global_parent_index = m_parent_index;
+#if PROFILER_COUNTERS
+        const perf_counter_values end_counters = m_profile->counters.read();
+#endif
+
+#if PROFILER_ALLOCATIONS
+        const allocation_counters end_allocations = thread_allocations;
+        const page_fault_counts end_faults = read_page_faults();
+        thread_allocations.peak_live_bytes = std::max(m_outer_peak_live_bytes, end_allocations.peak_live_bytes);
+#endif
+
+        m_profile->parent_index = m_parent_index;
+
+#if PROFILER_VARIANCE
+        m_profile->current_block = m_parent_block;
+#endif
+
+        profile_anchor& anchor = m_profile->anchors[m_anchor_index];
+        uint64_t sample_weight = 1;
+        uint64_t extrapolated_time = 0;
+
+        if (m_sample_period)
+        {
+            // the first sample only stands for itself, so blocks hit fewer times than the period still get timed
+            sample_weight = anchor.timed_count ? m_sample_period : 1;
+
+            // the untimed hits ran without the timer reads a timed hit carries, so they are estimated without them
+            const uint64_t untimed_hit_time = elapsed_time - std::min(static_cast<uint64_t>(p::block_overhead.inner), elapsed_time);
+            extrapolated_time = (sample_weight - 1) * untimed_hit_time;
+            anchor.extrapolated_duration += extrapolated_time;
+
+            if (!anchor.timed_count)
+                anchor.sampled_parent_index = m_parent_index;
+            else if (anchor.sampled_parent_index != m_parent_index)
+                anchor.sampled_parent_index = profile_anchor::several_parents;
+
+            anchor.sample_period = m_sample_period;
+        }
+
+        const uint64_t weighted_time = elapsed_time + extrapolated_time;
+
+        ++anchor.timed_count;
 
-        profile_anchor& parent = p::anchors[m_parent_index];
-        parent.exclusive_duration -= elapsed_time;
+#if PROFILER_VARIANCE
+        if (m_parent_block)
+            m_parent_block->m_child_duration += weighted_time;
 
-        profile_anchor& anchor = p::anchors[m_anchor_index];
-        anchor.exclusive_duration += elapsed_time;
-        anchor.inclusive_duration = m_prev_inclusive_duration + elapsed_time;
+        add_timed_hit(anchor, elapsed_time - std::min(m_child_duration, elapsed_time));
+#else
+        // sampled blocks are leaves, so a hit's elapsed time is its exclusive time
+        if (m_sample_period)
+            add_timed_hit(anchor, elapsed_time);
+#endif
+
+        profile_anchor& parent = m_profile->anchors[m_parent_index];
+        parent.exclusive_duration -= weighted_time;
+        ++parent.child_count;
+
+        anchor.exclusive_duration += weighted_time;
+        anchor.inclusive_duration = m_prev_inclusive_duration + weighted_time;
         ++anchor.hit_count;
         anchor.data_processed += m_data_processed;
+        anchor.descendant_count = m_prev_descendant_count + (m_profile->block_count - m_start_block_count);
         anchor.name = m_operation_name;
+
+#if PROFILER_HISTOGRAMS
+        m_profile->latencies[m_anchor_index].add(elapsed_time);
+#endif
+
+#if PROFILER_CALL_TREE
+        if (m_node != p::no_call_tree_node)
+        {
+            call_tree_node& node = m_profile->call_tree[m_node];
+            ++node.hit_count;
+            ++node.timed_count;
+            node.exclusive_duration += weighted_time;
+            node.inclusive_duration += weighted_time;
+            node.extrapolated_duration += extrapolated_time;
+
+            m_profile->call_tree[m_parent_node].exclusive_duration -= weighted_time;
+            m_profile->current_node = m_parent_node;
+        }
+#endif
+
+        ++m_profile->block_count;
+
+#if PROFILER_TRACE
+        if (m_profile->trace_events)
+        {
+            trace_event& event = m_profile->trace_events[m_profile->trace_event_count++ & (p::trace_capacity - 1)];
+            event = { m_operation_name, m_start_time, end_time };
+        }
+#endif
+
+#if PROFILER_COUNTERS
+        for (size_t i = 0; i < perf_counter_count; ++i)
+        {
+            const uint64_t counter_delta = sample_weight * (end_counters[i] - m_start_counters[i]);
+            parent.exclusive_counters[i] -= counter_delta;
+            anchor.exclusive_counters[i] += counter_delta;
+        }
+#endif
+
+#if PROFILER_ALLOCATIONS
+        const uint64_t allocation_delta = sample_weight * (end_allocations.allocation_count - m_start_allocations.allocation_count);
+        const uint64_t allocated_bytes_delta = sample_weight * (end_allocations.allocated_bytes - m_start_allocations.allocated_bytes);
+        const uint64_t minor_faults_delta = sample_weight * (end_faults.minor_faults - m_start_faults.minor_faults);
+        const uint64_t major_faults_delta = sample_weight * (end_faults.major_faults - m_start_faults.major_faults);
+
+        parent.exclusive_allocation_count -= allocation_delta;
+        parent.exclusive_allocated_bytes -= allocated_bytes_delta;
+        parent.exclusive_minor_faults -= minor_faults_delta;
+        parent.exclusive_major_faults -= major_faults_delta;
+
+        anchor.exclusive_allocation_count += allocation_delta;
+        anchor.exclusive_allocated_bytes += allocated_bytes_delta;
+        anchor.exclusive_minor_faults += minor_faults_delta;
+        anchor.exclusive_major_faults += major_faults_delta;
+
+        const int64_t peak_growth = end_allocations.peak_live_bytes - m_start_allocations.live_bytes;
+        anchor.peak_live_bytes = std::max(anchor.peak_live_bytes, static_cast<uint64_t>(std::max<int64_t>(peak_growth, 0)));
+#endif
+    }
+
+    profile_block(const named_anchor& anchor, uint64_t data_processed)
+        : profile_block{ anchor.name, anchor.id, data_processed }
+    {
     }
 
     profile_block(const profile_block&) = delete;
@@ -160,4 +681,49 @@ public:
     profile_block& operator=(profile_block&&) noexcept = delete;
 };
 
+// Counts every hit and its data, but times only the first hit and every SamplePeriod-th one after it. Each timed
+// hit is weighted by the hits it stands for, so the anchor and its parent get extrapolated durations. Blocks nested
+// in an untimed hit are attributed to the enclosing block instead, so this is meant for leaf blocks.
+template<uint32_t SamplePeriod>
+class sampled_profile_block final
+{
+    static_assert(SamplePeriod > 0, "The sample period must be at least 1");
+
+private:
+    std::optional<profile_block> m_timed_block;
+
+    using p = profiler;
+
+public:
+    sampled_profile_block(const char* operation_name, uint32_t anchor_index, uint64_t data_processed)
+    {
+        if (!p::is_enabled())
+            return;
+
+        p::thread_profile& profile = p::get_thread_profile(anchor_index);
+        profile_anchor& anchor = profile.anchors[anchor_index];
+
+        if (anchor.hit_count % SamplePeriod == 0)
+        {
+            m_timed_block.emplace(operation_name, anchor_index, data_processed, SamplePeriod);
+            return;
+        }
+
+        ++anchor.hit_count;
+        anchor.data_processed += data_processed;
+
+#if PROFILER_CALL_TREE
+        // the hit still belongs to its path, though only timed hits enter it
+        const uint32_t node = p::enter_call_tree_node(profile, anchor_index);
+        if (node != p::no_call_tree_node)
+            ++profile.call_tree[node].hit_count;
+#endif
+    }
+
+    sampled_profile_block(const sampled_profile_block&) = delete;
+    sampled_profile_block& operator=(const sampled_profile_block&) = delete;
+    sampled_profile_block(sampled_profile_block&&) noexcept = delete;
+    sampled_profile_block& operator=(sampled_profile_block&&) noexcept = delete;
+};
+
 #endif
@@ -0,0 +1,305 @@
+#include "spatial_index.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+#include <limits>
+#include <numbers>
+#include <queue>
+#include <utility>
+
+#include "distance_kernels.hpp"
+#include "parallel.hpp"
+#include "profiler.hpp"
+
+namespace
+{
+    // deep enough for 2^32 points with 16-point leaves, since median splits keep the tree balanced
+    constexpr size_t max_tree_depth = 64;
+
+    std::array<double, 3> to_unit_vector(globe_point point)
+    {
+        const chord_kernel::point_data v = chord_kernel::prepare(point);
+        return { v.x, v.y, v.z };
+    }
+
+    double chord_squared(const std::array<double, 3>& a, const std::array<double, 3>& b)
+    {
+        const double dx = a[0] - b[0];
+        const double dy = a[1] - b[1];
+        const double dz = a[2] - b[2];
+
+        return dx * dx + dy * dy + dz * dz;
+    }
+
+    // matches the layout produced by build_node: a leaf, or a node followed by its two median-split subtrees
+    size_t subtree_node_count(size_t point_count)
+    {
+        if (point_count <= spatial_index::leaf_size)
+            return 1;
+
+        const size_t left_count = point_count / 2;
+        return 1 + subtree_node_count(left_count) + subtree_node_count(point_count - left_count);
+    }
+
+    void sort_by_distance(std::vector<spatial_neighbor>& neighbors)
+    {
+        std::ranges::sort(neighbors, [](const spatial_neighbor& a, const spatial_neighbor& b)
+        {
+            return a.distance < b.distance || (a.distance == b.distance && a.index < b.index);
+        });
+    }
+}
+
+spatial_index::spatial_index(std::span<const globe_point> points, unsigned thread_count, double earth_radius)
+    : m_earth_radius{ earth_radius }
+{
+    PROFILE_DATA_FUNCTION(points.size() * sizeof(globe_point));
+
+    if (points.size() >= std::numeric_limits<uint32_t>::max())
+        throw std::runtime_error{ "Too many points for the spatial index." };
+
+    if (points.empty())
+        return;
+
+    if (thread_count == 0)
+        thread_count = default_thread_count();
+
+    m_points.resize(points.size());
+
+    parallel_for(points.size(), thread_count, [&](size_t begin, size_t end)
+    {
+        for (size_t i = begin; i < end; ++i)
+            m_points[i] = { .position = to_unit_vector(points[i]), .index = static_cast<uint32_t>(i) };
+    });
+
+    m_nodes.resize(subtree_node_count(points.size()));
+
+    const auto point_count = static_cast<uint32_t>(points.size());
+
+    if (thread_count == 1)
+    {
+        build_node(0, 0, point_count, nullptr, 0);
+        return;
+    }
+
+    // split the top of the tree serially until there are a few subtrees per thread, then build those in parallel
+    const size_t spawn_size = std::max<size_t>(leaf_size, points.size() / (4 * static_cast<size_t>(thread_count)));
+
+    std::vector<build_task> tasks;
+    build_node(0, 0, point_count, &tasks, spawn_size);
+
+    parallel_for(tasks.size(), thread_count, [&](size_t begin, size_t end)
+    {
+        for (size_t i = begin; i < end; ++i)
+            build_node(tasks[i].node_index, tasks[i].begin, tasks[i].end, nullptr, 0);
+    });
+}
+
+void spatial_index::build_node(uint32_t node_index, uint32_t begin, uint32_t end, std::vector<build_task>* deferred_tasks, size_t spawn_size)
+{
+    const uint32_t count = end - begin;
+
+    if (count > leaf_size && deferred_tasks && count <= spawn_size)
+    {
+        deferred_tasks->push_back({ .node_index = node_index, .begin = begin, .end = end });
+        return;
+    }
+
+    node& current = m_nodes[node_index];
+    current.begin = begin;
+    current.end = end;
+
+    if (count <= leaf_size)
+        return;
+
+    // split along the axis with the largest spread
+    std::array<double, 3> min_position = m_points[begin].position;
+    std::array<double, 3> max_position = m_points[begin].position;
+
+    for (uint32_t i = begin + 1; i < end; ++i)
+    {
+        for (size_t axis = 0; axis < 3; ++axis)
+        {
+            min_position[axis] = std::min(min_position[axis], m_points[i].position[axis]);
+            max_position[axis] = std::max(max_position[axis], m_points[i].position[axis]);
+        }
+    }
+
+    uint8_t axis = 0;
+    for (uint8_t a = 1; a < 3; ++a)
+    {
+        if (max_position[a] - min_position[a] > max_position[axis] - min_position[axis])
+            axis = a;
+    }
+
+    const uint32_t middle = begin + count / 2;
+    std::nth_element(m_points.begin() + begin, m_points.begin() + middle, m_points.begin() + end,
+                     [axis](const indexed_point& a, const indexed_point& b) { return a.position[axis] < b.position[axis]; });
+
+    const auto left_child = node_index + 1;
+    const auto right_child = static_cast<uint32_t>(left_child + subtree_node_count(middle - begin));
+
+    current.axis = axis;
+    current.split = m_points[middle].position[axis];
+    current.right_child = right_child;
+
+    build_node(left_child, begin, middle, deferred_tasks, spawn_size);
+    build_node(right_child, middle, end, deferred_tasks, spawn_size);
+}
+
+double spatial_index::to_distance(double chord_squared) const
+{
+    return 2.0 * m_earth_radius * std::asin(std::min(std::sqrt(chord_squared) / 2.0, 1.0));
+}
+
+std::vector<spatial_neighbor> spatial_index::within_radius(globe_point query, double radius) const
+{
+    std::vector<spatial_neighbor> neighbors;
+    if (m_nodes.empty() || radius < 0.0)
+        return neighbors;
+
+    // anything at or beyond half the circumference is every point on the globe
+    const double angle = radius / m_earth_radius;
+    const double max_chord_squared = angle >= std::numbers::pi ? 4.0 : 4.0 * std::pow(std::sin(angle / 2.0), 2.0);
+
+    const std::array<double, 3> position = to_unit_vector(query);
+
+    std::array<uint32_t, max_tree_depth> stack;
+    size_t stack_size = 0;
+    stack[stack_size++] = 0;
+
+    while (stack_size)
+    {
+        const node& current = m_nodes[stack[--stack_size]];
+
+        if (!current.right_child)
+        {
+            for (uint32_t i = current.begin; i < current.end; ++i)
+            {
+                const double distance_squared = chord_squared(position, m_points[i].position);
+                if (distance_squared <= max_chord_squared)
+                    neighbors.push_back({ .index = m_points[i].index, .distance = to_distance(distance_squared) });
+            }
+
+            continue;
+        }
+
+        const double plane_distance = position[current.axis] - current.split;
+        const uint32_t left_child = static_cast<uint32_t>(&current - m_nodes.data()) + 1;
+        const uint32_t near_child = plane_distance < 0.0 ? left_child : current.right_child;
+        const uint32_t far_child = plane_distance < 0.0 ? current.right_child : left_child;
+
+        if (plane_distance * plane_distance <= max_chord_squared)
+            stack[stack_size++] = far_child;
+
+        stack[stack_size++] = near_child;
+    }
+
+    sort_by_distance(neighbors);
+    return neighbors;
+}
+
+std::vector<spatial_neighbor> spatial_index::nearest(globe_point query, size_t k) const
+{
+    std::vector<spatial_neighbor> neighbors;
+    if (m_nodes.empty() || k == 0)
+        return neighbors;
+
+    const std::array<double, 3> position = to_unit_vector(query);
+
+    // max-heap on chord distance, so the current k-th nearest candidate is on top
+    std::priority_queue<std::pair<double, uint32_t>> candidates;
+    auto worst_distance = [&]
+    {
+        return candidates.size() < k ? std::numeric_limits<double>::infinity() : candidates.top().first;
+    };
+
+    struct stack_entry
+    {
+        uint32_t node_index{};
+        double min_distance_squared{};
+    };
+
+    std::array<stack_entry, max_tree_depth> stack;
+    size_t stack_size = 0;
+    stack[stack_size++] = { 0, 0.0 };
+
+    while (stack_size)
+    {
+        const stack_entry entry = stack[--stack_size];
+        if (entry.min_distance_squared > worst_distance())
+            continue;
+
+        const node& current = m_nodes[entry.node_index];
+
+        if (!current.right_child)
+        {
+            for (uint32_t i = current.begin; i < current.end; ++i)
+            {
+                const double distance_squared = chord_squared(position, m_points[i].position);
+
+                if (candidates.size() < k)
+                {
+                    candidates.emplace(distance_squared, i);
+                }
+                else if (distance_squared < candidates.top().first)
+                {
+                    candidates.pop();
+                    candidates.emplace(distance_squared, i);
+                }
+            }
+
+            continue;
+        }
+
+        const double plane_distance = position[current.axis] - current.split;
+        const uint32_t left_child = entry.node_index + 1;
+        const uint32_t near_child = plane_distance < 0.0 ? left_child : current.right_child;
+        const uint32_t far_child = plane_distance < 0.0 ? current.right_child : left_child;
+
+        stack[stack_size++] = { far_child, plane_distance * plane_distance };
+        stack[stack_size++] = { near_child, entry.min_distance_squared };
+    }
+
+    neighbors.reserve(candidates.size());
+    while (!candidates.empty())
+    {
+        const auto [distance_squared, i] = candidates.top();
+        neighbors.push_back({ .index = m_points[i].index, .distance = to_distance(distance_squared) });
+        candidates.pop();
+    }
+
+    sort_by_distance(neighbors);
+    return neighbors;
+}
+
+std::vector<std::vector<spatial_neighbor>> spatial_index::within_radius(std::span<const globe_point> queries, double radius, unsigned thread_count) const
+{
+    PROFILE_DATA_FUNCTION(queries.size() * sizeof(globe_point));
+
+    std::vector<std::vector<spatial_neighbor>> results(queries.size());
+
+    parallel_for(queries.size(), thread_count, [&](size_t begin, size_t end)
+    {
+        for (size_t i = begin; i < end; ++i)
+            results[i] = within_radius(queries[i], radius);
+    });
+
+    return results;
+}
+
+std::vector<std::vector<spatial_neighbor>> spatial_index::nearest(std::span<const globe_point> queries, size_t k, unsigned thread_count) const
+{
+    PROFILE_DATA_FUNCTION(queries.size() * sizeof(globe_point));
+
+    std::vector<std::vector<spatial_neighbor>> results(queries.size());
+
+    parallel_for(queries.size(), thread_count, [&](size_t begin, size_t end)
+    {
+        for (size_t i = begin; i < end; ++i)
+            results[i] = nearest(queries[i], k);
+    });
+
+    return results;
+}
@@ -0,0 +1,74 @@
+﻿#ifndef WS_SPATIALINDEX_HPP
+#define WS_SPATIALINDEX_HPP
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+#include "haversine_formula.hpp"
+
+struct spatial_neighbor
+{
+    uint32_t index{};
+    double distance{};
+};
+
+// K-d tree over the 3D unit vectors of a point set. Straight-line (chord) distance between unit vectors grows
+// monotonically with great-circle distance, so the tree can be searched in 3D with no special cases for the
+// poles or the antimeridian, and results are converted back to great-circle distances.
+//
+// Nodes live in one flat array in depth-first order: a node's left child is the next node and only the right
+// child's index is stored. Leaves reference a contiguous range of the reordered point array.
+class spatial_index
+{
+private:
+    struct indexed_point
+    {
+        std::array<double, 3> position{};
+        uint32_t index{};
+    };
+
+    struct node
+    {
+        double split{};
+        uint32_t begin{};
+        uint32_t end{};
+        uint32_t right_child{}; // 0 for leaves
+        uint8_t axis{};
+    };
+
+    std::vector<indexed_point> m_points;
+    std::vector<node> m_nodes;
+    double m_earth_radius{};
+
+    struct build_task
+    {
+        uint32_t node_index{};
+        uint32_t begin{};
+        uint32_t end{};
+    };
+
+    void build_node(uint32_t node_index, uint32_t begin, uint32_t end, std::vector<build_task>* deferred_tasks, size_t spawn_size);
+
+    double to_distance(double chord_squared) const;
+
+public:
+    static constexpr uint32_t leaf_size = 16;
+
+    explicit spatial_index(std::span<const globe_point> points, unsigned thread_count = 0, double earth_radius = default_earth_radius);
+
+    size_t size() const { return m_points.size(); }
+
+    // every indexed point within radius (same unit as the earth radius) of the query, nearest first
+    std::vector<spatial_neighbor> within_radius(globe_point query, double radius) const;
+
+    // the k indexed points nearest to the query, nearest first
+    std::vector<spatial_neighbor> nearest(globe_point query, size_t k) const;
+
+    std::vector<std::vector<spatial_neighbor>> within_radius(std::span<const globe_point> queries, double radius, unsigned thread_count = 0) const;
+    std::vector<std::vector<spatial_neighbor>> nearest(std::span<const globe_point> queries, size_t k, unsigned thread_count = 0) const;
+};
+
+#endif
@@ -0,0 +1,296 @@
+#include "spatial_join.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+#include <limits>
+#include <numbers>
+#include <numeric>
+
+#include "distance_kernels.hpp"
+#include "parallel.hpp"
+#include "profiler.hpp"
+
+namespace
+{
+    // lat/lon grid with square cells (in degrees) at least as tall as the join distance, so matches for a point
+    // can only be in its own row or the rows directly above and below it
+    struct join_grid
+    {
+        double cell_degrees{};
+        uint32_t rows{};
+        uint32_t columns{};
+
+        uint32_t row_of(double lat) const
+        {
+            const auto row = static_cast<int64_t>(std::floor((lat + 90.0) / cell_degrees));
+            return static_cast<uint32_t>(std::clamp<int64_t>(row, 0, rows - 1));
+        }
+
+        uint32_t column_of(double lon) const
+        {
+            const auto column = static_cast<int64_t>(std::floor((lon + 180.0) / cell_degrees));
+            const int64_t wrapped = column % columns;
+            return static_cast<uint32_t>(wrapped < 0 ? wrapped + columns : wrapped);
+        }
+    };
+
+    join_grid make_grid(double angle_degrees)
+    {
+        // keep row and column numbers within 24 bits so the Morton keys stay well inside 64 bits, and round the cell
+        // size up so a whole number of columns wraps around the globe
+        constexpr double min_cell_degrees = 360.0 / (1 << 24);
+        const auto columns = static_cast<uint32_t>(std::max(1.0, std::floor(360.0 / std::max(angle_degrees, min_cell_degrees))));
+        const double cell_degrees = 360.0 / columns;
+
+        return
+        {
+            .cell_degrees = cell_degrees,
+            .rows = static_cast<uint32_t>(std::ceil(180.0 / cell_degrees)),
+            .columns = columns
+        };
+    }
+
+    uint64_t spread_bits(uint32_t value)
+    {
+        uint64_t x = value;
+        x = (x | (x << 16)) & 0x0000ffff0000ffffULL;
+        x = (x | (x << 8)) & 0x00ff00ff00ff00ffULL;
+        x = (x | (x << 4)) & 0x0f0f0f0f0f0f0f0fULL;
+        x = (x | (x << 2)) & 0x3333333333333333ULL;
+        x = (x | (x << 1)) & 0x5555555555555555ULL;
+
+        return x;
+    }
+
+    uint64_t morton_key(uint32_t row, uint32_t column)
+    {
+        return (spread_bits(row) << 1) | spread_bits(column);
+    }
+
+    // widest longitude difference (in degrees) between a point at the given latitude and any point within the
+    // angular distance; 180 once the search circle reaches a pole
+    double max_longitude_offset(double lat_degrees, double angle_radians)
+    {
+        constexpr double degrees_per_radian = 180.0 / std::numbers::pi;
+
+        const double cos_lat = std::cos(lat_degrees / degrees_per_radian);
+        const double sin_angle = std::sin(angle_radians);
+
+        if (angle_radians >= std::numbers::pi / 2.0 || cos_lat <= sin_angle)
+            return 180.0;
+
+        return degrees_per_radian * std::asin(sin_angle / cos_lat);
+    }
+
+    double wrapped_longitude_difference(double lon1, double lon2)
+    {
+        const double difference = std::fmod(std::abs(lon2 - lon1), 360.0);
+        return difference > 180.0 ? 360.0 - difference : difference;
+    }
+
+    struct cell_run
+    {
+        uint32_t row{};
+        uint32_t column{};
+        uint32_t begin{};
+        uint32_t end{};
+    };
+
+    // a point set reordered by Morton key, with the contiguous run of points in every occupied cell
+    struct sorted_point_set
+    {
+        std::vector<globe_point> points;
+        std::vector<haversine_kernel::point_data> prepared;
+        std::vector<uint32_t> original_indices;
+        std::vector<cell_run> runs;           // sorted by Morton key
+        std::vector<cell_run> runs_by_row;    // sorted by (row, column)
+        std::vector<uint32_t> row_offsets;    // first entry of each row in runs_by_row
+
+        sorted_point_set(std::span<const globe_point> source, const join_grid& grid)
+        {
+            if (source.size() >= std::numeric_limits<uint32_t>::max())
+                throw std::runtime_error{ "Too many points for a spatial join." };
+
+            std::vector<uint64_t> keys(source.size());
+            for (size_t i = 0; i < source.size(); ++i)
+                keys[i] = morton_key(grid.row_of(source[i].y), grid.column_of(source[i].x));
+
+            original_indices.resize(source.size());
+            std::iota(original_indices.begin(), original_indices.end(), 0u);
+            std::ranges::stable_sort(original_indices, {}, [&keys](uint32_t i) { return keys[i]; });
+
+            points.reserve(source.size());
+            prepared.reserve(source.size());
+
+            for (const uint32_t i : original_indices)
+            {
+                points.push_back(source[i]);
+                prepared.push_back(haversine_kernel::prepare(source[i]));
+            }
+
+            for (uint32_t begin = 0; begin < points.size();)
+            {
+                const uint64_t key = keys[original_indices[begin]];
+
+                uint32_t end = begin + 1;
+                while (end < points.size() && keys[original_indices[end]] == key)
+                    ++end;
+
+                runs.push_back({ .row = grid.row_of(points[begin].y), .column = grid.column_of(points[begin].x), .begin = begin, .end = end });
+                begin = end;
+            }
+
+            runs_by_row = runs;
+            std::ranges::sort(runs_by_row, [](const cell_run& a, const cell_run& b)
+            {
+                return a.row < b.row || (a.row == b.row && a.column < b.column);
+            });
+
+            row_offsets.assign(grid.rows + 1, 0);
+            for (const cell_run& run : runs_by_row)
+                ++row_offsets[run.row + 1];
+
+            std::partial_sum(row_offsets.begin(), row_offsets.end(), row_offsets.begin());
+        }
+
+        // calls visit for every occupied cell of the row with a column in [first_column, last_column]
+        template<typename Visitor>
+        void visit_columns(uint32_t row, uint32_t first_column, uint32_t last_column, Visitor&& visit) const
+        {
+            const auto row_begin = runs_by_row.begin() + row_offsets[row];
+            const auto row_end = runs_by_row.begin() + row_offsets[row + 1];
+
+            auto iter = std::lower_bound(row_begin, row_end, first_column, [](const cell_run& run, uint32_t column) { return run.column < column; });
+            for (; iter != row_end && iter->column <= last_column; ++iter)
+                visit(*iter);
+        }
+    };
+
+    std::vector<join_pair> join_sorted_sets(const sorted_point_set& first, const sorted_point_set& second, const join_grid& grid,
+                                            double max_distance, double earth_radius, unsigned thread_count, bool self_join)
+    {
+        constexpr double degrees_per_radian = 180.0 / std::numbers::pi;
+
+        const double angle_radians = max_distance / earth_radius;
+        const double angle_degrees = degrees_per_radian * angle_radians;
+
+        // per-point longitude window for the bounding-box prefilter
+        std::vector<double> longitude_offsets(first.points.size());
+        for (size_t i = 0; i < first.points.size(); ++i)
+            longitude_offsets[i] = max_longitude_offset(first.points[i].y, angle_radians);
+
+        std::vector<std::vector<join_pair>> run_results(first.runs.size());
+
+        parallel_for(first.runs.size(), thread_count, [&](size_t run_begin, size_t run_end)
+        {
+            for (size_t run_index = run_begin; run_index < run_end; ++run_index)
+            {
+                const cell_run& run = first.runs[run_index];
+                std::vector<join_pair>& results = run_results[run_index];
+
+                // the cell edge closest to a pole needs the widest longitude window
+                const double band_min = -90.0 + run.row * grid.cell_degrees;
+                const double band_max = std::min(90.0, band_min + grid.cell_degrees);
+                const double cell_offset = max_longitude_offset(std::max(std::abs(band_min), std::abs(band_max)), angle_radians);
+
+                const auto offset_columns = static_cast<int64_t>(std::ceil(cell_offset / grid.cell_degrees));
+                const int64_t first_column = static_cast<int64_t>(run.column) - offset_columns;
+                const int64_t last_column = static_cast<int64_t>(run.column) + offset_columns;
+
+                auto compare_cell = [&](const cell_run& candidates)
+                {
+                    for (uint32_t a = run.begin; a < run.end; ++a)
+                    {
+                        const globe_point& p1 = first.points[a];
+
+                        for (uint32_t b = candidates.begin; b < candidates.end; ++b)
+                        {
+                            const globe_point& p2 = second.points[b];
+
+                            if (self_join && first.original_indices[a] >= second.original_indices[b])
+                                continue;
+
+                            if (std::abs(p2.y - p1.y) > angle_degrees || wrapped_longitude_difference(p1.x, p2.x) > longitude_offsets[a])
+                                continue;
+
+                            const double distance = haversine_kernel::distance(first.prepared[a], second.prepared[b], earth_radius);
+                            if (distance <= max_distance)
+                                results.push_back({ .first = first.original_indices[a], .second = second.original_indices[b], .distance = distance });
+                        }
+                    }
+                };
+
+                const uint32_t row_begin = run.row > 0 ? run.row - 1 : 0;
+                const uint32_t row_end = std::min(grid.rows - 1, run.row + 1);
+
+                for (uint32_t row = row_begin; row <= row_end; ++row)
+                {
+                    if (last_column - first_column + 1 >= grid.columns)
+                    {
+                        second.visit_columns(row, 0, grid.columns - 1, compare_cell);
+                    }
+                    else if (first_column < 0)
+                    {
+                        second.visit_columns(row, static_cast<uint32_t>(first_column + grid.columns), grid.columns - 1, compare_cell);
+                        second.visit_columns(row, 0, static_cast<uint32_t>(last_column), compare_cell);
+                    }
+                    else if (last_column >= grid.columns)
+                    {
+                        second.visit_columns(row, static_cast<uint32_t>(first_column), grid.columns - 1, compare_cell);
+                        second.visit_columns(row, 0, static_cast<uint32_t>(last_column - grid.columns), compare_cell);
+                    }
+                    else
+                    {
+                        second.visit_columns(row, static_cast<uint32_t>(first_column), static_cast<uint32_t>(last_column), compare_cell);
+                    }
+                }
+            }
+        });
+
+        size_t pair_count = 0;
+        for (const std::vector<join_pair>& results : run_results)
+            pair_count += results.size();
+
+        std::vector<join_pair> pairs;
+        pairs.reserve(pair_count);
+
+        for (const std::vector<join_pair>& results : run_results)
+            pairs.insert(pairs.end(), results.begin(), results.end());
+
+        std::ranges::sort(pairs, [](const join_pair& a, const join_pair& b)
+        {
+            return a.first < b.first || (a.first == b.first && a.second < b.second);
+        });
+
+        return pairs;
+    }
+}
+
+std::vector<join_pair> spatial_join(std::span<const globe_point> first, std::span<const globe_point> second, double max_distance,
+                                    unsigned thread_count, double earth_radius)
+{
+    PROFILE_DATA_FUNCTION((first.size() + second.size()) * sizeof(globe_point));
+
+    if (max_distance < 0.0)
+        throw std::runtime_error{ "The join distance cannot be negative." };
+
+    const join_grid grid = make_grid(180.0 / std::numbers::pi * max_distance / earth_radius);
+    const sorted_point_set sorted_first{ first, grid };
+    const sorted_point_set sorted_second{ second, grid };
+
+    return join_sorted_sets(sorted_first, sorted_second, grid, max_distance, earth_radius, thread_count, false);
+}
+
+std::vector<join_pair> spatial_self_join(std::span<const globe_point> points, double max_distance, unsigned thread_count, double earth_radius)
+{
+    PROFILE_DATA_FUNCTION(points.size() * sizeof(globe_point));
+
+    if (max_distance < 0.0)
+        throw std::runtime_error{ "The join distance cannot be negative." };
+
+    const join_grid grid = make_grid(180.0 / std::numbers::pi * max_distance / earth_radius);
+    const sorted_point_set sorted_points{ points, grid };
+
+    return join_sorted_sets(sorted_points, sorted_points, grid, max_distance, earth_radius, thread_count, true);
+}
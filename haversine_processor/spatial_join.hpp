@@ -0,0 +1,29 @@
+﻿#ifndef WS_SPATIALJOIN_HPP
+#define WS_SPATIALJOIN_HPP
+
+#include <cstdint>
+#include <span>
+#include <vector>
+
+#include "haversine_formula.hpp"
+
+struct join_pair
+{
+    uint32_t first{};
+    uint32_t second{};
+    double distance{};
+};
+
+// Finds every (i, j) with the haversine distance between first[i] and second[j] at most max_distance, sorted by
+// (i, j). Both sets are bucketed into a lat/lon grid with cells max_distance tall and sorted by the cells' Morton
+// keys, so each cell is a contiguous run found by binary search. Each cell of the first set is then compared only
+// against the neighboring cells of the second set, with a latitude/longitude bounding-box test in front of the
+// exact distance. Cells of the first set are split across threads.
+std::vector<join_pair> spatial_join(std::span<const globe_point> first, std::span<const globe_point> second, double max_distance,
+                                    unsigned thread_count = 0, double earth_radius = default_earth_radius);
+
+// Same as spatial_join against itself, reporting each unordered pair once (i < j) and no self-pairs.
+std::vector<join_pair> spatial_self_join(std::span<const globe_point> points, double max_distance,
+                                         unsigned thread_count = 0, double earth_radius = default_earth_radius);
+
+#endif
@@ -0,0 +1,411 @@
+#include "task_scheduler.hpp"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <exception>
+#include <optional>
+
+#if _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#elif __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+namespace
+{
+    // Lazy splitting keeps each deque down to a range or two; a full one just stops splitting until it drains.
+    constexpr int64_t deque_capacity = 64;
+
+    // The smallest range a loop is cut into is this fraction of each thread's even share: fine enough to even out
+    // a straggler, coarse enough that the body's per-call setup stays noise.
+    constexpr size_t ranges_per_thread = 32;
+
+    // failed searches for work, yielding between them, before an idle worker sleeps
+    constexpr int idle_spin_count = 64;
+
+    std::atomic<task_scheduler*> active_scheduler{};
+
+    // the scheduler and deque of the loop the thread is working on, so a loop started from inside a body reuses them
+    thread_local const task_scheduler* current_scheduler = nullptr;
+    thread_local unsigned current_slot = 0;
+
+    // best effort; a thread that can't be pinned just keeps running unpinned
+    void pin_current_thread(unsigned hardware_thread)
+    {
+        hardware_thread %= default_thread_count();
+
+#if _WIN32
+        // affinity masks only reach the first processor group
+        if (hardware_thread < 64)
+            SetThreadAffinityMask(GetCurrentThread(), DWORD_PTR{ 1 } << hardware_thread);
+#elif __linux__
+        cpu_set_t cpus;
+        CPU_ZERO(&cpus);
+        CPU_SET(hardware_thread, &cpus);
+        pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus);
+#endif
+    }
+}
+
+struct task_scheduler::loop_job
+{
+    parallel_body body;
+    size_t grain{};
+
+    // indices not yet run; the thread that started the loop returns once this reaches 0
+    std::atomic<size_t> remaining{};
+
+    std::atomic<bool> failed{};
+    std::exception_ptr error;
+
+    // Runs [begin, end) unless an earlier range has thrown. Counting the range off is the last access to the job,
+    // since the thread that started the loop may return and destroy it as soon as nothing remains.
+    void run(size_t begin, size_t end)
+    {
+        if (!failed.load(std::memory_order_relaxed))
+        {
+            try
+            {
+                body.invoke(body.context, begin, end);
+            }
+            catch (...)
+            {
+                if (!failed.exchange(true))
+                    error = std::current_exception();
+            }
+        }
+
+        remaining.fetch_sub(end - begin, std::memory_order_acq_rel);
+    }
+};
+
+struct task_scheduler::loop_range
+{
+    loop_job* job = nullptr;
+    size_t begin{};
+    size_t end{};
+
+    // kept with the range so a thief can check them before it owns the range, while the job may already be gone
+    unsigned owner_slot{};
+    unsigned thread_limit{};
+
+    // the thread that started the loop, plus workers 1 to thread_limit - 1
+    bool may_run_on(unsigned slot) const
+    {
+        return slot == owner_slot || (slot > 0 && slot < thread_limit);
+    }
+};
+
+// Chase-Lev work-stealing deque of fixed capacity. The owner pushes and pops at the bottom without contention
+// until one range is left; thieves claim the top with a compare-exchange.
+class task_scheduler::range_deque
+{
+private:
+    // atomic fields, as a thief may read an entry the owner is reusing; the thief's claim then fails
+    struct entry
+    {
+        std::atomic<loop_job*> job{};
+        std::atomic<size_t> begin{};
+        std::atomic<size_t> end{};
+        std::atomic<unsigned> owner_slot{};
+        std::atomic<unsigned> thread_limit{};
+    };
+
+    alignas(64) std::atomic<int64_t> m_top{};
+    alignas(64) std::atomic<int64_t> m_bottom{};
+    alignas(64) std::array<entry, deque_capacity> m_entries{};
+
+    void store(int64_t index, const loop_range& range)
+    {
+        entry& slot = m_entries[static_cast<size_t>(index % deque_capacity)];
+
+        slot.job.store(range.job, std::memory_order_relaxed);
+        slot.begin.store(range.begin, std::memory_order_relaxed);
+        slot.end.store(range.end, std::memory_order_relaxed);
+        slot.owner_slot.store(range.owner_slot, std::memory_order_relaxed);
+        slot.thread_limit.store(range.thread_limit, std::memory_order_relaxed);
+    }
+
+    loop_range load(int64_t index) const
+    {
+        const entry& slot = m_entries[static_cast<size_t>(index % deque_capacity)];
+
+        return loop_range
+        {
+            .job = slot.job.load(std::memory_order_relaxed),
+            .begin = slot.begin.load(std::memory_order_relaxed),
+            .end = slot.end.load(std::memory_order_relaxed),
+            .owner_slot = slot.owner_slot.load(std::memory_order_relaxed),
+            .thread_limit = slot.thread_limit.load(std::memory_order_relaxed)
+        };
+    }
+
+public:
+    // owner only; false when the deque is full
+    bool push(const loop_range& range)
+    {
+        const int64_t bottom = m_bottom.load(std::memory_order_relaxed);
+        const int64_t top = m_top.load(std::memory_order_acquire);
+
+        if (bottom - top >= deque_capacity)
+            return false;
+
+        store(bottom, range);
+
+        std::atomic_thread_fence(std::memory_order_release);
+        m_bottom.store(bottom + 1, std::memory_order_relaxed);
+
+        return true;
+    }
+
+    // owner only
+    std::optional<loop_range> pop()
+    {
+        const int64_t bottom = m_bottom.load(std::memory_order_relaxed) - 1;
+        m_bottom.store(bottom, std::memory_order_relaxed);
+
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        int64_t top = m_top.load(std::memory_order_relaxed);
+
+        if (top > bottom)
+        {
+            m_bottom.store(bottom + 1, std::memory_order_relaxed);
+            return std::nullopt;
+        }
+
+        const loop_range range = load(bottom);
+
+        if (top == bottom)
+        {
+            // the last range, which a thief may be claiming at the same time
+            const bool claimed = m_top.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed);
+            m_bottom.store(bottom + 1, std::memory_order_relaxed);
+
+            if (!claimed)
+                return std::nullopt;
+        }
+
+        return range;
+    }
+
+    // any thread; takes the top range if the thief may run it
+    std::optional<loop_range> steal(unsigned thief_slot)
+    {
+        int64_t top = m_top.load(std::memory_order_acquire);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        const int64_t bottom = m_bottom.load(std::memory_order_acquire);
+
+        if (top >= bottom)
+            return std::nullopt;
+
+        // a torn read means the entry has been reused, which also makes the claim fail
+        const loop_range range = load(top);
+        if (!range.may_run_on(thief_slot))
+            return std::nullopt;
+
+        if (!m_top.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+            return std::nullopt;
+
+        return range;
+    }
+
+    // owner only
+    bool empty() const
+    {
+        return m_bottom.load(std::memory_order_relaxed) <= m_top.load(std::memory_order_relaxed);
+    }
+};
+
+task_scheduler::task_scheduler(const task_scheduler_options& options)
+    : m_pin_threads{ options.pin_threads }
+{
+    const unsigned thread_count = options.thread_count ? options.thread_count : default_thread_count();
+
+    m_deques.reserve(thread_count);
+    for (unsigned slot = 0; slot < thread_count; ++slot)
+        m_deques.push_back(std::make_unique<range_deque>());
+
+    try
+    {
+        m_workers.reserve(thread_count - 1);
+        for (unsigned slot = 1; slot < thread_count; ++slot)
+            m_workers.emplace_back(&task_scheduler::work, this, slot);
+    }
+    catch (...)
+    {
+        stop_workers();
+        throw;
+    }
+}
+
+task_scheduler::~task_scheduler()
+{
+    stop_workers();
+}
+
+void task_scheduler::stop_workers()
+{
+    m_stopping.store(true, std::memory_order_release);
+    wake_workers();
+
+    for (std::thread& worker : m_workers)
+        worker.join();
+
+    m_workers.clear();
+}
+
+unsigned task_scheduler::get_thread_count() const
+{
+    return static_cast<unsigned>(m_deques.size());
+}
+
+void task_scheduler::run(size_t count, unsigned thread_count, const parallel_body& body)
+{
+    if (count == 0)
+        return;
+
+    thread_count = std::min(thread_count ? thread_count : get_thread_count(), get_thread_count());
+
+    if (thread_count == 1)
+    {
+        body.invoke(body.context, 0, count);
+        return;
+    }
+
+    // a loop started from inside a body keeps the deque the thread already has; outside threads share deque 0
+    const bool nested = current_scheduler == this;
+
+    std::unique_lock outside_lock{ m_outside_mutex, std::defer_lock };
+    if (!nested)
+        outside_lock.lock();
+
+    const task_scheduler* const prev_scheduler = current_scheduler;
+    const unsigned prev_slot = current_slot;
+    const unsigned slot = nested ? current_slot : 0;
+
+    current_scheduler = this;
+    current_slot = slot;
+
+    loop_job job{ .body = body, .grain = std::max<size_t>(1, count / (ranges_per_thread * thread_count)), .remaining{ count }, .failed{}, .error{} };
+
+    run_range({ .job = &job, .begin = 0, .end = count, .owner_slot = slot, .thread_limit = thread_count }, slot);
+
+    // help with what's left rather than sleep: the tail of a loop is short, and it's where stragglers get split
+    while (job.remaining.load(std::memory_order_acquire) != 0)
+    {
+        if (!try_run_range(slot))
+            std::this_thread::yield();
+    }
+
+    current_scheduler = prev_scheduler;
+    current_slot = prev_slot;
+
+    if (job.error)
+        std::rethrow_exception(job.error);
+}
+
+void task_scheduler::run_range(loop_range range, unsigned slot)
+{
+    loop_job& job = *range.job;
+    range_deque& deque = *m_deques[slot];
+    const size_t grain = job.grain;
+
+    while (range.end - range.begin > grain)
+    {
+        // split only while nothing is waiting to be stolen; once a thief takes the upper half, split again
+        if (deque.empty())
+        {
+            loop_range upper_half = range;
+            upper_half.begin = range.begin + (range.end - range.begin) / 2;
+
+            if (deque.push(upper_half))
+            {
+                range.end = upper_half.begin;
+                wake_workers();
+                continue;
+            }
+        }
+
+        job.run(range.begin, range.begin + grain);
+        range.begin += grain;
+    }
+
+    job.run(range.begin, range.end);
+}
+
+bool task_scheduler::try_run_range(unsigned slot)
+{
+    std::optional<loop_range> range = m_deques[slot]->pop();
+
+    // then the other deques, starting from the next one so the thieves spread out
+    for (size_t i = 1; !range && i < m_deques.size(); ++i)
+        range = m_deques[(slot + i) % m_deques.size()]->steal(slot);
+
+    if (!range)
+        return false;
+
+    run_range(*range, slot);
+    return true;
+}
+
+void task_scheduler::wake_workers()
+{
+    m_work_epoch.fetch_add(1, std::memory_order_seq_cst);
+    m_work_epoch.notify_all();
+}
+
+void task_scheduler::work(unsigned slot)
+{
+    current_scheduler = this;
+    current_slot = slot;
+
+    // worker slots start at 1, leaving hardware thread 0 to the thread that starts the loops
+    if (m_pin_threads)
+        pin_current_thread(slot);
+
+    int idle_count = 0;
+
+    for (;;)
+    {
+        // read before the search, so a range pushed after it changes the epoch and the wait below returns at once
+        const uint64_t epoch = m_work_epoch.load(std::memory_order_seq_cst);
+
+        if (m_stopping.load(std::memory_order_acquire))
+            return;
+
+        if (try_run_range(slot))
+        {
+            idle_count = 0;
+            continue;
+        }
+
+        if (++idle_count < idle_spin_count)
+        {
+            std::this_thread::yield();
+            continue;
+        }
+
+        m_work_epoch.wait(epoch, std::memory_order_seq_cst);
+        idle_count = 0;
+    }
+}
+
+task_scheduler* task_scheduler::get_active()
+{
+    return active_scheduler.load(std::memory_order_acquire);
+}
+
+task_scheduler_scope::task_scheduler_scope(const task_scheduler_options& options)
+    : m_scheduler{ options }, m_prev_scheduler{ active_scheduler.exchange(&m_scheduler) }
+{
+}
+
+task_scheduler_scope::~task_scheduler_scope()
+{
+    active_scheduler.store(m_prev_scheduler);
+}
@@ -0,0 +1,103 @@
+﻿#ifndef WS_TASKSCHEDULER_HPP
+#define WS_TASKSCHEDULER_HPP
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+inline unsigned default_thread_count()
+{
+    return std::max(1u, std::thread::hardware_concurrency());
+}
+
+struct task_scheduler_options
+{
+    // threads a loop can run on, the thread that starts it included; 0 uses every hardware thread
+    unsigned thread_count{};
+
+    // keeps each worker on one hardware thread, so its caches stay warm from one loop to the next
+    bool pin_threads{};
+};
+
+// the body of a parallel_for, without its type, so the scheduler can live in its own translation unit
+struct parallel_body
+{
+    void* context = nullptr;
+    void (*invoke)(void* context, size_t begin, size_t end) = nullptr;
+};
+
+// Runs loops over index ranges on a fixed set of worker threads. Every worker, and the thread waiting on the loop
+// it started, owns a Chase-Lev deque of ranges: the owner pushes and pops at the bottom, idle workers steal from
+// the top. A range is split lazily, its upper half pushed only while the owner's deque is empty, so ranges are cut
+// about as fast as thieves take them and the grain adapts to how unevenly the work is spread.
+class task_scheduler final
+{
+private:
+    struct loop_job;
+    struct loop_range;
+    class range_deque;
+
+    // deque 0 belongs to whichever outside thread is running a loop, the rest to the workers
+    std::vector<std::unique_ptr<range_deque>> m_deques;
+    std::vector<std::thread> m_workers;
+    std::mutex m_outside_mutex;
+
+    // bumped whenever a range is pushed or the workers should stop; idle workers sleep on it
+    std::atomic<uint64_t> m_work_epoch{};
+    std::atomic<bool> m_stopping{};
+
+    bool m_pin_threads = false;
+
+    void stop_workers();
+    void work(unsigned slot);
+    void run_range(loop_range range, unsigned slot);
+    bool try_run_range(unsigned slot);
+    void wake_workers();
+
+public:
+    explicit task_scheduler(const task_scheduler_options& options = {});
+
+    // stops and joins the workers; loops still running on other threads must have returned
+    ~task_scheduler();
+
+    task_scheduler(const task_scheduler&) = delete;
+    task_scheduler& operator=(const task_scheduler&) = delete;
+    task_scheduler(task_scheduler&&) noexcept = delete;
+    task_scheduler& operator=(task_scheduler&&) noexcept = delete;
+
+    // threads a loop can run on, the calling thread included
+    unsigned get_thread_count() const;
+
+    // Calls body over [0, count) in ranges on up to thread_count threads (capped at get_thread_count), the calling
+    // thread included, and returns once every index has run. The first exception the body throws is rethrown here,
+    // after the ranges not yet started have been skipped. Loops started from outside the workers take turns.
+    void run(size_t count, unsigned thread_count, const parallel_body& body);
+
+    // the scheduler parallel_for runs on, or null outside every task_scheduler_scope
+    static task_scheduler* get_active();
+};
+
+// Starts a scheduler and makes parallel_for run on it until the scope ends, when the previous one (if any) is
+// restored and the workers are joined. Without a scope each parallel_for starts and joins threads of its own.
+class task_scheduler_scope final
+{
+private:
+    task_scheduler m_scheduler;
+    task_scheduler* m_prev_scheduler = nullptr;
+
+public:
+    explicit task_scheduler_scope(const task_scheduler_options& options = {});
+    ~task_scheduler_scope();
+
+    task_scheduler_scope(const task_scheduler_scope&) = delete;
+    task_scheduler_scope& operator=(const task_scheduler_scope&) = delete;
+    task_scheduler_scope(task_scheduler_scope&&) noexcept = delete;
+    task_scheduler_scope& operator=(task_scheduler_scope&&) noexcept = delete;
+};
+
+#endif
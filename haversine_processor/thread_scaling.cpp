@@ -0,0 +1,110 @@
+#include "thread_scaling.hpp"
+
+#include <algorithm>
+#include <stdexcept>
+#include <format>
+#include <iostream>
+
+namespace
+{
+    scaling_point measure_point(const char* name, uint64_t elapsed_cycles, uint64_t single_thread_cycles, unsigned thread_count, double cpu_freq)
+    {
+        const double speedup = elapsed_cycles ? static_cast<double>(single_thread_cycles) / elapsed_cycles : 0.0;
+
+        return {
+            .name = name,
+            .duration_ms = 1000.0 * elapsed_cycles / cpu_freq,
+            .speedup = speedup,
+            .efficiency = speedup / thread_count
+        };
+    }
+
+    uint64_t total_cycles(const scaling_pass& pass)
+    {
+        uint64_t cycles = 0;
+        for (const stage_timing& stage : pass.stages)
+            cycles += stage.elapsed_cycles;
+
+        return cycles;
+    }
+}
+
+std::vector<unsigned> scaling_thread_counts(unsigned max_thread_count)
+{
+    std::vector<unsigned> thread_counts;
+
+    for (unsigned thread_count = 1; thread_count < max_thread_count; thread_count *= 2)
+        thread_counts.push_back(thread_count);
+
+    thread_counts.push_back(std::max(max_thread_count, 1u));
+
+    return thread_counts;
+}
+
+std::vector<pass_scaling> summarize_thread_scaling(std::span<const scaling_pass> passes)
+{
+    const uint64_t cpu_freq = estimate_cpu_timer_freq();
+    if (!cpu_freq)
+        throw std::runtime_error{ "Failed to estimate CPU frequency." };
+
+    std::vector<pass_scaling> scaling;
+    if (passes.empty())
+        return scaling;
+
+    const scaling_pass& single_thread = passes.front();
+
+    for (const scaling_pass& pass : passes)
+    {
+        if (pass.stages.size() != single_thread.stages.size())
+            throw std::runtime_error{ "The scaling passes ran different stages." };
+
+        pass_scaling& result = scaling.emplace_back();
+        result.thread_count = pass.thread_count;
+        result.total = measure_point("total", total_cycles(pass), total_cycles(single_thread), pass.thread_count, static_cast<double>(cpu_freq));
+
+        for (size_t i = 0; i < pass.stages.size(); ++i)
+        {
+            const stage_timing& stage = pass.stages[i];
+            result.stages.push_back(measure_point(stage.name, stage.elapsed_cycles, single_thread.stages[i].elapsed_cycles, pass.thread_count, static_cast<double>(cpu_freq)));
+        }
+    }
+
+    return scaling;
+}
+
+void print_thread_scaling(std::span<const pass_scaling> scaling)
+{
+    if (scaling.empty())
+        return;
+
+    std::cout << "Thread scaling:\n";
+    std::cout << std::format("  {:>7}  {:>12}  {:>8}  {:>10}\n", "Threads", "Time (ms)", "Speedup", "Efficiency");
+
+    for (const pass_scaling& pass : scaling)
+    {
+        std::cout << std::format("  {:>7}  {:>12.3f}  {:>7.2f}x  {:>9.1f}%\n",
+                                 pass.thread_count, pass.total.duration_ms, pass.total.speedup, 100.0 * pass.total.efficiency);
+    }
+
+    // one curve per stage: a stage that stops speeding up while the others keep going is the one hitting a
+    // shared limit, usually memory bandwidth
+    std::cout << "\nStage speedup by thread count:\n";
+    std::cout << std::format("  {:<28}{:>12}", "Stage", "1 thread ms");
+
+    for (const pass_scaling& pass : scaling.subspan(1))
+        std::cout << std::format("{:>9}", pass.thread_count);
+
+    std::cout << '\n';
+
+    for (size_t i = 0; i < scaling.front().stages.size(); ++i)
+    {
+        std::cout << std::format("  {:<28}{:>12.3f}", scaling.front().stages[i].name, scaling.front().stages[i].duration_ms);
+
+        for (const pass_scaling& pass : scaling.subspan(1))
+            std::cout << std::format("{:>8.2f}x", pass.stages[i].speedup);
+
+        std::cout << '\n';
+    }
+
+    std::cout << '\n';
+}
@@ -0,0 +1,69 @@
+﻿#ifndef WS_THREADSCALING_HPP
+#define WS_THREADSCALING_HPP
+
+#include <cstdint>
+#include <span>
+#include <type_traits>
+#include <vector>
+
+#include "platform_metrics.hpp"
+
+struct stage_timing
+{
+    const char* name = nullptr;
+    uint64_t elapsed_cycles{};
+};
+
+// One run of a pipeline at one thread count. Stages are timed from the calling thread, so their times are wall
+// clock times however many threads did the work.
+struct scaling_pass
+{
+    unsigned thread_count{};
+    std::vector<stage_timing> stages;
+};
+
+// runs func as the next stage of the pass and returns its result
+template<typename Func>
+auto time_stage(scaling_pass& pass, const char* name, Func&& func)
+{
+    const uint64_t start_time = read_cpu_timer();
+
+    if constexpr (std::is_void_v<std::invoke_result_t<Func>>)
+    {
+        func();
+        pass.stages.push_back({ name, read_cpu_timer() - start_time });
+    }
+    else
+    {
+        auto result = func();
+        pass.stages.push_back({ name, read_cpu_timer() - start_time });
+        return result;
+    }
+}
+
+// a stage's or a whole pass's time, and its speedup and parallel efficiency against the single-thread pass
+struct scaling_point
+{
+    const char* name = nullptr;
+    double duration_ms{};
+    double speedup{};
+    double efficiency{};
+};
+
+struct pass_scaling
+{
+    unsigned thread_count{};
+    scaling_point total;
+    std::vector<scaling_point> stages;
+};
+
+// 1, 2, 4, ... up to max_thread_count, which is always included
+std::vector<unsigned> scaling_thread_counts(unsigned max_thread_count);
+
+// Compares every pass against the first, which must be the single-thread one. The passes must have run the same
+// stages in the same order.
+std::vector<pass_scaling> summarize_thread_scaling(std::span<const scaling_pass> passes);
+
+void print_thread_scaling(std::span<const pass_scaling> scaling);
+
+#endif
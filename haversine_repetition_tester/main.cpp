@@ -0,0 +1,322 @@
+#include <charconv>
+#include <cstdint>
+#include <cstdlib>
+#include <exception>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "../haversine_processor/haversine_formula.hpp"
+#include "../haversine_processor/json/model.hpp"
+#include "../haversine_processor/json/parser.hpp"
+#include "../haversine_processor/json/scanner.hpp"
+#include "../haversine_processor/json/token.hpp"
+#include "../haversine_processor/platform_metrics.hpp"
+#include "../haversine_processor/point_input.hpp"
+#include "../haversine_processor/profiler.hpp"
+#include "repetition_tester.hpp"
+
+namespace
+{
+    struct tester_arguments
+    {
+        const char* input_path = nullptr;
+        uint32_t seconds_to_try = repetition_tester::default_seconds_to_try;
+        bool profile = false;
+    };
+
+    // everything the tests need, prepared once so each test only times its own stage
+    struct test_input
+    {
+        std::string path;
+        uintmax_t file_size{};
+        std::string contents;
+        std::vector<json::token> tokens;
+        std::vector<globe_point_pair> point_pairs;
+    };
+
+    struct test_function
+    {
+        const char* name = nullptr;
+        uint64_t(*target_bytes)(const test_input&) = nullptr;
+        void(*run)(repetition_tester&, const test_input&) = nullptr;
+    };
+
+    // byte counts match the data_processed totals of the corresponding profile blocks
+
+    uint64_t file_bytes(const test_input& input)
+    {
+        return input.file_size;
+    }
+
+    uint64_t token_bytes(const test_input& input)
+    {
+        return input.tokens.size() * sizeof(json::token);
+    }
+
+    uint64_t pair_bytes(const test_input& input)
+    {
+        return input.point_pairs.size() * sizeof(globe_point_pair);
+    }
+
+    void test_read_file(repetition_tester& tester, const test_input& input)
+    {
+        std::string buffer(input.file_size, '\0');
+
+        tester.begin_time();
+
+        std::ifstream input_file{ input.path, std::ios::binary };
+        input_file.read(buffer.data(), static_cast<std::streamsize>(buffer.size()));
+        const std::streamsize bytes_read = input_file.gcount();
+
+        tester.end_time();
+
+        if (!input_file)
+        {
+            tester.error("Could not read the input file.");
+            return;
+        }
+
+        tester.count_bytes(static_cast<uint64_t>(bytes_read));
+    }
+
+    void test_scan(repetition_tester& tester, const test_input& input)
+    {
+        std::istringstream input_stream{ input.contents };
+
+        tester.begin_time();
+        const std::vector<json::token> tokens = json::scanner::scan(input_stream, input.file_size);
+        tester.end_time();
+
+        if (tokens.size() != input.tokens.size())
+        {
+            tester.error("The scanner produced a different number of tokens.");
+            return;
+        }
+
+        tester.count_bytes(input.file_size);
+    }
+
+    void test_parse(repetition_tester& tester, const test_input& input)
+    {
+        tester.begin_time();
+        const json::json_document document = json::parser::parse(input.tokens);
+        tester.end_time();
+
+        tester.count_bytes(input.tokens.size() * sizeof(json::token));
+    }
+
+    void test_haversine(repetition_tester& tester, const test_input& input)
+    {
+        tester.begin_time();
+
+        const double sum_coeff = 1.0 / input.point_pairs.size();
+        double mean_distance = 0.0;
+
+        for (const auto& [p1, p2] : input.point_pairs)
+            mean_distance += sum_coeff * haversine_distance(p1, p2);
+
+        tester.end_time();
+
+        // keeps the loop from being optimized away
+        if (!(mean_distance >= 0.0))
+        {
+            tester.error("The haversine mean is not a number.");
+            return;
+        }
+
+        tester.count_bytes(input.point_pairs.size() * sizeof(globe_point_pair));
+    }
+
+    // The same short dependency chain with and without a profile block around each step. With the profiler
+    // disabled, or compiled out, the difference is what an idle block costs; --profile shows a recording one.
+    constexpr uint64_t block_loop_count = uint64_t{ 1 } << 20;
+
+    // keeps the loops from being optimized away
+    volatile uint64_t block_loop_result{};
+
+    uint64_t block_loop_bytes(const test_input&)
+    {
+        return block_loop_count * sizeof(uint64_t);
+    }
+
+    uint64_t block_loop_step(uint64_t value, uint64_t i)
+    {
+        return value * 6364136223846793005 + i;
+    }
+
+    void test_plain_loop(repetition_tester& tester, const test_input&)
+    {
+        uint64_t value = 1;
+
+        tester.begin_time();
+
+        for (uint64_t i = 0; i < block_loop_count; ++i)
+            value = block_loop_step(value, i);
+
+        tester.end_time();
+
+        block_loop_result = value;
+        tester.count_bytes(block_loop_count * sizeof(uint64_t));
+    }
+
+    void test_block_loop(repetition_tester& tester, const test_input&)
+    {
+        uint64_t value = 1;
+
+        tester.begin_time();
+
+        for (uint64_t i = 0; i < block_loop_count; ++i)
+        {
+            PROFILE_BLOCK("block_loop_step");
+            value = block_loop_step(value, i);
+        }
+
+        tester.end_time();
+
+        block_loop_result = value;
+        tester.count_bytes(block_loop_count * sizeof(uint64_t));
+    }
+
+    constexpr test_function test_functions[] =
+    {
+        { "read_file", file_bytes, test_read_file },
+        { "scanner::scan", file_bytes, test_scan },
+        { "parser::parse", token_bytes, test_parse },
+        { "haversine_distance", pair_bytes, test_haversine },
+        { "loop without profile blocks", block_loop_bytes, test_plain_loop },
+        { "loop with profile blocks", block_loop_bytes, test_block_loop },
+    };
+
+    bool parse_arguments(int argc, char* argv[], tester_arguments& app_args, const std::string& usage_message)
+    {
+        constexpr std::string_view seconds_prefix = "--seconds=";
+
+        for (int i = 1; i < argc; ++i)
+        {
+            const std::string_view arg = argv[i];
+
+            if (arg.starts_with(seconds_prefix))
+            {
+                const std::string_view value = arg.substr(seconds_prefix.size());
+                const auto [end, error] = std::from_chars(value.data(), value.data() + value.size(), app_args.seconds_to_try);
+
+                if (error != std::errc{} || end != value.data() + value.size() || app_args.seconds_to_try == 0)
+                {
+                    std::cout << usage_message << "\n\n";
+                    std::cout << "Invalid option '" << arg << "'.\n";
+                    return false;
+                }
+            }
+            else if (arg == "--profile")
+            {
+                app_args.profile = true;
+            }
+            else if (!arg.starts_with("--") && !app_args.input_path)
+            {
+                app_args.input_path = argv[i];
+            }
+            else
+            {
+                std::cout << usage_message << "\n\n";
+                std::cout << "Unrecognized option '" << arg << "'.\n";
+                return false;
+            }
+        }
+
+        if (!app_args.input_path)
+        {
+            std::cout << usage_message << "\n";
+            return false;
+        }
+
+        return true;
+    }
+
+    test_input load_test_input(const char* path)
+    {
+        test_input input{ .path = path, .file_size = 0, .contents = {}, .tokens = {}, .point_pairs = {} };
+
+        if (!std::filesystem::exists(input.path))
+            throw std::runtime_error{ "JSON file does not exist." };
+
+        input.file_size = std::filesystem::file_size(input.path);
+
+        std::ifstream input_file{ input.path, std::ios::binary };
+        if (!input_file)
+            throw std::runtime_error{ "Cannot open JSON file." };
+
+        input.contents.assign(std::istreambuf_iterator<char>{ input_file }, std::istreambuf_iterator<char>{});
+
+        std::istringstream input_stream{ input.contents };
+        input.tokens = json::scanner::scan(input_stream, input.file_size);
+        input.point_pairs = read_point_pairs(json::parser::parse(input.tokens));
+
+        if (input.point_pairs.empty())
+            throw std::runtime_error{ "The input has no point pairs." };
+
+        return input;
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    begin_timer_calibration();
+
+    const std::string exe_filename = std::filesystem::path(argv[0]).filename().string();
+    const std::string usage_message = "Usage: " + exe_filename + " [--seconds=<count>] [--profile] [haversine_input.json]\n\n"
+                                      "Repeats each stage of the haversine processor until it goes <count> seconds (default "
+                                      + std::to_string(repetition_tester::default_seconds_to_try) + ") without a new fastest time.\n"
+                                      "--profile (or HAVERSINE_PROFILE=1) times the stages with their profile blocks recording.";
+
+    tester_arguments app_args;
+    if (!parse_arguments(argc, argv, app_args, usage_message))
+        return EXIT_FAILURE;
+
+    if (app_args.profile || profiler::is_requested_by_environment())
+        profiler::enable();
+
+    try
+    {
+        const timer_calibration calibration = get_timer_calibration();
+        const uint64_t cpu_freq = calibration.cpu_freq;
+        if (!cpu_freq)
+            throw std::runtime_error{ "Failed to estimate CPU frequency." };
+
+        const test_input input = load_test_input(app_args.input_path);
+
+        std::cout << "--- Haversine Repetition Tester ---\n\n";
+        std::cout << "Input file: " << std::filesystem::path(input.path).filename().string() << "\n";
+        std::cout << "CPU freq: " << cpu_freq << " (" << to_string(calibration.source) << ")\n";
+        std::cout << "Profile blocks: " << (!PROFILER ? "compiled out" : profiler::is_enabled() ? "recording" : "disabled") << "\n";
+
+        for (const test_function& test : test_functions)
+        {
+            std::cout << "\n--- " << test.name << " ---\n";
+
+            repetition_tester tester;
+            tester.new_test_wave(test.target_bytes(input), cpu_freq, app_args.seconds_to_try);
+
+            while (tester.is_testing())
+                test.run(tester, input);
+        }
+    }
+    catch (std::exception& ex)
+    {
+        std::cout << "ERROR!! " << ex.what() << '\n';
+        return EXIT_FAILURE;
+    }
+    catch (...)
+    {
+        std::cout << "UNKNOWN ERROR!!\n";
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
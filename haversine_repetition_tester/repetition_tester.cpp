@@ -0,0 +1,161 @@
+#include "repetition_tester.hpp"
+
+#include <algorithm>
+#include <format>
+#include <iostream>
+#include <limits>
+
+#include "../haversine_processor/allocation_tracker.hpp"
+#include "../haversine_processor/platform_metrics.hpp"
+
+namespace
+{
+    uint64_t read_page_fault_total()
+    {
+        const page_fault_counts faults = read_page_faults();
+        return faults.minor_faults + faults.major_faults;
+    }
+}
+
+void repetition_tester::new_test_wave(uint64_t target_bytes, uint64_t cpu_freq, uint32_t seconds_to_try)
+{
+    if (m_state == test_state::completed && target_bytes == m_target_bytes && cpu_freq == m_cpu_freq)
+    {
+        m_state = test_state::testing;
+    }
+    else
+    {
+        m_state = test_state::testing;
+        m_target_bytes = target_bytes;
+        m_cpu_freq = cpu_freq;
+        m_results = { .min_cycles = std::numeric_limits<uint64_t>::max(), .bytes_processed = target_bytes };
+    }
+
+    m_open_block_count = 0;
+    m_close_block_count = 0;
+    m_cycles_accumulated = 0;
+    m_bytes_accumulated = 0;
+    m_page_faults_accumulated = 0;
+
+    m_try_for_cycles = seconds_to_try * cpu_freq;
+    m_tests_started_at = read_cpu_timer();
+}
+
+void repetition_tester::begin_time()
+{
+    ++m_open_block_count;
+    m_page_faults_accumulated -= read_page_fault_total();
+    m_cycles_accumulated -= read_cpu_timer();
+}
+
+void repetition_tester::end_time()
+{
+    m_cycles_accumulated += read_cpu_timer();
+    m_page_faults_accumulated += read_page_fault_total();
+    ++m_close_block_count;
+}
+
+void repetition_tester::error(const std::string& message)
+{
+    m_state = test_state::error;
+    std::cout << "\nERROR: " << message << '\n';
+}
+
+bool repetition_tester::is_testing()
+{
+    if (m_state != test_state::testing)
+        return false;
+
+    const uint64_t current_time = read_cpu_timer();
+
+    // a repetition just finished, unless this is the first call of the wave
+    if (m_open_block_count)
+    {
+        if (m_open_block_count != m_close_block_count)
+            error("Unbalanced begin_time/end_time.");
+
+        if (m_bytes_accumulated != m_target_bytes)
+            error(std::format("Processed {} bytes instead of {}.", m_bytes_accumulated, m_target_bytes));
+
+        if (m_state == test_state::testing)
+        {
+            const uint64_t elapsed = m_cycles_accumulated;
+            const uint64_t page_faults = m_page_faults_accumulated;
+
+            ++m_results.test_count;
+            m_results.total_cycles += elapsed;
+            m_results.total_page_faults += page_faults;
+
+            if (elapsed > m_results.max_cycles)
+            {
+                m_results.max_cycles = elapsed;
+                m_results.max_page_faults = page_faults;
+            }
+
+            if (elapsed < m_results.min_cycles)
+            {
+                m_results.min_cycles = elapsed;
+                m_results.min_page_faults = page_faults;
+
+                // a new minimum restarts the clock
+                m_tests_started_at = current_time;
+
+                std::cout << "\r                                                            \r";
+                print_time("Min", static_cast<double>(elapsed), m_target_bytes, static_cast<double>(page_faults));
+                std::cout << std::flush;
+            }
+        }
+
+        m_open_block_count = 0;
+        m_close_block_count = 0;
+        m_cycles_accumulated = 0;
+        m_bytes_accumulated = 0;
+        m_page_faults_accumulated = 0;
+    }
+
+    if (m_state == test_state::testing && current_time - m_tests_started_at > m_try_for_cycles)
+    {
+        m_state = test_state::completed;
+
+        std::cout << "\r                                                            \r";
+        print_results();
+    }
+
+    return m_state == test_state::testing;
+}
+
+void repetition_tester::print_time(const char* label, double cycles, uint64_t bytes, double page_faults) const
+{
+    std::cout << std::format("{}: {:.0f}", label, cycles);
+
+    if (m_cpu_freq)
+    {
+        const double seconds = cycles / m_cpu_freq;
+        std::cout << std::format(" ({:.6f} ms)", 1000.0 * seconds);
+
+        if (bytes && seconds > 0.0)
+        {
+            constexpr double gigabyte = 1024.0 * 1024.0 * 1024.0;
+            std::cout << std::format(" {:.6f} GB/s", bytes / (gigabyte * seconds));
+        }
+    }
+
+    if (page_faults > 0.0)
+        std::cout << std::format(" PF: {:.4f} ({:.4f} KiB/fault)", page_faults, bytes / (1024.0 * page_faults));
+}
+
+void repetition_tester::print_results() const
+{
+    if (!m_results.test_count)
+        return;
+
+    print_time("Min", static_cast<double>(m_results.min_cycles), m_results.bytes_processed, static_cast<double>(m_results.min_page_faults));
+    std::cout << '\n';
+
+    print_time("Max", static_cast<double>(m_results.max_cycles), m_results.bytes_processed, static_cast<double>(m_results.max_page_faults));
+    std::cout << '\n';
+
+    const double test_count = static_cast<double>(m_results.test_count);
+    print_time("Avg", m_results.total_cycles / test_count, m_results.bytes_processed, m_results.total_page_faults / test_count);
+    std::cout << std::format("\nTests: {}\n", m_results.test_count);
+}
@@ -0,0 +1,84 @@
+﻿#ifndef WS_REPETITIONTESTER_HPP
+#define WS_REPETITIONTESTER_HPP
+
+#include <cstdint>
+#include <string>
+
+struct repetition_results
+{
+    uint64_t test_count{};
+    uint64_t total_cycles{};
+    uint64_t min_cycles{};
+    uint64_t max_cycles{};
+    uint64_t bytes_processed{};
+
+    // page faults taken inside the timed sections: in total, and by the fastest and slowest repetitions
+    uint64_t total_page_faults{};
+    uint64_t min_page_faults{};
+    uint64_t max_page_faults{};
+};
+
+// Runs a target over and over until it goes a set number of seconds without producing a new minimum time. The
+// minimum is the closest estimate of the target's real cost, since a later repetition can only be slowed down
+// by page faults, cold caches, interrupts or the clock still ramping up; the mean and maximum show how noisy the
+// target is.
+//
+// Usage:
+//     tester.new_test_wave(expected_bytes, cpu_freq);
+//     while (tester.is_testing())
+//     {
+//         tester.begin_time();
+//         ...target...
+//         tester.end_time();
+//         tester.count_bytes(bytes);
+//     }
+//
+// A repetition may time several begin/end sections; they are summed into one measurement.
+class repetition_tester
+{
+private:
+    enum class test_state
+    {
+        idle,
+        testing,
+        completed,
+        error
+    };
+
+    test_state m_state = test_state::idle;
+    uint64_t m_target_bytes{};
+    uint64_t m_cpu_freq{};
+    uint64_t m_try_for_cycles{};
+    uint64_t m_tests_started_at{};
+
+    uint32_t m_open_block_count{};
+    uint32_t m_close_block_count{};
+    uint64_t m_cycles_accumulated{};
+    uint64_t m_bytes_accumulated{};
+    uint64_t m_page_faults_accumulated{};
+
+    repetition_results m_results;
+
+    void print_time(const char* label, double cycles, uint64_t bytes, double page_faults) const;
+
+public:
+    static constexpr uint32_t default_seconds_to_try = 10;
+
+    // starts a new set of repetitions; the minimum carries over if the previous wave tested the same byte count,
+    // so a wave can be rerun to confirm a result
+    void new_test_wave(uint64_t target_bytes, uint64_t cpu_freq, uint32_t seconds_to_try = default_seconds_to_try);
+
+    void begin_time();
+    void end_time();
+    void count_bytes(uint64_t byte_count) { m_bytes_accumulated += byte_count; }
+
+    void error(const std::string& message);
+
+    bool is_testing();
+
+    const repetition_results& results() const { return m_results; }
+
+    void print_results() const;
+};
+
+#endif